@@ -0,0 +1,33 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/ztest.h>
+#include <zephyr/logging/log.h>
+#include "gdo_config.h"
+#include "gdo_file_system_util.h"
+#include "gdo_fs_benchmark.h"
+
+LOG_MODULE_REGISTER(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+static void *gdo_fs_bench_setup(void)
+{
+  zassert_true(gdo_file_system_init(), "gdo_file_system_init failed");
+  return NULL;
+}
+
+ZTEST(gdo_fs_benchmark, test_run)
+{
+  /* results are the "BENCH " lines on the console */
+  zassert_ok(gdo_fs_benchmark_run());
+}
+
+ZTEST_SUITE(gdo_fs_benchmark, NULL, gdo_fs_bench_setup, NULL, NULL, NULL);
@@ -0,0 +1,276 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_file_system_util.h"
+#include "gdo_flash_cache.h"
+#include "gdo_event_log.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+#define EVENT_SEGMENT_SIZE  GDO_FLASH_SECTOR_SIZE
+#define EVENT_SEGMENT_NUM   (GDO_EVENT_LOG_REGION_SIZE / EVENT_SEGMENT_SIZE)
+#define EVENT_SEGMENT_MAGIC 0x45564C47 /* "EVLG" */
+#define EVENT_RECORD_MAGIC  0xA5
+#define EVENT_ALIGN         4
+
+BUILD_ASSERT(EVENT_SEGMENT_NUM >= 2, "event log needs at least two segments");
+BUILD_ASSERT((GDO_EVENT_LOG_REGION_OFFSET % GDO_FLASH_SECTOR_SIZE) == 0, "event log region must be sector aligned");
+
+struct event_segment_header {
+  uint32_t magic;
+  uint32_t segment_seq; /* increases by one per segment, picks the head at mount */
+  uint32_t first_event_seq;
+  uint32_t crc;
+} __packed;
+
+struct event_record_header {
+  uint8_t magic; /* erased flash (0xFF) marks the end of a segment */
+  uint8_t type;
+  uint16_t len;
+  uint32_t seq;
+  uint32_t timestamp;
+  uint16_t crc; /* over this header up to crc, then the payload */
+  uint16_t reserved;
+} __packed;
+
+#define EVENT_RECORD_SPACE(len) ROUND_UP(sizeof(struct event_record_header) + (len), EVENT_ALIGN)
+
+K_MUTEX_DEFINE(event_log_lock);
+
+static uint32_t head_segment;    /* index of the segment being appended */
+static uint32_t head_segment_seq;
+static uint32_t head_offset;     /* write offset inside the head segment */
+static uint32_t next_event_seq;
+static uint32_t pending_flush;
+static bool event_log_ready;
+
+static off_t segment_addr(uint32_t segment)
+{
+  return GDO_EVENT_LOG_REGION_OFFSET + (off_t) segment * EVENT_SEGMENT_SIZE;
+}
+
+static uint32_t segment_header_crc(const struct event_segment_header *header)
+{
+  return crc32_ieee((const uint8_t *) header, offsetof(struct event_segment_header, crc));
+}
+
+static bool segment_header_read(uint32_t segment, struct event_segment_header *header)
+{
+  if (!gdo_flash_read_offset(segment_addr(segment), (uint8_t *) header, sizeof(*header))) {
+    return false;
+  }
+  return header->magic == EVENT_SEGMENT_MAGIC && header->crc == segment_header_crc(header);
+}
+
+static uint16_t record_crc(const struct event_record_header *header, const uint8_t *payload)
+{
+  uint16_t crc = crc16_ccitt(0xFFFF, (const uint8_t *) header, offsetof(struct event_record_header, crc));
+  return crc16_ccitt(crc, payload, header->len);
+}
+
+/* Erase @p segment and make it the head. Caller holds event_log_lock. */
+static int segment_open(uint32_t segment, uint32_t segment_seq)
+{
+  struct event_segment_header header = {
+      .magic           = EVENT_SEGMENT_MAGIC,
+      .segment_seq     = segment_seq,
+      .first_event_seq = next_event_seq,
+  };
+
+  header.crc = segment_header_crc(&header);
+  if (!gdo_flash_earse_region(segment_addr(segment), EVENT_SEGMENT_SIZE)) {
+    return -EIO;
+  }
+  if (!gdo_flash_write_offset(segment_addr(segment), (uint8_t *) &header, sizeof(header))) {
+    return -EIO;
+  }
+  head_segment     = segment;
+  head_segment_seq = segment_seq;
+  head_offset      = sizeof(header);
+  return 0;
+}
+
+/*
+ * Walk the records of one segment. Stops at erased space or the first damaged record and
+ * returns the offset after the last good one. Caller holds event_log_lock.
+ */
+static uint32_t segment_scan(uint32_t segment, uint32_t from_seq, gdo_event_log_cb_t cb, void *user_data, int *cb_res)
+{
+  static uint8_t payload[GDO_EVENT_LOG_MAX_PAYLOAD];
+  struct event_record_header header;
+  uint32_t offset = sizeof(struct event_segment_header);
+
+  *cb_res = 0;
+  while (offset + sizeof(header) <= EVENT_SEGMENT_SIZE) {
+    if (!gdo_flash_read_offset(segment_addr(segment) + offset, (uint8_t *) &header, sizeof(header)) ||
+        header.magic != EVENT_RECORD_MAGIC || header.len > GDO_EVENT_LOG_MAX_PAYLOAD ||
+        offset + EVENT_RECORD_SPACE(header.len) > EVENT_SEGMENT_SIZE) {
+      break;
+    }
+    if (!gdo_flash_read_offset(segment_addr(segment) + offset + sizeof(header), payload, header.len) ||
+        header.crc != record_crc(&header, payload)) {
+      break;
+    }
+    if (header.seq >= next_event_seq) {
+      next_event_seq = header.seq + 1;
+    }
+    if (cb != NULL && header.seq >= from_seq) {
+      gdo_event_log_entry entry = {
+          .seq       = header.seq,
+          .timestamp = header.timestamp,
+          .type      = header.type,
+          .len       = header.len,
+          .payload   = payload,
+      };
+      *cb_res = cb(&entry, user_data);
+      if (*cb_res != 0) {
+        break;
+      }
+    }
+    offset += EVENT_RECORD_SPACE(header.len);
+  }
+  return offset;
+}
+
+int gdo_event_log_init(void)
+{
+  struct event_segment_header header;
+  bool found = false;
+  int cb_res;
+  int res = 0;
+
+  k_mutex_lock(&event_log_lock, K_FOREVER);
+  next_event_seq = 0;
+  for (uint32_t segment = 0; segment < EVENT_SEGMENT_NUM; segment++) {
+    if (segment_header_read(segment, &header) && (!found || (int32_t) (header.segment_seq - head_segment_seq) > 0)) {
+      found            = true;
+      head_segment     = segment;
+      head_segment_seq = header.segment_seq;
+      next_event_seq   = header.first_event_seq;
+    }
+  }
+  if (!found) {
+    LOG_INF("EVENT-LOG: empty, formatting");
+    res = segment_open(0, 0);
+  } else {
+    head_offset = segment_scan(head_segment, 0, NULL, NULL, &cb_res);
+  }
+  pending_flush   = 0;
+  event_log_ready = (res == 0);
+  k_mutex_unlock(&event_log_lock);
+  return res;
+}
+
+int gdo_event_log_append(uint8_t type, uint32_t timestamp, const void *payload, size_t len)
+{
+  static uint8_t record[EVENT_RECORD_SPACE(GDO_EVENT_LOG_MAX_PAYLOAD)];
+  struct event_record_header *header = (struct event_record_header *) record;
+  size_t space = EVENT_RECORD_SPACE(len);
+  int res;
+
+  if (len > GDO_EVENT_LOG_MAX_PAYLOAD) {
+    return -EINVAL;
+  }
+  k_mutex_lock(&event_log_lock, K_FOREVER);
+  if (!event_log_ready) {
+    res = -EAGAIN;
+    goto exit;
+  }
+  if (head_offset + space > EVENT_SEGMENT_SIZE) {
+    /* the next segment holds the oldest events, they are dropped */
+    res = segment_open((head_segment + 1) % EVENT_SEGMENT_NUM, head_segment_seq + 1);
+    if (res != 0) {
+      goto exit;
+    }
+  }
+  memset(record, 0xFF, space);
+  header->magic     = EVENT_RECORD_MAGIC;
+  header->type      = type;
+  header->len       = len;
+  header->seq       = next_event_seq;
+  header->timestamp = timestamp;
+  header->reserved  = 0xFFFF;
+  memcpy(record + sizeof(*header), payload, len);
+  header->crc = record_crc(header, record + sizeof(*header));
+
+  if (!gdo_flash_write_offset(segment_addr(head_segment) + head_offset, record, space)) {
+    res = -EIO;
+    goto exit;
+  }
+  head_offset += space;
+  res = next_event_seq++;
+  if (++pending_flush >= GDO_EVENT_LOG_FLUSH_EVERY) {
+    pending_flush = 0;
+    if (!gdo_flash_flush()) {
+      res = -EIO;
+    }
+  }
+exit:
+  k_mutex_unlock(&event_log_lock);
+  return res;
+}
+
+int gdo_event_log_sync(void)
+{
+  k_mutex_lock(&event_log_lock, K_FOREVER);
+  pending_flush = 0;
+  int res = gdo_flash_flush() ? 0 : -EIO;
+  k_mutex_unlock(&event_log_lock);
+  return res;
+}
+
+int gdo_event_log_walk(uint32_t from_seq, gdo_event_log_cb_t cb, void *user_data)
+{
+  struct event_segment_header header;
+  int cb_res = 0;
+
+  k_mutex_lock(&event_log_lock, K_FOREVER);
+  /* oldest segment is the one after the head, older slots may still be blank after a clear */
+  for (uint32_t i = 1; i <= EVENT_SEGMENT_NUM && cb_res == 0; i++) {
+    uint32_t segment = (head_segment + i) % EVENT_SEGMENT_NUM;
+
+    if (!segment_header_read(segment, &header)) {
+      continue;
+    }
+    /* skip whole segments that end before from_seq */
+    if (segment != head_segment) {
+      struct event_segment_header next;
+      uint32_t next_segment = (segment + 1) % EVENT_SEGMENT_NUM;
+      if (segment_header_read(next_segment, &next) && next.segment_seq == header.segment_seq + 1 &&
+          (int32_t) (next.first_event_seq - from_seq) <= 0) {
+        continue;
+      }
+    }
+    segment_scan(segment, from_seq, cb, user_data, &cb_res);
+  }
+  k_mutex_unlock(&event_log_lock);
+  return cb_res;
+}
+
+int gdo_event_log_clear(void)
+{
+  k_mutex_lock(&event_log_lock, K_FOREVER);
+  int res = gdo_flash_earse_region(GDO_EVENT_LOG_REGION_OFFSET, GDO_EVENT_LOG_REGION_SIZE) ? 0 : -EIO;
+  if (res == 0) {
+    next_event_seq = 0;
+    res            = segment_open(0, 0);
+  }
+  pending_flush   = 0;
+  event_log_ready = (res == 0);
+  k_mutex_unlock(&event_log_lock);
+  return res;
+}
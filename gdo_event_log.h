@@ -0,0 +1,69 @@
+#ifndef _GDO_EVENT_LOG_H_
+#define _GDO_EVENT_LOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Largest payload of one event */
+#ifndef GDO_EVENT_LOG_MAX_PAYLOAD
+#define GDO_EVENT_LOG_MAX_PAYLOAD 256
+#endif
+
+/* Appends buffered in the flash cache before they are programmed, 1 = every event is durable on return */
+#ifndef GDO_EVENT_LOG_FLUSH_EVERY
+#define GDO_EVENT_LOG_FLUSH_EVERY 1
+#endif
+
+typedef struct {
+  uint32_t seq;
+  uint32_t timestamp;
+  uint8_t type;
+  uint16_t len;
+  const uint8_t *payload;
+} gdo_event_log_entry;
+
+/*
+ * Return 0 to continue, anything else stops the walk and is returned by gdo_event_log_walk.
+ * The payload pointer is only valid during the callback.
+ */
+typedef int (*gdo_event_log_cb_t)(const gdo_event_log_entry *entry, void *user_data);
+
+/**
+ * @brief Mount the event log, an append-only ring of flash sectors in the raw external_flash region.
+ *
+ * Only the segment headers and the newest segment are read to find the head.
+ *
+ * @return 0 on success, or a negative error code.
+ */
+int gdo_event_log_init(void);
+
+/**
+ * @brief Append one event, O(1). When the head segment is full the oldest segment is erased and reused.
+ *
+ * @return Sequence number of the event (>= 0) on success, or a negative error code.
+ */
+int gdo_event_log_append(uint8_t type, uint32_t timestamp, const void *payload, size_t len);
+
+/**
+ * @brief Program buffered events to the flash.
+ */
+int gdo_event_log_sync(void);
+
+/**
+ * @brief Call @p cb for every retained event with a sequence number >= @p from_seq, oldest first.
+ */
+int gdo_event_log_walk(uint32_t from_seq, gdo_event_log_cb_t cb, void *user_data);
+
+/**
+ * @brief Erase the whole log.
+ */
+int gdo_event_log_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -13,16 +13,33 @@
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
 #include <zephyr/fs/fs.h>
-#include <zephyr/fs/littlefs.h>
 #include <zephyr/logging/log.h>
-#include <zephyr/storage/flash_map.h>
 #include "gdo_config.h"
 #include "gdo_file_system_util.h"
 #include <zephyr/devicetree.h>
 #include <stdio.h>
 #include <string.h>
 #include "gdo_user_infor_util.h"
+#include "gdo_user_index.h"
+#include "gdo_fs_lock.h"
+#include "gdo_fs_async.h"
+#include "gdo_flash_cache.h"
+#include "gdo_schedule_store.h"
+#include "gdo_user_bulk.h"
+#include "gdo_event_log.h"
+#include "gdo_kv_store.h"
+#include "gdo_fs_stats.h"
+#include "gdo_fs_integrity.h"
+#include "gdo_fs_view.h"
+#include "gdo_user_store.h"
+#include "gdo_fs_compress.h"
+#include "gdo_fs_backend.h"
+#include "gdo_fs_files.h"
 #include "gdo_schedule.h"
+/*
+ * Serializes the littlefs calls and the open handle cache only. Whole operations are
+ * ordered per file by gdo_fs_lock; lock order is gdo_fs_lock -> fileaccess.
+ */
 K_MUTEX_DEFINE(fileaccess);
 
 // static FATFS fat_fs;
@@ -34,6 +51,12 @@ K_MUTEX_DEFINE(fileaccess);
 
 LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
 
+/*======================littlefs===================*/
+/* The POSIX backend stores GDO_DISK_MOUNT_PT in host files, no partition to mount or test */
+#if !(GDO_FS_BACKEND_POSIX)
+#include <zephyr/fs/littlefs.h>
+#include <zephyr/storage/flash_map.h>
+
 /* Matches LFS_NAME_MAX */
 #define MAX_PATH_LEN   255
 #define TEST_FILE_SIZE 547
@@ -369,36 +392,157 @@ out:
   LOG_INF("%s unmount: %d\n", mountpoint->mnt_point, rc);
   return 0;
 }
+#endif
 /*======================fatfs===================*/
 static int gdo_disk_init(const char *disk);
 
+/*======================timed storage calls===================*/
+/*
+ * Thin wrappers so every storage call of the gdo_fs layer goes to the backend of its mount
+ * point (gdo_fs_backend) and the file calls are counted by gdo_fs_stats.
+ */
+static void gdo_fs_access_lock(void)
+{
+  uint32_t start = GDO_FS_STAT_START();
+
+  k_mutex_lock(&fileaccess, K_FOREVER);
+  GDO_FS_STAT_END(GDO_FS_STAT_LOCK_WAIT, start, 0, 0);
+}
+
+static int gdo_fs_io_open(struct gdo_fs_file *file, const char *full_path_file, fs_mode_t flags)
+{
+  uint32_t start = GDO_FS_STAT_START();
+  int res;
+
+  file->backend = gdo_fs_backend_find(full_path_file);
+  res           = (file->backend != NULL) ? file->backend->open(file, full_path_file, flags) : -ENOENT;
+
+  GDO_FS_STAT_END(GDO_FS_STAT_OPEN, start, res, 0);
+  return res;
+}
+
+static int gdo_fs_io_seek(struct gdo_fs_file *file, off_t offset, int whence)
+{
+  uint32_t start = GDO_FS_STAT_START();
+  int res        = file->backend->seek(file, offset, whence);
+
+  GDO_FS_STAT_END(GDO_FS_STAT_SEEK, start, res, 0);
+  return res;
+}
+
+static ssize_t gdo_fs_io_read(struct gdo_fs_file *file, void *buff, size_t len)
+{
+  uint32_t start = GDO_FS_STAT_START();
+  ssize_t res    = file->backend->read(file, buff, len);
+
+  GDO_FS_STAT_END(GDO_FS_STAT_READ, start, res, (res > 0) ? res : 0);
+  return res;
+}
+
+static ssize_t gdo_fs_io_write(struct gdo_fs_file *file, const void *buff, size_t len)
+{
+  uint32_t start = GDO_FS_STAT_START();
+  ssize_t res    = file->backend->write(file, buff, len);
+
+  GDO_FS_STAT_END(GDO_FS_STAT_WRITE, start, res, (res > 0) ? res : 0);
+  return res;
+}
+
+static int gdo_fs_io_sync(struct gdo_fs_file *file)
+{
+  uint32_t start = GDO_FS_STAT_START();
+  int res        = file->backend->sync(file);
+
+  GDO_FS_STAT_END(GDO_FS_STAT_SYNC, start, res, 0);
+  return res;
+}
+
+static int gdo_fs_io_close(struct gdo_fs_file *file)
+{
+  uint32_t start = GDO_FS_STAT_START();
+  int res        = file->backend->close(file);
+
+  GDO_FS_STAT_END(GDO_FS_STAT_CLOSE, start, res, 0);
+  return res;
+}
+
+static int gdo_fs_io_truncate(struct gdo_fs_file *file, off_t length)
+{
+  return file->backend->truncate(file, length);
+}
+
+static int gdo_fs_io_stat(const char *path, struct fs_dirent *entry)
+{
+  const struct gdo_fs_backend *backend = gdo_fs_backend_find(path);
+
+  return (backend != NULL) ? backend->stat(path, entry) : -ENOENT;
+}
+
+static int gdo_fs_io_statvfs(const char *path, struct fs_statvfs *stat)
+{
+  const struct gdo_fs_backend *backend = gdo_fs_backend_find(path);
+
+  return (backend != NULL) ? backend->statvfs(path, stat) : -ENOENT;
+}
+
+static int gdo_fs_io_unlink(const char *path)
+{
+  const struct gdo_fs_backend *backend = gdo_fs_backend_find(path);
+
+  return (backend != NULL) ? backend->unlink(path) : -ENOENT;
+}
+
+static int gdo_fs_io_rename(const char *from, const char *to)
+{
+  const struct gdo_fs_backend *backend = gdo_fs_backend_find(from);
+
+  if (backend == NULL) {
+    return -ENOENT;
+  }
+  /* a rename never copies data between backends */
+  return (backend == gdo_fs_backend_find(to)) ? backend->rename(from, to) : -EXDEV;
+}
+
+static int gdo_fs_io_opendir(struct gdo_fs_dir *dir, const char *path)
+{
+  dir->backend = gdo_fs_backend_find(path);
+  return (dir->backend != NULL) ? dir->backend->opendir(dir, path) : -ENOENT;
+}
+
+static int gdo_fs_io_readdir(struct gdo_fs_dir *dir, struct fs_dirent *entry)
+{
+  return dir->backend->readdir(dir, entry);
+}
+
+static int gdo_fs_io_closedir(struct gdo_fs_dir *dir)
+{
+  return dir->backend->closedir(dir);
+}
+
 bool gdo_flash_earse_region(off_t region_offset, size_t sector_size)
 {
-  const struct device *flash_dev = DEVICE_DT_GET(DT_ALIAS(spi_flash0));
+  return gdo_flash_earse_region_ex(region_offset, sector_size, NULL);
+}
 
-  if (!device_is_ready(flash_dev)) {
-    LOG_ERR("%s: device not ready.\n", flash_dev->name);
-    return false;
+bool gdo_flash_earse_region_ex(off_t region_offset, size_t size, size_t *erased)
+{
+  size_t done = 0;
+  int rc      = gdo_flash_cache_erase_ex(region_offset, size, &done);
+  if (erased != NULL) {
+    *erased = done;
   }
-  int rc = flash_erase(flash_dev, region_offset, sector_size);
   if (rc != 0) {
     LOG_ERR("Flash erase failed! %d\n", rc);
     return false;
   } else {
-    LOG_INF("Flash erase succeeded!\n");
+    LOG_INF("Flash erase succeeded! %u of %u bytes erased\n", done, size);
   }
   return true;
 }
 
 bool gdo_flash_write_offset(off_t region_offset, uint8_t *buff_write, size_t len)
 {
-  const struct device *flash_dev = DEVICE_DT_GET(DT_ALIAS(spi_flash0));
-
-  if (!device_is_ready(flash_dev)) {
-    LOG_ERR("%s: device not ready.\n", flash_dev->name);
-    return false;
-  }
-  int rc = flash_write(flash_dev, region_offset, buff_write, len);
+  int rc = gdo_flash_cache_write(region_offset, buff_write, len);
   if (rc != 0) {
     LOG_ERR("Flash write failed! %d\n", rc);
     return false;
@@ -408,60 +552,22 @@ bool gdo_flash_write_offset(off_t region_offset, uint8_t *buff_write, size_t len
 
 bool gdo_flash_read_offset(off_t region_offset, uint8_t *buff_read, size_t len)
 {
-  const struct device *flash_dev = DEVICE_DT_GET(DT_ALIAS(spi_flash0));
-
-  if (!device_is_ready(flash_dev)) {
-    LOG_ERR("%s: device not ready.\n", flash_dev->name);
-    return false;
-  }
-  int rc = flash_read(flash_dev, region_offset, buff_read, len);
+  int rc = gdo_flash_cache_read(region_offset, buff_read, len);
   if (rc != 0) {
-    LOG_ERR("Flash write failed! %d", rc);
+    LOG_ERR("Flash read failed! %d", rc);
     return false;
   }
   return true;
 }
 
-int gdo_fs_delete_all_file(const char *disk, const char *path)
+bool gdo_flash_flush(void)
 {
-  k_mutex_lock(&fileaccess, K_FOREVER);
-  int res = 0;
-  struct fs_dir_t dirp;
-  static struct fs_dirent entry;
-  int count = 0;
-  char path_temp[GDO_FS_MAX_PATH_LEN];
-
-  fs_dir_t_init(&dirp);
-
-  /* Verify fs_opendir() */
-  res = fs_opendir(&dirp, path);
-  if (res) {
-    LOG_ERR("Error opening dir %s [%d]\n", path, res);
-    k_mutex_unlock(&fileaccess);
-    return res;
-  }
-  for (;;) {
-    /* Verify fs_readdir() */
-    res = fs_readdir(&dirp, &entry);
-
-    /* entry.name[0] == 0 means end-of-dir */
-    if (res || entry.name[0] == 0) {
-      break;
-    }
-    strcpy(path_temp, path);
-    strcat(path_temp, "/");
-    strcat(path_temp, entry.name);
-    fs_unlink(path_temp);
-    if (entry.type == FS_DIR_ENTRY_DIR) {
-      LOG_ERR("[DIR ] %s\n", entry.name);
-    } else {
-      LOG_ERR("[FILE] %s (size = %zu)\n", entry.name, entry.size);
-    }
-    count++;
+  int rc = gdo_flash_cache_flush();
+  if (rc != 0) {
+    LOG_ERR("Flash flush failed! %d", rc);
+    return false;
   }
-  res = count;
-  k_mutex_unlock(&fileaccess);
-  return res;
+  return true;
 }
 
 int gdo_disk_init(const char *disk)
@@ -495,236 +601,1714 @@ static int gdo_fs_deinit()
   // return fs_unmount(&mp);
 }
 
-bool gdo_fs_create_file(const char *full_path_file, size_t size_file)
-{
-  if (GDO_FS_MAX_PATH_LEN <= strlen(full_path_file)) {
-    LOG_ERR("FS-Create File-ERR: file path too long");
-    return false;
-  }
-  k_mutex_lock(&fileaccess, K_FOREVER);
-  struct fs_file_t file;
-  fs_file_t_init(&file);
-  LOG_INF("Create file %s", full_path_file);
+/*======================managed files===================*/
+/*
+ * Files the firmware expects at boot, all directly under GDO_DISK_MOUNT_PT: the registry
+ * (gdo_fs_files.h) and, when the user table is split, the two files it is stored in. The
+ * index of a registry file is its enum gdo_file_id. A call resolves its path to this index
+ * once; the per file state below (handle, extent map, flags, lock) is then indexed by it.
+ */
+struct gdo_fs_managed_file {
+  const char *path;
+  size_t size;
+  const char *map; /* extent map of the sparse layout */
+};
 
-  if (fs_open(&file, full_path_file, FS_O_CREATE | FS_O_RDWR) != 0) {
-    LOG_ERR("FS-Create File-ERR: create file %s", full_path_file);
-    k_mutex_unlock(&fileaccess);
-    return false;
-  }
+#define GDO_FS_MANAGED_FILE(id, path, record_size, record_count, reset_on, reset)                               \
+  {path, (record_size) * (record_count), path ".map"},
 
-  if (fs_truncate(&file, 0) != 0) {
-    LOG_ERR("Failed to shirk file");
-    fs_close(&file);
-    k_mutex_unlock(&fileaccess);
-    return false;
-  }
+static const struct gdo_fs_managed_file managed_files[] = {
+    GDO_FS_FILE_LIST(GDO_FS_MANAGED_FILE)
+#if (GDO_USER_STORE_SPLIT)
+    {GDO_USER_HOT_FULL_PATH, GDO_MAX_USER_SUPORT * sizeof(gdo_user_hot_infor), GDO_USER_HOT_FULL_PATH ".map"},
+    {GDO_USER_COLD_FULL_PATH, GDO_MAX_USER_SUPORT * sizeof(gdo_user_cold_infor), GDO_USER_COLD_FULL_PATH ".map"},
+#endif
+};
 
-  if (fs_truncate(&file, size_file) != 0) {
-    LOG_ERR("Failed to extend file to: %lu bytes", size_file);
-    fs_close(&file);
-    k_mutex_unlock(&fileaccess);
-    return false;
+static int gdo_fs_managed_find(const char *full_path_file)
+{
+  for (size_t i = 0; i < ARRAY_SIZE(managed_files); i++) {
+    if (strcmp(managed_files[i].path, full_path_file) == 0) {
+      return i;
+    }
   }
-  fs_sync(&file);
-
-  fs_close(&file);
-  k_mutex_unlock(&fileaccess);
-  return true;
+  return -1;
 }
 
-int gdo_fs_read_file(const char *disk, const char *full_path_file, void *buff, size_t len)
+/* What the file layer would otherwise find out by comparing the path on every call */
+#define GDO_FS_FILE_KNOWN      BIT(0)
+#define GDO_FS_FILE_ROUTED     BIT(1) /* the user table, stored by gdo_user_store */
+#define GDO_FS_FILE_USER_INDEX BIT(2) /* its writes feed gdo_user_index */
+#define GDO_FS_FILE_COMPRESSED BIT(3) /* listed in GDO_FS_COMPRESSED_FILES */
+
+static uint8_t managed_flags[ARRAY_SIZE(managed_files)];
+
+/* Flags of file @p id, or of @p full_path_file when it is not a managed file (id < 0) */
+static uint8_t gdo_fs_file_flags(int id, const char *full_path_file)
 {
-  k_mutex_lock(&fileaccess, K_FOREVER);
-  int res = 0;
-  struct fs_file_t file;
+  uint8_t flags;
 
-  fs_file_t_init(&file);
-  res = fs_open(&file, full_path_file, FS_O_READ);
-  if (res != 0) {
-    LOG_ERR("Failed to open file %s Err %d\n", full_path_file, res);
-    k_mutex_unlock(&fileaccess);
-    return res;
+  if (id >= 0 && (managed_flags[id] & GDO_FS_FILE_KNOWN)) {
+    return managed_flags[id];
   }
-  res = fs_read(&file, buff, len);
-
-  if (res < 0) {
-    LOG_ERR("Error read file %s\n", full_path_file);
+  flags = (gdo_fs_compress_find(full_path_file) >= 0) ? GDO_FS_FILE_COMPRESSED : 0;
+  if (id == GDO_FILE_USERS) {
+    flags |= GDO_FS_FILE_USER_INDEX | (GDO_USER_STORE_SPLIT ? GDO_FS_FILE_ROUTED : 0);
   }
-  if (res != len) {
-    LOG_ERR("Error len file %d bytes, you read %d bytes\n", res, len);
-    res = 0;
+  if (id >= 0) {
+    managed_flags[id] = flags | GDO_FS_FILE_KNOWN;
   }
-  fs_close(&file);
-  k_mutex_unlock(&fileaccess);
-  return res;
+  return flags;
 }
 
-int gdo_fs_write_file(const char *disk, const char *full_path_file, void *buff, size_t len)
+/* File lock by the registry id where there is one, the lock table has a fixed entry for it */
+static struct gdo_fs_lock *gdo_fs_file_lock(int id, const char *full_path_file, enum gdo_fs_lock_mode mode)
 {
-  k_mutex_lock(&fileaccess, K_FOREVER);
-  int res = 0;
-  struct fs_file_t file;
-
-  fs_file_t_init(&file);
-  res = fs_open(&file, full_path_file, FS_O_APPEND | FS_O_WRITE);
-  if (res != 0) {
-    LOG_ERR("Failed to open file %s err %d\n", full_path_file, res);
-    k_mutex_unlock(&fileaccess);
-    return res;
-  }
-
-  res = fs_write(&file, buff, len);
-  if (res < 0 || res != len) {
-    LOG_ERR("Error write file %s , ret: %d\n", full_path_file, res);
-    k_mutex_unlock(&fileaccess);
-    res = -1;
+  if (id >= 0 && id < GDO_FILE_NUM) {
+    return gdo_fs_lock_acquire_id(id, mode);
   }
-  fs_close(&file);
-  k_mutex_unlock(&fileaccess);
-  return res;
+  return gdo_fs_lock_acquire(full_path_file, mode);
 }
 
-int gdo_fs_write_file_index(const char *disk, const char *full_path_file, void *buff, size_t len, size_t index)
+/*======================open handle cache===================*/
+/*
+ * littlefs walks the path and re-reads the metadata pairs on every fs_open, so the
+ * record accessors keep a small LRU of open handles. All entries are only touched
+ * with fileaccess held.
+ */
+#ifndef GDO_FS_HANDLE_CACHE_SIZE
+#ifdef CONFIG_FS_LITTLEFS_NUM_FILES
+/* keep one littlefs file slot free for the uncached open in gdo_fs_create_file */
+#define GDO_FS_HANDLE_CACHE_SIZE (CONFIG_FS_LITTLEFS_NUM_FILES - 1)
+#else
+#define GDO_FS_HANDLE_CACHE_SIZE 3
+#endif
+#endif
+
+/* 1: fs_sync after every write (same power-loss behaviour as close per call),
+ * 0: defer the commit until eviction or gdo_fs_cache_flush() */
+#ifndef GDO_FS_HANDLE_CACHE_WRITE_THROUGH
+#define GDO_FS_HANDLE_CACHE_WRITE_THROUGH 1
+#endif
+
+struct gdo_fs_handle {
+  char path[GDO_FS_MAX_PATH_LEN];
+  struct gdo_fs_file file;
+  uint32_t last_use;
+  int id; /* managed_files index, -1 for any other file */
+  bool open;
+  bool dirty;
+};
+
+static struct gdo_fs_handle handle_cache[GDO_FS_HANDLE_CACHE_SIZE];
+/* open handle of each managed file, NULL if it has none */
+static struct gdo_fs_handle *managed_handle[ARRAY_SIZE(managed_files)];
+static uint32_t handle_clock;
+
+static int gdo_fs_handle_close(struct gdo_fs_handle *handle)
 {
-  k_mutex_lock(&fileaccess, K_FOREVER);
   int res = 0;
-  struct fs_file_t file;
 
-  fs_file_t_init(&file);
-  res = fs_open(&file, full_path_file, FS_O_WRITE);
-  if (res != 0) {
-    LOG_ERR("Failed to open file %s err %d\n", full_path_file, res);
-    k_mutex_unlock(&fileaccess);
-    return res;
+  if (!handle->open) {
+    return 0;
   }
-  res = fs_seek(&file, index, FS_SEEK_SET);
-  if (res != 0) {
-    LOG_ERR("Failed to seek file %s \n", full_path_file);
-    k_mutex_unlock(&fileaccess);
-    return res;
+  if (handle->dirty) {
+    res = gdo_fs_io_sync(&handle->file);
+    if (res != 0) {
+      LOG_ERR("Failed to sync file %s err %d\n", handle->path, res);
+    }
   }
-  res = fs_write(&file, buff, len);
-  if (res < 0 || res != len) {
-    LOG_ERR("Error write file %s\n", full_path_file);
-    res = -1;
+  int rc = gdo_fs_io_close(&handle->file);
+  if (rc != 0) {
+    LOG_ERR("Failed to close file %s err %d\n", handle->path, rc);
+    res = (res != 0) ? res : rc;
   }
-  fs_close(&file);
-  k_mutex_unlock(&fileaccess);
+  if (handle->id >= 0) {
+    managed_handle[handle->id] = NULL;
+  }
+  handle->open  = false;
+  handle->dirty = false;
   return res;
 }
 
-int gdo_fs_read_file_index(const char *disk, const char *full_path_file, void *buff, size_t len, size_t index)
+/* Open handle of file @p id, the path is only compared for a file that is not managed */
+static struct gdo_fs_handle *gdo_fs_handle_find(int id, const char *full_path_file)
 {
-  k_mutex_lock(&fileaccess, K_FOREVER);
-  int res = 0;
-  struct fs_file_t file;
-  fs_file_t_init(&file);
-  res = fs_open(&file, full_path_file, FS_O_READ);
-  if (res != 0) {
-    LOG_ERR("Failed to open file %s error %d\n", full_path_file, res);
-    k_mutex_unlock(&fileaccess);
-    return res;
+  if (id >= 0) {
+    return managed_handle[id];
   }
-  res = fs_seek(&file, index, FS_SEEK_SET);
-  if (res != 0) {
-    LOG_ERR("Failed to seek file %s \n", full_path_file);
-    fs_close(&file);
-    k_mutex_unlock(&fileaccess);
-    return res;
+  for (int i = 0; i < GDO_FS_HANDLE_CACHE_SIZE; i++) {
+    if (handle_cache[i].open && handle_cache[i].id < 0 && strcmp(handle_cache[i].path, full_path_file) == 0) {
+      return &handle_cache[i];
+    }
   }
-  res = fs_read(&file, buff, len);
+  return NULL;
+}
 
-  if (res < 0) {
-    LOG_ERR("Error read file %s\n", full_path_file);
-    res = -1;
+/* Returns an open handle for the file, opening it (and evicting the LRU entry) on a miss. */
+static struct gdo_fs_handle *gdo_fs_handle_get(int id, const char *full_path_file, int *err)
+{
+  struct gdo_fs_handle *handle = gdo_fs_handle_find(id, full_path_file);
+
+  *err = 0;
+  if (handle != NULL) {
+    handle->last_use = ++handle_clock;
+    return handle;
+  }
+  if (GDO_FS_MAX_PATH_LEN <= strlen(full_path_file)) {
+    LOG_ERR("FS-Handle-ERR: file path too long");
+    *err = -ENAMETOOLONG;
+    return NULL;
   }
 
-  if (res != len) {
-    LOG_ERR("Error len file %d bytes, you read %d bytes, index %d\n", res, len, index);
-    res = -1;
+  handle = &handle_cache[0];
+  for (int i = 0; i < GDO_FS_HANDLE_CACHE_SIZE; i++) {
+    if (!handle_cache[i].open) {
+      handle = &handle_cache[i];
+      break;
+    }
+    if (handle_cache[i].last_use < handle->last_use) {
+      handle = &handle_cache[i];
+    }
   }
-  fs_close(&file);
-  k_mutex_unlock(&fileaccess);
-  return res;
+  gdo_fs_handle_close(handle);
+
+  *err = gdo_fs_io_open(&handle->file, full_path_file, FS_O_RDWR);
+  if (*err != 0) {
+    return NULL;
+  }
+  strcpy(handle->path, full_path_file);
+  handle->id = id;
+  if (id >= 0) {
+    managed_handle[id] = handle;
+  }
+  handle->open     = true;
+  handle->dirty    = false;
+  handle->last_use = ++handle_clock;
+  return handle;
 }
 
-bool gdo_fs_delete_file(const char *disk, const char *full_path_file)
+static int gdo_fs_handle_written(struct gdo_fs_handle *handle)
 {
-  bool flag = true;
-  k_mutex_lock(&fileaccess, K_FOREVER);
-  if (strcmp(full_path_file, GDO_USER_INFOR_FULL_PATH) == 0) {
-    flag = gdo_fs_create_file(GDO_USER_INFOR_FULL_PATH, GDO_MAX_USER_SUPORT * sizeof(gdo_user_infor));
+  handle->dirty = true;
+  if (!GDO_FS_HANDLE_CACHE_WRITE_THROUGH) {
+    return 0;
   }
-  if (strcmp(full_path_file, SCHEDULE_CURRENT_FILE_FULL_PATH) == 0) {
-    flag = gdo_fs_create_file(SCHEDULE_CURRENT_FILE_FULL_PATH, SCHEDULE_NUM * sizeof(struct schedule_data));
+  int res = gdo_fs_io_sync(&handle->file);
+  if (res != 0) {
+    LOG_ERR("Failed to sync file %s err %d\n", handle->path, res);
+    return res;
   }
+  handle->dirty = false;
+  return 0;
+}
 
-  if (strcmp(full_path_file, SCHEDULE_BACKUP_FILE_FULL_PATH) == 0) {
-    flag = gdo_fs_create_file(SCHEDULE_BACKUP_FILE_FULL_PATH, SCHEDULE_NUM * sizeof(struct schedule_data));
-  }
+static void gdo_fs_handle_evict(int id, const char *full_path_file)
+{
+  struct gdo_fs_handle *handle = gdo_fs_handle_find(id, full_path_file);
 
-  if (strcmp(full_path_file, HOME_CFG_FILE_FULL_PATH) == 0) {
-    flag = gdo_fs_create_file(HOME_CFG_FILE_FULL_PATH, HOME_CFG_FILE_SIZE);
+  if (handle != NULL) {
+    gdo_fs_handle_close(handle);
   }
-  k_mutex_unlock(&fileaccess);
-  return flag;
 }
 
-uint8_t gdo_fs_file_exist(const char *full_path_file)
+static int gdo_fs_handle_evict_all(void)
 {
   int res = 0;
-  struct fs_file_t file;
-  uint8_t rs = 0;
-  k_mutex_lock(&fileaccess, K_FOREVER);
-  fs_file_t_init(&file);
-  res = fs_open(&file, full_path_file, FS_O_READ);
-  if (res == 0) {
-    fs_close(&file);
-    rs = FILE_EXIST;
-    goto exit;
-  }
 
-  if (res == -ENOENT) {
-    rs = FILE_NOT_EXIST;
-    goto exit;
+  for (int i = 0; i < GDO_FS_HANDLE_CACHE_SIZE; i++) {
+    int rc = gdo_fs_handle_close(&handle_cache[i]);
+    res    = (res != 0) ? res : rc;
   }
-  rs = FILE_ERROR;
-exit:
-  k_mutex_unlock(&fileaccess);
-  return rs;
+  return res;
 }
 
-bool createFileIfNotExist()
+int gdo_fs_cache_flush(void)
 {
-  bool flag = true;
-  if (gdo_fs_file_exist(GDO_USER_INFOR_FULL_PATH) == FILE_NOT_EXIST) {
-    flag &= gdo_fs_create_file(GDO_USER_INFOR_FULL_PATH, GDO_MAX_USER_SUPORT * sizeof(gdo_user_infor));
+  int res = 0;
+
+  gdo_fs_access_lock();
+  for (int i = 0; i < GDO_FS_HANDLE_CACHE_SIZE; i++) {
+    if (handle_cache[i].open && handle_cache[i].dirty) {
+      int rc = gdo_fs_io_sync(&handle_cache[i].file);
+      if (rc == 0) {
+        handle_cache[i].dirty = false;
+      }
+      res = (res != 0) ? res : rc;
+    }
+  }
+  k_mutex_unlock(&fileaccess);
+  return res;
+}
+
+int gdo_fs_cache_close_all(void)
+{
+  gdo_fs_access_lock();
+  int res = gdo_fs_handle_evict_all();
+  k_mutex_unlock(&fileaccess);
+  return res;
+}
+
+/*======================sparse files===================*/
+/*
+ * Managed files are stored through an extent map. The logical file is cut into
+ * GDO_FS_SPARSE_CHUNKS chunks, and a chunk only gets a place in the littlefs file, the
+ * next free slot at its end, when it is first written. A chunk never written does not
+ * exist on flash and reads as zeros, so creating or resetting a managed file is a
+ * truncate and a map rewrite whatever its size. Slots are handed out in write order
+ * because littlefs zero fills a file from its end up to a write offset: writing at the
+ * logical offset would only move the zero fill from create to the first write.
+ *
+ * The map (logical size and the slot of every chunk) is "<path>.map", rewritten after
+ * the data when a write takes new slots or grows the file. A file without a map comes
+ * from an older build and maps every chunk onto itself. The state is loaded on first
+ * use and only touched with fileaccess held.
+ */
+#ifndef GDO_FS_SPARSE_FILES
+#define GDO_FS_SPARSE_FILES 1
+#endif
+
+/* chunks per file, the chunk is the smallest power of two that covers the file with them */
+#ifndef GDO_FS_SPARSE_CHUNKS
+#define GDO_FS_SPARSE_CHUNKS 128
+#endif
+BUILD_ASSERT(GDO_FS_SPARSE_CHUNKS < UINT8_MAX, "chunk slots are stored in a uint8_t");
+
+#define GDO_FS_SPARSE_NONE      UINT8_MAX
+#define GDO_FS_SPARSE_MAP_MAGIC 0x53504D50 /* "SPMP" */
+
+struct gdo_fs_sparse_map {
+  uint32_t magic;
+  uint32_t size;                       /* logical size */
+  uint8_t slot[GDO_FS_SPARSE_CHUNKS]; /* slot of each chunk in the file, GDO_FS_SPARSE_NONE if never written */
+} __packed;
+
+struct gdo_fs_sparse {
+  struct gdo_fs_sparse_map map;
+  size_t physical; /* littlefs file length */
+  uint8_t slots;   /* slots handed out, a new chunk takes the next one */
+  uint8_t shift;   /* chunk size is 1 << shift */
+  bool known;
+  bool plain;      /* too large for the map, accessed as a plain file */
+  bool dirty;      /* map changed since it was saved */
+};
+
+static struct gdo_fs_sparse sparse_files[ARRAY_SIZE(managed_files)];
+
+static size_t gdo_fs_sparse_capacity(const struct gdo_fs_sparse *sparse)
+{
+  return (size_t) GDO_FS_SPARSE_CHUNKS << sparse->shift;
+}
+
+/* Empty map of logical size @p size, the file itself is not touched */
+static void gdo_fs_sparse_reset(int id, size_t size)
+{
+  struct gdo_fs_sparse *sparse = &sparse_files[id];
+
+  memset(sparse, 0, sizeof(*sparse));
+  memset(sparse->map.slot, GDO_FS_SPARSE_NONE, sizeof(sparse->map.slot));
+  while (((managed_files[id].size + BIT(sparse->shift) - 1) >> sparse->shift) > GDO_FS_SPARSE_CHUNKS) {
+    sparse->shift++;
+  }
+  sparse->map.magic = GDO_FS_SPARSE_MAP_MAGIC;
+  sparse->map.size  = size;
+  sparse->known     = true;
+}
+
+static int gdo_fs_sparse_load(int id)
+{
+  struct gdo_fs_sparse *sparse = &sparse_files[id];
+  struct fs_dirent entry;
+  struct gdo_fs_file file;
+  int res = gdo_fs_io_stat(managed_files[id].path, &entry);
+
+  if (res != 0) {
+    return res;
+  }
+  gdo_fs_sparse_reset(id, MAX(managed_files[id].size, entry.size));
+  sparse->physical = entry.size;
+  res              = gdo_fs_io_open(&file, managed_files[id].map, FS_O_RDWR);
+  if (res == 0) {
+    res = (gdo_fs_io_read(&file, &sparse->map, sizeof(sparse->map)) == sizeof(sparse->map) &&
+           sparse->map.magic == GDO_FS_SPARSE_MAP_MAGIC && sparse->map.size <= gdo_fs_sparse_capacity(sparse))
+              ? 0
+              : -EINVAL;
+    gdo_fs_io_close(&file);
+  }
+  if (res == 0) {
+    for (size_t c = 0; c < GDO_FS_SPARSE_CHUNKS; c++) {
+      if (sparse->map.slot[c] != GDO_FS_SPARSE_NONE) {
+        sparse->slots = MAX(sparse->slots, sparse->map.slot[c] + 1);
+      }
+    }
+    return 0;
+  }
+  if (res != -ENOENT) {
+    LOG_ERR("FS-Sparse: map of %s unreadable (%d), read as a plain file", managed_files[id].path, res);
+  }
+  /* a plain file: every chunk below its length is in place */
+  gdo_fs_sparse_reset(id, MAX(managed_files[id].size, entry.size));
+  sparse->physical = entry.size;
+  if (entry.size > gdo_fs_sparse_capacity(sparse)) {
+    sparse->plain = true;
+    return 0;
+  }
+  for (size_t c = 0; ((size_t) c << sparse->shift) < entry.size; c++) {
+    sparse->map.slot[c] = c;
+    sparse->slots       = c + 1;
+  }
+  return 0;
+}
+
+/* Rewrites the map of managed file @p id; the state is reloaded from flash if that fails */
+static int gdo_fs_sparse_save(int id)
+{
+  struct gdo_fs_sparse *sparse = &sparse_files[id];
+  struct gdo_fs_file file;
+  int res = gdo_fs_io_open(&file, managed_files[id].map, FS_O_CREATE | FS_O_RDWR);
+
+  if (res == 0) {
+    res = (gdo_fs_io_write(&file, &sparse->map, sizeof(sparse->map)) == sizeof(sparse->map)) ? 0 : -EIO;
+    int rc = gdo_fs_io_close(&file);
+    res    = (res != 0) ? res : rc;
+  }
+  sparse->dirty = false;
+  if (res != 0) {
+    LOG_ERR("FS-Sparse: save map of %s err %d", managed_files[id].path, res);
+    sparse->known = false;
+  }
+  return res;
+}
+
+static void gdo_fs_sparse_forget(int id)
+{
+  if (id >= 0) {
+    sparse_files[id].known = false;
+  }
+}
+
+/* NULL for a file that is not a managed one in the sparse layout */
+static struct gdo_fs_sparse *gdo_fs_sparse_get(int id)
+{
+  if (!GDO_FS_SPARSE_FILES || id < 0 || (!sparse_files[id].known && gdo_fs_sparse_load(id) != 0) || sparse_files[id].plain) {
+    return NULL;
+  }
+  return &sparse_files[id];
+}
+
+/* End of the run of chunks from @p pos on that lies in one piece in the file (or nowhere) */
+static size_t gdo_fs_sparse_run(const struct gdo_fs_sparse *sparse, size_t pos, size_t end)
+{
+  size_t first = pos >> sparse->shift;
+  uint8_t slot = sparse->map.slot[first];
+  size_t next  = MIN(end, (first + 1) << sparse->shift);
+
+  while (next < end) {
+    size_t c = next >> sparse->shift;
+
+    if (slot == GDO_FS_SPARSE_NONE ? sparse->map.slot[c] != GDO_FS_SPARSE_NONE
+                                   : sparse->map.slot[c] != slot + (c - first)) {
+      break;
+    }
+    next = MIN(end, (c + 1) << sparse->shift);
+  }
+  return next;
+}
+
+/*
+ * Positioned write with fileaccess held, through the map for a sparse file. Chunks written
+ * for the first time take the next slots, so a run of them is one write at the end of the
+ * file. The caller saves the map with gdo_fs_sparse_commit() once the write succeeded and
+ * forgets the state if it failed. Returns @p len or a negative error.
+ */
+static int gdo_fs_pwrite(struct gdo_fs_handle *handle, struct gdo_fs_sparse *sparse, const void *buff, size_t len,
+                         size_t index)
+{
+  const uint8_t *data = buff;
+  size_t end          = index + len;
+  int res;
+
+  if (sparse == NULL) {
+    res = gdo_fs_io_seek(&handle->file, index, FS_SEEK_SET);
+    return (res != 0) ? res : gdo_fs_io_write(&handle->file, buff, len);
+  }
+  if (len == 0) {
+    return 0;
+  }
+  if (end > gdo_fs_sparse_capacity(sparse) || end < index) {
+    return -EFBIG;
+  }
+  for (size_t c = index >> sparse->shift; c <= (end - 1) >> sparse->shift; c++) {
+    if (sparse->map.slot[c] != GDO_FS_SPARSE_NONE) {
+      continue;
+    }
+    if (sparse->physical > ((size_t) sparse->slots << sparse->shift)) {
+      /* left by a write whose map was never saved, the new chunk must not inherit it */
+      res = gdo_fs_io_truncate(&handle->file, (size_t) sparse->slots << sparse->shift);
+      if (res != 0) {
+        return res;
+      }
+      sparse->physical = (size_t) sparse->slots << sparse->shift;
+    }
+    sparse->map.slot[c] = sparse->slots++;
+    sparse->dirty       = true;
+  }
+  for (size_t pos = index; pos < end;) {
+    size_t next = gdo_fs_sparse_run(sparse, pos, end);
+    size_t at   = ((size_t) sparse->map.slot[pos >> sparse->shift] << sparse->shift) + (pos & BIT_MASK(sparse->shift));
+
+    res = gdo_fs_io_seek(&handle->file, at, FS_SEEK_SET);
+    if (res == 0) {
+      res = gdo_fs_io_write(&handle->file, data + (pos - index), next - pos);
+    }
+    if (res != (int) (next - pos)) {
+      return (res < 0) ? res : -EIO;
+    }
+    sparse->physical = MAX(sparse->physical, at + (next - pos));
+    pos              = next;
+  }
+  if (end > sparse->map.size) {
+    sparse->map.size = end;
+    sparse->dirty    = true;
+  }
+  return len;
+}
+
+/* Saves the map after a write that changed it, the data is synced before */
+static int gdo_fs_sparse_commit(struct gdo_fs_handle *handle, struct gdo_fs_sparse *sparse)
+{
+  int res = 0;
+
+  if (sparse == NULL || !sparse->dirty) {
+    return 0;
+  }
+  if (handle->dirty) {
+    res = gdo_fs_io_sync(&handle->file);
+    handle->dirty = (res != 0);
+  }
+  if (res != 0) {
+    sparse->known = false;
+    return res;
+  }
+  return gdo_fs_sparse_save(sparse - sparse_files);
+}
+
+/*
+ * One positioned read with fileaccess held. Returns the bytes read (short at the end of
+ * the file) or a negative error; the handle is closed on an I/O error.
+ */
+static int gdo_fs_pread(int id, const char *full_path_file, void *buff, size_t len, size_t index)
+{
+  struct gdo_fs_sparse *sparse = gdo_fs_sparse_get(id);
+  struct gdo_fs_handle *handle = NULL;
+  uint8_t *data                = buff;
+  int res                      = 0;
+
+  if (sparse != NULL) {
+    /* a sparse file reads as zeros up to its logical size wherever nothing was written */
+    len = (index >= sparse->map.size) ? 0 : MIN(len, sparse->map.size - index);
+  }
+  for (size_t pos = index; pos < index + len;) {
+    size_t next = (sparse != NULL) ? gdo_fs_sparse_run(sparse, pos, index + len) : index + len;
+    size_t at   = pos;
+
+    if (sparse != NULL) {
+      uint8_t slot = sparse->map.slot[pos >> sparse->shift];
+
+      if (slot == GDO_FS_SPARSE_NONE) {
+        memset(data + (pos - index), 0, next - pos);
+        pos = next;
+        continue;
+      }
+      at = ((size_t) slot << sparse->shift) + (pos & BIT_MASK(sparse->shift));
+    }
+    if (handle == NULL) {
+      handle = gdo_fs_handle_get(id, full_path_file, &res);
+      if (handle == NULL) {
+        LOG_ERR("Failed to open file %s err %d\n", full_path_file, res);
+        return res;
+      }
+    }
+    res = gdo_fs_io_seek(&handle->file, at, FS_SEEK_SET);
+    if (res != 0) {
+      LOG_ERR("Failed to seek file %s \n", full_path_file);
+      gdo_fs_handle_close(handle);
+      return res;
+    }
+    res = gdo_fs_io_read(&handle->file, data + (pos - index), next - pos);
+    if (res < 0) {
+      LOG_ERR("Error read file %s\n", full_path_file);
+      gdo_fs_handle_close(handle);
+      return res;
+    }
+    if (sparse == NULL) {
+      return res;
+    }
+    /* the last slot may end before its chunk does */
+    memset(data + (pos - index) + res, 0, (next - pos) - res);
+    pos = next;
+  }
+  return len;
+}
+
+/* gdo_fs_pread taking littlefs itself, the split user table is read from its two files */
+static int gdo_fs_pread_routed(int id, const char *full_path_file, void *buff, size_t len, size_t index)
+{
+  int res;
+
+  if (gdo_fs_file_flags(id, full_path_file) & GDO_FS_FILE_ROUTED) {
+    return gdo_user_store_read(buff, len, index);
+  }
+  gdo_fs_access_lock();
+  res = gdo_fs_pread(id, full_path_file, buff, len, index);
+  k_mutex_unlock(&fileaccess);
+  return res;
+}
+
+/* Byte source of the readers of a compressed file */
+static int gdo_fs_lz_source(void *ctx, size_t pos, uint8_t *buff, size_t len)
+{
+  return gdo_fs_pread_routed(gdo_fs_managed_find(ctx), ctx, buff, len, pos);
+}
+
+/* Compressed files are a stream of frames, a byte offset into them means nothing */
+static bool gdo_fs_compressed_reject(int id, const char *full_path_file)
+{
+  if (!(gdo_fs_file_flags(id, full_path_file) & GDO_FS_FILE_COMPRESSED)) {
+    return false;
+  }
+  LOG_ERR("Indexed access to compressed %s not supported", full_path_file);
+  return true;
+}
+
+/* 1: gdo_fs_write_file_index reads the record back first and only writes the changed bytes */
+#ifndef GDO_FS_WRITE_COMPARE
+#define GDO_FS_WRITE_COMPARE 1
+#endif
+
+/* Stack buffer of the comparison, the record is compared in pieces of this size */
+#ifndef GDO_FS_COMPARE_CHUNK
+#define GDO_FS_COMPARE_CHUNK 64
+#endif
+
+/*
+ * Narrows [index, index + len) of a write to the bytes that differ from the file, as
+ * [index + *lo, index + *hi). *lo == *hi when nothing changed. Bytes past the end of
+ * the file always differ. With fileaccess held.
+ */
+static int gdo_fs_diff_range(int id, const char *full_path_file, const uint8_t *buff, size_t len, size_t index,
+                             size_t *lo, size_t *hi)
+{
+  uint8_t chunk[GDO_FS_COMPARE_CHUNK];
+  size_t first = len;
+  size_t last  = 0;
+
+  for (size_t pos = 0; pos < len; pos += sizeof(chunk)) {
+    size_t n = MIN(sizeof(chunk), len - pos);
+    int res  = gdo_fs_pread(id, full_path_file, chunk, n, index + pos);
+
+    if (res < 0) {
+      return res;
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (i >= (size_t) res || chunk[i] != buff[pos + i]) {
+        first = MIN(first, pos + i);
+        last  = pos + i + 1;
+      }
+    }
+  }
+  *lo = (first < last) ? first : 0;
+  *hi = last;
+  return 0;
+}
+
+int gdo_fs_iov_narrow(const char *full_path_file, struct gdo_fs_iovec *iov)
+{
+  size_t lo = 0;
+  size_t hi = iov->len;
+
+  if (!GDO_FS_WRITE_COMPARE) {
+    return 0;
+  }
+  gdo_fs_access_lock();
+  int res = gdo_fs_diff_range(gdo_fs_managed_find(full_path_file), full_path_file, iov->buff, iov->len, iov->index, &lo, &hi);
+  k_mutex_unlock(&fileaccess);
+  if (res == 0) {
+    iov->index += lo;
+    iov->buff = (uint8_t *) iov->buff + lo;
+    iov->len  = hi - lo;
+  }
+  return res;
+}
+
+/*======================tree delete===================*/
+/* Directory levels below the start path that are followed */
+#ifndef GDO_FS_DELETE_MAX_DEPTH
+#define GDO_FS_DELETE_MAX_DEPTH 8
+#endif
+
+/* Entries listed per pass over a directory before they are removed */
+#ifndef GDO_FS_DELETE_BATCH
+#define GDO_FS_DELETE_BATCH 4
+#endif
+
+/* 1: deleting everything under the mount point reformats the partition instead */
+#ifndef GDO_FS_FAST_WIPE
+#define GDO_FS_FAST_WIPE 1
+#endif
+
+/* How long a fast wipe waits for the file locks held by other threads, then walks the tree */
+#ifndef GDO_FS_WIPE_LOCK_WAIT_MS
+#define GDO_FS_WIPE_LOCK_WAIT_MS 1000
+#endif
+
+/* the listing buffer is too big for the caller stack, tree deletes run one at a time */
+K_MUTEX_DEFINE(treeaccess);
+static struct fs_dirent tree_batch[GDO_FS_DELETE_BATCH];
+static char tree_path[GDO_FS_MAX_PATH_LEN];
+
+/* Appends "/name" to tree_path of length len, returns the new length or -ENAMETOOLONG */
+static int gdo_fs_tree_join(size_t len, const char *name)
+{
+  size_t name_len = strlen(name);
+
+  if (len + 1 + name_len >= sizeof(tree_path)) {
+    return -ENAMETOOLONG;
+  }
+  tree_path[len] = '/';
+  memcpy(&tree_path[len + 1], name, name_len + 1);
+  return len + 1 + name_len;
+}
+
+/* Lists up to GDO_FS_DELETE_BATCH entries of tree_path, the directory is closed again on return */
+static int gdo_fs_tree_list(void)
+{
+  struct gdo_fs_dir dirp;
+  int count = 0;
+  int res;
+
+  gdo_fs_access_lock();
+  res = gdo_fs_io_opendir(&dirp, tree_path);
+  if (res == 0) {
+    while (count < GDO_FS_DELETE_BATCH) {
+      res = gdo_fs_io_readdir(&dirp, &tree_batch[count]);
+      /* entry.name[0] == 0 means end-of-dir */
+      if (res != 0 || tree_batch[count].name[0] == 0) {
+        break;
+      }
+      count++;
+    }
+    gdo_fs_io_closedir(&dirp);
+  }
+  k_mutex_unlock(&fileaccess);
+  return (res < 0) ? res : count;
+}
+
+static int gdo_fs_remove(const char *full_path_file)
+{
+  int id                   = gdo_fs_managed_find(full_path_file);
+  struct gdo_fs_lock *lock = gdo_fs_file_lock(id, full_path_file, GDO_FS_LOCK_WRITE);
+  gdo_fs_access_lock();
+  gdo_fs_handle_evict(id, full_path_file);
+  gdo_fs_sparse_forget(id);
+  int res = gdo_fs_io_unlink(full_path_file);
+  if (res == 0 && id >= 0) {
+    /* may not exist, the file was plain */
+    gdo_fs_io_unlink(managed_files[id].map);
+  }
+  k_mutex_unlock(&fileaccess);
+  gdo_fs_compress_forget(full_path_file);
+  if (res == 0) {
+    /* either split user file takes the whole user table with it */
+    const char *table = gdo_user_store_backs(full_path_file) ? GDO_USER_INFOR_FULL_PATH : full_path_file;
+
+    gdo_fs_view_invalidate(full_path_file, 0, 0);
+    gdo_fs_view_invalidate(table, 0, 0);
+    gdo_fs_integrity_forget(table);
+    if (table != full_path_file || (gdo_fs_file_flags(id, full_path_file) & GDO_FS_FILE_USER_INDEX)) {
+      gdo_user_index_reset();
+    }
+  }
+  gdo_fs_lock_release(lock);
+  return res;
+}
+
+/* Drops every file of the mounted partition with one format, under every file lock */
+static int gdo_fs_tree_wipe(void)
+{
+  const struct gdo_fs_backend *backend = gdo_fs_backend_find(GDO_DISK_MOUNT_PT);
+  int res;
+
+  if (backend == NULL || backend->format == NULL) {
+    return -ENOTSUP;
+  }
+  res = gdo_fs_lock_exclusive(GDO_FS_WIPE_LOCK_WAIT_MS);
+  if (res != 0) {
+    return res;
+  }
+  gdo_fs_access_lock();
+  gdo_fs_handle_evict_all();
+  for (size_t i = 0; i < ARRAY_SIZE(sparse_files); i++) {
+    sparse_files[i].known = false;
+  }
+  res = backend->format(GDO_DISK_MOUNT_PT);
+  k_mutex_unlock(&fileaccess);
+  gdo_fs_view_invalidate(NULL, 0, 0);
+  gdo_fs_integrity_forget(NULL);
+  gdo_fs_compress_forget(NULL);
+  gdo_fs_lock_exclusive_release();
+  if (res != 0) {
+    LOG_ERR("FS-Wipe: format %s err %d", GDO_DISK_MOUNT_PT, res);
+  }
+  return res;
+}
+
+/* The mount point was emptied, by a format or a walk: bring the RAM state of its files in line */
+static void gdo_fs_tree_wiped(void)
+{
+  gdo_user_index_reset();
+  gdo_fs_view_invalidate(NULL, 0, 0);
+  /* a new empty base and journal, the next-due index follows the cleared table */
+  if (gdo_schedule_store_clear() != 0) {
+    LOG_ERR("FS-Wipe: schedule store");
+  }
+  for (int id = 0; id < GDO_FILE_NUM; id++) {
+    gdo_fs_integrity_on_reset(gdo_fs_files[id].path);
+  }
+}
+
+int gdo_fs_delete_tree(const char *path, uint8_t flags, gdo_fs_delete_cb_t cb, void *user_data)
+{
+  size_t stack[GDO_FS_DELETE_MAX_DEPTH + 1];
+  int depth   = 0;
+  int removed = 0;
+  int res     = 0;
+  int len     = strlen(path);
+
+  if (len >= GDO_FS_MAX_PATH_LEN) {
+    return -ENAMETOOLONG;
+  }
+  while (len > 1 && path[len - 1] == '/') {
+    len--;
+  }
+  bool whole = !(flags & GDO_FS_DELETE_ROOT) && strlen(GDO_DISK_MOUNT_PT) == len && strncmp(path, GDO_DISK_MOUNT_PT, len) == 0;
+
+  if (whole && (flags & GDO_FS_DELETE_FAST_WIPE)) {
+    /* any failure of the fast path falls back to the walk */
+    if (gdo_fs_tree_wipe() == 0) {
+      gdo_fs_tree_wiped();
+      if (cb != NULL) {
+        cb(GDO_DISK_MOUNT_PT, 0, user_data);
+      }
+      return 0;
+    }
+  }
+
+  k_mutex_lock(&treeaccess, K_FOREVER);
+  memcpy(tree_path, path, len);
+  tree_path[len] = 0;
+  stack[depth++] = len;
+  /*
+   * Iterate-then-delete: a batch of names is listed with the directory closed again
+   * before anything is removed, so littlefs never sees an unlink under an open
+   * directory. A subdirectory is descended into right away and the parent is listed
+   * again once it is gone.
+   */
+  while (depth > 0 && res >= 0) {
+    int count = gdo_fs_tree_list();
+
+    if (count < 0) {
+      res = count;
+      break;
+    }
+    if (count == 0) {
+      /* directory is empty now */
+      depth--;
+      if (depth > 0 || (flags & GDO_FS_DELETE_ROOT)) {
+        res = gdo_fs_remove(tree_path);
+        if (res == 0) {
+          removed++;
+          if (cb != NULL) {
+            cb(tree_path, removed, user_data);
+          }
+        }
+      }
+      if (depth > 0) {
+        tree_path[stack[depth - 1]] = 0;
+      }
+      continue;
+    }
+    for (int i = 0; i < count && res >= 0; i++) {
+      size_t parent = stack[depth - 1];
+      int child     = gdo_fs_tree_join(parent, tree_batch[i].name);
+
+      if (child < 0) {
+        res = child;
+        break;
+      }
+      if (tree_batch[i].type == FS_DIR_ENTRY_DIR) {
+        if (depth > GDO_FS_DELETE_MAX_DEPTH) {
+          LOG_ERR("FS-Delete: %s nested too deep", tree_path);
+          res = -E2BIG;
+          break;
+        }
+        stack[depth++] = child;
+        break;
+      }
+      res = gdo_fs_remove(tree_path);
+      if (res == 0) {
+        removed++;
+        if (cb != NULL) {
+          cb(tree_path, removed, user_data);
+        }
+      }
+      tree_path[parent] = 0;
+    }
+  }
+  if (res < 0) {
+    LOG_ERR("FS-Delete: %s err %d", tree_path, res);
+  }
+  k_mutex_unlock(&treeaccess);
+  if (whole && res >= 0) {
+    gdo_fs_tree_wiped();
+  }
+  return (res < 0) ? res : removed;
+}
+
+int gdo_fs_delete_all_file(const char *disk, const char *path)
+{
+  uint32_t stat_start = GDO_FS_STAT_START();
+  int res = gdo_fs_delete_tree(path, GDO_FS_FAST_WIPE ? GDO_FS_DELETE_FAST_WIPE : 0, NULL, NULL);
+  GDO_FS_STAT_END(GDO_FS_STAT_API_DELETE_ALL, stat_start, res, 0);
+  return res;
+}
+
+bool gdo_fs_create_file(const char *full_path_file, size_t size_file)
+{
+  uint32_t stat_start = GDO_FS_STAT_START();
+  if (GDO_FS_MAX_PATH_LEN <= strlen(full_path_file)) {
+    LOG_ERR("FS-Create File-ERR: file path too long");
+    return false;
+  }
+  bool flag = false;
+  struct gdo_fs_file file;
+  int id                   = gdo_fs_managed_find(full_path_file);
+  uint8_t flags            = gdo_fs_file_flags(id, full_path_file);
+  struct gdo_fs_lock *lock = gdo_fs_file_lock(id, full_path_file, GDO_FS_LOCK_WRITE);
+  if (flags & GDO_FS_FILE_ROUTED) {
+    /* a leftover single file table would be migrated again at the next boot */
+    int res = gdo_fs_remove(full_path_file);
+    flag    = (res == 0 || res == -ENOENT) && gdo_user_store_reset(size_file);
+    gdo_user_index_reset();
+    goto done;
+  }
+  gdo_fs_access_lock();
+  LOG_INF("Create file %s", full_path_file);
+  gdo_fs_handle_evict(id, full_path_file);
+
+  if (gdo_fs_io_open(&file, full_path_file, FS_O_CREATE | FS_O_RDWR) != 0) {
+    LOG_ERR("FS-Create File-ERR: create file %s", full_path_file);
+    goto exit;
+  }
+
+  int sparse_id = GDO_FS_SPARSE_FILES ? id : -1;
+  if (sparse_id >= 0) {
+    /* an empty map first: a reset cut after it finds no chunk of the old data */
+    gdo_fs_sparse_reset(sparse_id, size_file);
+    if (size_file > gdo_fs_sparse_capacity(&sparse_files[sparse_id]) || gdo_fs_sparse_save(sparse_id) != 0) {
+      gdo_fs_io_unlink(managed_files[sparse_id].map);
+      sparse_files[sparse_id].known = false;
+      sparse_id                     = -1;
+    }
+  }
+  if (gdo_fs_io_truncate(&file, 0) != 0) {
+    LOG_ERR("Failed to shirk file");
+    gdo_fs_io_close(&file);
+    goto exit;
+  }
+
+  if (sparse_id >= 0) {
+    /* nothing is zero filled, chunks get their place when they are written */
+    sparse_files[sparse_id].physical = 0;
+  } else if (gdo_fs_io_truncate(&file, size_file) != 0) {
+    LOG_ERR("Failed to extend file to: %lu bytes", size_file);
+    gdo_fs_io_close(&file);
+    goto exit;
+  }
+  gdo_fs_io_sync(&file);
+
+  gdo_fs_io_close(&file);
+  flag = true;
+  if (flags & GDO_FS_FILE_USER_INDEX) {
+    gdo_user_index_reset();
+  }
+exit:
+  k_mutex_unlock(&fileaccess);
+done:
+  gdo_fs_view_invalidate(full_path_file, 0, 0);
+  gdo_fs_compress_forget(full_path_file);
+  if (flag) {
+    gdo_fs_integrity_on_reset(full_path_file);
+  }
+  gdo_fs_lock_release(lock);
+  GDO_FS_STAT_END(GDO_FS_STAT_API_CREATE, stat_start, flag ? 0 : -1, 0);
+  return flag;
+}
+
+int gdo_fs_read_file(const char *disk, const char *full_path_file, void *buff, size_t len)
+{
+  uint32_t stat_start = GDO_FS_STAT_START();
+  int res = 0;
+  int id                   = gdo_fs_managed_find(full_path_file);
+  struct gdo_fs_lock *lock = gdo_fs_file_lock(id, full_path_file, GDO_FS_LOCK_READ);
+  if (gdo_fs_file_flags(id, full_path_file) & GDO_FS_FILE_COMPRESSED) {
+    struct gdo_fs_lz_reader reader;
+
+    /* whatever the file holds, up to len bytes */
+    gdo_fs_lz_reader_init(&reader);
+    res = gdo_fs_lz_read(&reader, gdo_fs_lz_source, (void *) full_path_file, buff, len);
+    goto exit;
+  }
+  res = gdo_fs_pread_routed(id, full_path_file, buff, len, 0);
+  if (res >= 0 && res != len) {
+    LOG_ERR("Error len file %d bytes, you read %d bytes\n", res, len);
+    res = 0;
+  }
+  if (res > 0 && gdo_fs_integrity_verify(id, buff, res, 0) != 0) {
+    res = -1;
+  }
+exit:
+  gdo_fs_lock_release(lock);
+  GDO_FS_STAT_END(GDO_FS_STAT_API_READ_FILE, stat_start, res, (res > 0) ? res : 0);
+  return res;
+}
+
+int gdo_fs_read_file_seq(const char *full_path_file, struct gdo_fs_lz_reader *reader, void *buff, size_t len)
+{
+  uint32_t stat_start = GDO_FS_STAT_START();
+  int res = 0;
+  int id                   = gdo_fs_managed_find(full_path_file);
+  struct gdo_fs_lock *lock = gdo_fs_file_lock(id, full_path_file, GDO_FS_LOCK_READ);
+  if (gdo_fs_file_flags(id, full_path_file) & GDO_FS_FILE_COMPRESSED) {
+    res = gdo_fs_lz_read(reader, gdo_fs_lz_source, (void *) full_path_file, buff, len);
+  } else {
+    res = gdo_fs_pread_routed(id, full_path_file, buff, len, reader->pos);
+    if (res > 0) {
+      reader->pos += res;
+    }
+  }
+  gdo_fs_lock_release(lock);
+  GDO_FS_STAT_END(GDO_FS_STAT_API_READ_FILE, stat_start, res, (res > 0) ? res : 0);
+  return res;
+}
+
+/*
+ * Appends @p len bytes to a compressed file, a frame per GDO_FS_COMPRESS_BLOCK. Each frame is
+ * encoded before fileaccess is taken, the file write lock keeps the frames in order. On a
+ * failure the file is truncated back to where the call started, so no partial frame is left.
+ */
+static int gdo_fs_append_compressed(int id, const char *full_path_file, int lz_id, const uint8_t *buff, size_t len)
+{
+  struct gdo_fs_handle *handle;
+  struct fs_dirent entry;
+  const uint8_t *frame;
+  size_t frame_len;
+  size_t n;
+  off_t start = 0;
+  int res     = 0;
+
+  gdo_fs_access_lock();
+  /* fs_stat does not see what a cached handle has not synced yet */
+  handle = gdo_fs_handle_find(id, full_path_file);
+  if (handle != NULL && handle->dirty) {
+    res = gdo_fs_handle_written(handle);
+  }
+  if (res == 0) {
+    res = gdo_fs_io_stat(full_path_file, &entry);
+    if (res == 0) {
+      start = entry.size;
+    } else if (res == -ENOENT) {
+      res = 0;
+    }
+  }
+  k_mutex_unlock(&fileaccess);
+  if (res != 0) {
+    LOG_ERR("Failed to size file %s err %d\n", full_path_file, res);
+    return -1;
+  }
+
+  for (size_t done = 0; done < len && res >= 0; done += n) {
+    n         = MIN(len - done, GDO_FS_COMPRESS_BLOCK);
+    frame_len = gdo_fs_compress_encode(lz_id, buff + done, n, &frame);
+    gdo_fs_access_lock();
+    handle = gdo_fs_handle_get(id, full_path_file, &res);
+    if (handle == NULL) {
+      LOG_ERR("Failed to open file %s err %d\n", full_path_file, res);
+      res = -1;
+    } else if (gdo_fs_io_seek(&handle->file, 0, FS_SEEK_END) != 0) {
+      LOG_ERR("Failed to seek file %s \n", full_path_file);
+      gdo_fs_handle_close(handle);
+      res = -1;
+    } else {
+      res = gdo_fs_io_write(&handle->file, frame, frame_len);
+      if (res < 0 || res != frame_len) {
+        LOG_ERR("Error write file %s , ret: %d\n", full_path_file, res);
+        gdo_fs_handle_close(handle);
+        res = -1;
+      } else if (gdo_fs_handle_written(handle) != 0) {
+        res = -1;
+      }
+    }
+    k_mutex_unlock(&fileaccess);
+    gdo_fs_compress_commit(lz_id, buff + done, n, res >= 0);
+  }
+  if (res < 0) {
+    /* the failed commit already dropped the window, the next frame starts a new one */
+    gdo_fs_access_lock();
+    handle = gdo_fs_handle_get(id, full_path_file, &res);
+    if (handle == NULL || gdo_fs_io_truncate(&handle->file, start) != 0 || gdo_fs_handle_written(handle) != 0) {
+      LOG_ERR("Failed to roll back file %s to %d\n", full_path_file, (int) start);
+      if (handle != NULL) {
+        gdo_fs_handle_close(handle);
+      }
+    }
+    k_mutex_unlock(&fileaccess);
+    return -1;
+  }
+  return len;
+}
+
+int gdo_fs_write_file(const char *disk, const char *full_path_file, void *buff, size_t len)
+{
+  uint32_t stat_start = GDO_FS_STAT_START();
+  int res = 0;
+  int id  = gdo_fs_managed_find(full_path_file);
+  struct gdo_fs_lock *lock;
+
+  if (gdo_fs_file_flags(id, full_path_file) & GDO_FS_FILE_ROUTED) {
+    /* fixed size table, records are written in place */
+    LOG_ERR("Append to %s not supported", full_path_file);
+    return -1;
+  }
+  lock = gdo_fs_file_lock(id, full_path_file, GDO_FS_LOCK_WRITE);
+  int lz_id = gdo_fs_compress_find(full_path_file);
+  if (lz_id >= 0) {
+    res = gdo_fs_append_compressed(id, full_path_file, lz_id, buff, len);
+    goto done;
+  }
+  gdo_fs_access_lock();
+  struct gdo_fs_sparse *sparse = gdo_fs_sparse_get(id);
+  struct gdo_fs_handle *handle = gdo_fs_handle_get(id, full_path_file, &res);
+
+  if (handle == NULL) {
+    LOG_ERR("Failed to open file %s err %d\n", full_path_file, res);
+    goto exit;
+  }
+  /* a sparse file ends at its logical size, not where its last slot stops */
+  if (sparse != NULL) {
+    res = gdo_fs_pwrite(handle, sparse, buff, len, sparse->map.size);
+  } else {
+    res = gdo_fs_io_seek(&handle->file, 0, FS_SEEK_END);
+    if (res != 0) {
+      LOG_ERR("Failed to seek file %s \n", full_path_file);
+      gdo_fs_handle_close(handle);
+      goto exit;
+    }
+    res = gdo_fs_io_write(&handle->file, buff, len);
+  }
+  if (res < 0 || res != len) {
+    LOG_ERR("Error write file %s , ret: %d\n", full_path_file, res);
+    gdo_fs_handle_close(handle);
+    gdo_fs_sparse_forget(id);
+    res = -1;
+  } else if (gdo_fs_handle_written(handle) != 0 || gdo_fs_sparse_commit(handle, sparse) != 0) {
+    res = -1;
+  }
+exit:
+  k_mutex_unlock(&fileaccess);
+done:
+  gdo_fs_view_invalidate(full_path_file, 0, 0);
+  gdo_fs_lock_release(lock);
+  GDO_FS_STAT_END(GDO_FS_STAT_API_WRITE_FILE, stat_start, res, (res > 0) ? res : 0);
+  return res;
+}
+
+/* gdo_fs_write_file_index() of file @p id (managed_files index, -1 for any other file) */
+static int gdo_fs_write_index(int id, const char *full_path_file, const void *buff, size_t len, size_t index)
+{
+  uint32_t stat_start = GDO_FS_STAT_START();
+  int res = 0;
+  size_t lo = 0;
+  size_t hi = len;
+  enum gdo_fs_stat_op stat_api = GDO_FS_STAT_API_WRITE_INDEX;
+  uint8_t flags = gdo_fs_file_flags(id, full_path_file);
+  if (gdo_fs_compressed_reject(id, full_path_file)) {
+    return -1;
+  }
+  struct gdo_fs_lock *lock = gdo_fs_file_lock(id, full_path_file, GDO_FS_LOCK_WRITE);
+  if (flags & GDO_FS_FILE_ROUTED) {
+    res = gdo_user_store_write(buff, len, index);
+    goto exit;
+  }
+  gdo_fs_access_lock();
+  struct gdo_fs_sparse *sparse = gdo_fs_sparse_get(id);
+  struct gdo_fs_handle *handle;
+
+  if (GDO_FS_WRITE_COMPARE && gdo_fs_diff_range(id, full_path_file, buff, len, index, &lo, &hi) == 0 && lo == hi) {
+    /* same bytes already in the file, no littlefs commit */
+    k_mutex_unlock(&fileaccess);
+    res = len;
+    stat_api = GDO_FS_STAT_API_WRITE_SKIP;
+    goto exit;
+  }
+  handle = gdo_fs_handle_get(id, full_path_file, &res);
+  if (handle == NULL) {
+    LOG_ERR("Failed to open file %s err %d\n", full_path_file, res);
+    k_mutex_unlock(&fileaccess);
+    goto exit;
+  }
+  res = gdo_fs_pwrite(handle, sparse, (const uint8_t *) buff + lo, hi - lo, index + lo);
+  if (res < 0 || res != hi - lo) {
+    LOG_ERR("Error write file %s\n", full_path_file);
+    gdo_fs_handle_close(handle);
+    gdo_fs_sparse_forget(id);
+    res = -1;
+  } else if (gdo_fs_handle_written(handle) != 0 || gdo_fs_sparse_commit(handle, sparse) != 0) {
+    res = -1;
+  } else {
+    res = len;
+  }
+  k_mutex_unlock(&fileaccess);
+exit:
+  /* still under the file write lock, so index updates land in write order */
+  if (res > 0 && (flags & GDO_FS_FILE_USER_INDEX)) {
+    gdo_user_index_on_write(buff, len, index);
+  }
+  if (lo != hi) {
+    gdo_fs_view_invalidate(full_path_file, index, len);
+  }
+  if (res > 0 && lo != hi) {
+    gdo_fs_integrity_on_write(id, buff, len, index);
+  }
+  gdo_fs_lock_release(lock);
+  GDO_FS_STAT_END(stat_api, stat_start, res, (res > 0) ? res : 0);
+  return res;
+}
+
+int gdo_fs_write_file_index(const char *disk, const char *full_path_file, void *buff, size_t len, size_t index)
+{
+  return gdo_fs_write_index(gdo_fs_managed_find(full_path_file), full_path_file, buff, len, index);
+}
+
+int gdo_fs_write_file_id(enum gdo_file_id id, const void *buff, size_t len, size_t index)
+{
+  if ((unsigned int) id >= GDO_FILE_NUM) {
+    return -EINVAL;
+  }
+  return gdo_fs_write_index(id, gdo_fs_files[id].path, buff, len, index);
+}
+
+static int gdo_fs_read_index(int id, const char *full_path_file, void *buff, size_t len, size_t index, bool verify)
+{
+  int res = 0;
+  if (gdo_fs_compressed_reject(id, full_path_file)) {
+    return -1;
+  }
+  struct gdo_fs_lock *lock = gdo_fs_file_lock(id, full_path_file, GDO_FS_LOCK_READ);
+  res = gdo_fs_pread_routed(id, full_path_file, buff, len, index);
+  if (res < 0) {
+    res = -1;
+  } else if (res != len) {
+    LOG_ERR("Error len file %d bytes, you read %d bytes, index %d\n", res, len, index);
+    res = -1;
+  }
+  /* checked under the read lock, a writer cannot re-seal the records in between */
+  if (verify && res > 0 && gdo_fs_integrity_verify(id, buff, len, index) != 0) {
+    res = -1;
+  }
+  gdo_fs_lock_release(lock);
+  return res;
+}
+
+int gdo_fs_read_file_index(const char *disk, const char *full_path_file, void *buff, size_t len, size_t index)
+{
+  uint32_t stat_start = GDO_FS_STAT_START();
+  int res = gdo_fs_read_index(gdo_fs_managed_find(full_path_file), full_path_file, buff, len, index, true);
+  GDO_FS_STAT_END(GDO_FS_STAT_API_READ_INDEX, stat_start, res, (res > 0) ? res : 0);
+  return res;
+}
+
+int gdo_fs_read_file_id(enum gdo_file_id id, void *buff, size_t len, size_t index)
+{
+  if ((unsigned int) id >= GDO_FILE_NUM) {
+    return -EINVAL;
+  }
+  uint32_t stat_start = GDO_FS_STAT_START();
+  int res = gdo_fs_read_index(id, gdo_fs_files[id].path, buff, len, index, true);
+  GDO_FS_STAT_END(GDO_FS_STAT_API_READ_INDEX, stat_start, res, (res > 0) ? res : 0);
+  return res;
+}
+
+int gdo_fs_read_file_index_raw(const char *full_path_file, void *buff, size_t len, size_t index)
+{
+  return gdo_fs_read_index(gdo_fs_managed_find(full_path_file), full_path_file, buff, len, index, false);
+}
+
+int gdo_fs_writev_index(const char *disk, const char *full_path_file, const struct gdo_fs_iovec *iov, size_t iovcnt)
+{
+  uint32_t stat_start = GDO_FS_STAT_START();
+  int res = 0;
+  int total = 0;
+  /* segments [0, done) are committed, [done, unsure) may be in part, the rest is untouched */
+  size_t done = 0;
+  size_t unsure = 0;
+  struct gdo_fs_handle *handle;
+  struct gdo_fs_sparse *sparse;
+  int id        = gdo_fs_managed_find(full_path_file);
+  uint8_t flags = gdo_fs_file_flags(id, full_path_file);
+  if (gdo_fs_compressed_reject(id, full_path_file)) {
+    return -1;
+  }
+  struct gdo_fs_lock *lock = gdo_fs_file_lock(id, full_path_file, GDO_FS_LOCK_WRITE);
+
+  if (flags & GDO_FS_FILE_ROUTED) {
+    /* the whole batch still costs one writev per split file */
+    res    = gdo_user_store_writev(iov, iovcnt);
+    total  = (res < 0) ? 0 : res;
+    done   = (res < 0) ? 0 : iovcnt;
+    unsure = iovcnt;
+    goto exit;
+  }
+  /*
+   * fileaccess is held over the whole batch: no other thread can evict, and so sync, the
+   * handle half way, the batch is one commit. A segment that fails is not undone, littlefs
+   * has no discard and the close commits what was written before it.
+   */
+  gdo_fs_access_lock();
+  sparse = gdo_fs_sparse_get(id);
+  handle = gdo_fs_handle_get(id, full_path_file, &res);
+  if (handle == NULL) {
+    LOG_ERR("Failed to open file %s err %d\n", full_path_file, res);
   }
+  for (size_t i = 0; i < iovcnt && handle != NULL; i++) {
+    res = gdo_fs_pwrite(handle, sparse, iov[i].buff, iov[i].len, iov[i].index);
+    if (res < 0 || res != iov[i].len) {
+      LOG_ERR("Error write file %s segment %u\n", full_path_file, i);
+      unsure = i + 1;
+      res    = -1;
+    }
+    if (res < 0) {
+      /* close commits the segments already written, the hooks below follow them */
+      gdo_fs_handle_close(handle);
+      if (gdo_fs_sparse_commit(handle, sparse) != 0) {
+        /* their chunks did not reach the map, refresh them too */
+        done = 0;
+      }
+      handle = NULL;
+      break;
+    }
+    handle->dirty = true;
+    total += res;
+    done   = i + 1;
+    unsure = done;
+  }
+  /* one commit for the whole batch */
+  if (res >= 0 && handle != NULL && handle->dirty &&
+      (gdo_fs_handle_written(handle) != 0 || gdo_fs_sparse_commit(handle, sparse) != 0)) {
+    /* what reached flash is not known, refresh every segment from the file */
+    res    = -1;
+    done   = 0;
+    unsure = iovcnt;
+  }
+  k_mutex_unlock(&fileaccess);
+exit:
+  /* the sidecar first: a refresh of the index reads the file, which is checked against it */
+  for (size_t i = 0; i < unsure; i++) {
+    gdo_fs_integrity_on_write(id, (i < done) ? iov[i].buff : NULL, iov[i].len, iov[i].index);
+  }
+  if (flags & GDO_FS_FILE_USER_INDEX) {
+    for (size_t i = 0; i < unsure; i++) {
+      gdo_user_index_on_write((i < done) ? iov[i].buff : NULL, iov[i].len, iov[i].index);
+    }
+  }
+  for (size_t i = 0; i < iovcnt; i++) {
+    gdo_fs_view_invalidate(full_path_file, iov[i].index, iov[i].len);
+  }
+  gdo_fs_lock_release(lock);
+  GDO_FS_STAT_END(GDO_FS_STAT_API_WRITEV, stat_start, res, total);
+  return (res < 0) ? res : total;
+}
 
-  if (gdo_fs_file_exist(SCHEDULE_CURRENT_FILE_FULL_PATH) == FILE_NOT_EXIST) {
-    flag &= gdo_fs_create_file(SCHEDULE_CURRENT_FILE_FULL_PATH, SCHEDULE_NUM * sizeof(struct schedule_data));
+int gdo_fs_readv_index(const char *disk, const char *full_path_file, const struct gdo_fs_iovec *iov, size_t iovcnt)
+{
+  uint32_t stat_start = GDO_FS_STAT_START();
+  int res = 0;
+  int total = 0;
+  int id    = gdo_fs_managed_find(full_path_file);
+  if (gdo_fs_compressed_reject(id, full_path_file)) {
+    return -1;
+  }
+  struct gdo_fs_lock *lock = gdo_fs_file_lock(id, full_path_file, GDO_FS_LOCK_READ);
+
+  for (size_t i = 0; i < iovcnt; i++) {
+    res = gdo_fs_pread_routed(id, full_path_file, iov[i].buff, iov[i].len, iov[i].index);
+    if (res < 0) {
+      res = -1;
+    } else if (res != iov[i].len) {
+      LOG_ERR("Error len file %d bytes, you read %d bytes, index %d\n", res, iov[i].len, iov[i].index);
+      res = -1;
+    }
+    if (res > 0 && gdo_fs_integrity_verify(id, iov[i].buff, iov[i].len, iov[i].index) != 0) {
+      res = -1;
+    }
+    if (res < 0) {
+      break;
+    }
+    total += res;
   }
+  gdo_fs_lock_release(lock);
+  GDO_FS_STAT_END(GDO_FS_STAT_API_READV, stat_start, res, total);
+  return (res < 0) ? res : total;
+}
 
-  if (gdo_fs_file_exist(SCHEDULE_BACKUP_FILE_FULL_PATH) == FILE_NOT_EXIST) {
-    flag &= gdo_fs_create_file(SCHEDULE_BACKUP_FILE_FULL_PATH, SCHEDULE_NUM * sizeof(struct schedule_data));
+bool gdo_fs_reset_file(enum gdo_file_id id)
+{
+  if ((unsigned int) id >= GDO_FILE_NUM) {
+    return false;
+  }
+  if (gdo_fs_files[id].reset == GDO_FILE_RESET_KEEP) {
+    return true;
+  }
+  /* the legacy copy is recreated too, it only seeds the store at its first start */
+  if (gdo_fs_files[id].reset == GDO_FILE_RESET_SCHEDULES && gdo_schedule_store_clear() != 0) {
+    LOG_ERR("FS-RESET: schedule store");
+    return false;
   }
+  /* or a batch staged before the reset would be replayed over the empty table */
+  if (gdo_fs_files[id].reset == GDO_FILE_RESET_USERS && gdo_user_bulk_discard() != 0) {
+    LOG_ERR("FS-RESET: user batch");
+    return false;
+  }
+  return gdo_fs_create_file(gdo_fs_files[id].path, gdo_fs_file_size_of(id));
+}
+
+/* Resets every registry file with one of the @p init_type bits */
+static bool gdo_fs_reset_files(uint8_t init_type)
+{
+  bool flag = true;
 
-  if (gdo_fs_file_exist(HOME_CFG_FILE_FULL_PATH) == FILE_NOT_EXIST) {
-    flag &= gdo_fs_create_file(HOME_CFG_FILE_FULL_PATH, HOME_CFG_FILE_SIZE);
+  for (int id = 0; id < GDO_FILE_NUM; id++) {
+    if (gdo_fs_files[id].reset_on & init_type) {
+      flag &= gdo_fs_reset_file(id);
+    }
   }
   return flag;
 }
 
-bool gdo_file_system_init()
+bool gdo_fs_delete_file(const char *disk, const char *full_path_file)
+{
+  int id = gdo_fs_file_find(full_path_file);
+
+  /* a file outside the registry has no reset size and is left alone */
+  return (id < 0) || gdo_fs_reset_file(id);
+}
+
+int gdo_fs_unlink(const char *full_path_file)
+{
+  if (GDO_FS_MAX_PATH_LEN <= strlen(full_path_file)) {
+    return -ENAMETOOLONG;
+  }
+  return gdo_fs_remove(full_path_file);
+}
+
+uint8_t gdo_fs_file_exist(const char *full_path_file)
+{
+  int res = 0;
+  struct fs_dirent entry;
+  uint8_t rs = 0;
+  if (gdo_user_store_routed(full_path_file)) {
+    full_path_file = GDO_USER_HOT_FULL_PATH;
+  }
+  int id                   = gdo_fs_managed_find(full_path_file);
+  struct gdo_fs_lock *lock = gdo_fs_file_lock(id, full_path_file, GDO_FS_LOCK_READ);
+  gdo_fs_access_lock();
+  if (gdo_fs_handle_find(id, full_path_file) != NULL) {
+    rs = FILE_EXIST;
+    goto exit;
+  }
+  res = gdo_fs_io_stat(full_path_file, &entry);
+  if (res == 0) {
+    rs = FILE_EXIST;
+    goto exit;
+  }
+
+  if (res == -ENOENT) {
+    rs = FILE_NOT_EXIST;
+    goto exit;
+  }
+  rs = FILE_ERROR;
+exit:
+  k_mutex_unlock(&fileaccess);
+  gdo_fs_lock_release(lock);
+  return rs;
+}
+
+int gdo_fs_statvfs(const char *path, struct fs_statvfs *stat)
+{
+  gdo_fs_access_lock();
+  int res = gdo_fs_io_statvfs(path, stat);
+  k_mutex_unlock(&fileaccess);
+  return res;
+}
+
+int gdo_fs_file_size(const char *full_path_file)
+{
+  int res = 0;
+  struct fs_dirent entry;
+  int id = gdo_fs_managed_find(full_path_file);
+  if (gdo_fs_file_flags(id, full_path_file) & GDO_FS_FILE_ROUTED) {
+    return gdo_user_store_size();
+  }
+  struct gdo_fs_lock *lock = gdo_fs_file_lock(id, full_path_file, GDO_FS_LOCK_READ);
+  gdo_fs_access_lock();
+  /* a cached handle may hold unsynced data that fs_stat does not see yet */
+  struct gdo_fs_handle *handle = gdo_fs_handle_find(id, full_path_file);
+  if (handle != NULL && handle->dirty) {
+    gdo_fs_handle_written(handle);
+  }
+  struct gdo_fs_sparse *sparse = gdo_fs_sparse_get(id);
+  if (sparse != NULL) {
+    res = sparse->map.size;
+  } else {
+    res = gdo_fs_io_stat(full_path_file, &entry);
+    if (res == 0) {
+      res = (entry.type == FS_DIR_ENTRY_FILE) ? (int) entry.size : -EISDIR;
+    }
+  }
+  k_mutex_unlock(&fileaccess);
+  gdo_fs_lock_release(lock);
+  return res;
+}
+
+int gdo_fs_rename(const char *from_path, const char *to_path)
+{
+  int res = 0;
+  int from_id = gdo_fs_managed_find(from_path);
+  int to_id   = gdo_fs_managed_find(to_path);
+  struct gdo_fs_lock *from_lock;
+  struct gdo_fs_lock *to_lock;
+  /* one acquire, so the rename never holds one lock entry while it waits for the other */
+  gdo_fs_lock_acquire_pair(from_path, to_path, &from_lock, &to_lock);
+  gdo_fs_access_lock();
+  gdo_fs_handle_evict(from_id, from_path);
+  gdo_fs_handle_evict(to_id, to_path);
+  gdo_fs_sparse_forget(from_id);
+  gdo_fs_sparse_forget(to_id);
+  res = gdo_fs_io_rename(from_path, to_path);
+  if (res != 0) {
+    LOG_ERR("Failed to rename %s to %s err %d\n", from_path, to_path, res);
+  }
+  k_mutex_unlock(&fileaccess);
+  gdo_fs_view_invalidate(from_path, 0, 0);
+  gdo_fs_view_invalidate(to_path, 0, 0);
+  gdo_fs_compress_forget(from_path);
+  gdo_fs_compress_forget(to_path);
+  gdo_fs_lock_release(to_lock);
+  gdo_fs_lock_release(from_lock);
+  return res;
+}
+
+static uint32_t fs_ready_us;
+
+/*
+ * Logical resize of a sparse file keeping the prefix, with fileaccess held. Chunks past the
+ * new end are dropped and the rest of the last one is zeroed, so growing again reads zeros.
+ */
+static int gdo_fs_sparse_resize(int id, const char *full_path_file, struct gdo_fs_sparse *sparse, size_t size_file)
+{
+  static const uint8_t zero[GDO_FS_COMPARE_CHUNK];
+  size_t chunk     = BIT(sparse->shift);
+  size_t tail_end  = MIN(sparse->map.size, (size_file + chunk - 1) & ~(chunk - 1));
+  struct gdo_fs_handle *handle = NULL;
+  int res          = 0;
+
+  if (size_file > gdo_fs_sparse_capacity(sparse)) {
+    return -EFBIG;
+  }
+  if (size_file < tail_end && sparse->map.slot[size_file >> sparse->shift] != GDO_FS_SPARSE_NONE) {
+    handle = gdo_fs_handle_get(id, full_path_file, &res);
+    for (size_t pos = size_file; handle != NULL && pos < tail_end && res >= 0; pos += sizeof(zero)) {
+      res = gdo_fs_pwrite(handle, sparse, zero, MIN(sizeof(zero), tail_end - pos), pos);
+    }
+    if (handle != NULL) {
+      res = (res < 0) ? res : gdo_fs_handle_close(handle);
+    }
+  }
+  if (res < 0) {
+    sparse->known = false;
+    return res;
+  }
+  for (size_t c = (size_file + chunk - 1) >> sparse->shift; c < GDO_FS_SPARSE_CHUNKS; c++) {
+    sparse->map.slot[c] = GDO_FS_SPARSE_NONE;
+  }
+  sparse->map.size = size_file;
+  return gdo_fs_sparse_save(sparse - sparse_files);
+}
+
+/* Sets the file length, keeping the existing prefix (the tail is zero filled when growing) */
+static int gdo_fs_resize_file(const char *full_path_file, size_t size_file)
+{
+  struct gdo_fs_file file;
+  int id                   = gdo_fs_managed_find(full_path_file);
+  struct gdo_fs_lock *lock = gdo_fs_file_lock(id, full_path_file, GDO_FS_LOCK_WRITE);
+  gdo_fs_access_lock();
+  gdo_fs_handle_evict(id, full_path_file);
+  gdo_fs_sparse_forget(id);
+  struct gdo_fs_sparse *sparse = gdo_fs_sparse_get(id);
+  int res;
+  if (sparse != NULL) {
+    res = gdo_fs_sparse_resize(id, full_path_file, sparse, size_file);
+  } else {
+    res = gdo_fs_io_open(&file, full_path_file, FS_O_RDWR);
+    if (res == 0) {
+      res = gdo_fs_io_truncate(&file, size_file);
+      if (res == 0) {
+        res = gdo_fs_io_sync(&file);
+      }
+      gdo_fs_io_close(&file);
+    }
+  }
+  k_mutex_unlock(&fileaccess);
+  gdo_fs_lock_release(lock);
+  return res;
+}
+
+/*
+ * Copies a single file user table into the split files, then drops it. Until the unlink the
+ * single file stays the reference: a migration cut by a power loss starts over at the next
+ * boot. Runs at boot before the storage queue, nothing else touches the user files yet.
+ */
+static int gdo_fs_user_migrate(void)
+{
+  uint8_t chunk[4 * GDO_FS_COMPARE_CHUNK];
+  size_t size = GDO_MAX_USER_SUPORT * sizeof(gdo_user_infor);
+  int res     = 0;
+
+  LOG_INF("FS-Provision: moving %s to the split user layout", GDO_USER_INFOR_FULL_PATH);
+  if (!gdo_user_store_reset(size)) {
+    return -EIO;
+  }
+  for (size_t index = 0; index < size && res >= 0; index += sizeof(chunk)) {
+    size_t n  = MIN(sizeof(chunk), size - index);
+    bool zero = true;
+
+    gdo_fs_access_lock();
+    res = gdo_fs_pread(GDO_FILE_USERS, GDO_USER_INFOR_FULL_PATH, chunk, n, index);
+    k_mutex_unlock(&fileaccess);
+    if (res < 0) {
+      break;
+    }
+    /* a short single file reads as zeros past its end */
+    memset(chunk + res, 0, n - res);
+    for (size_t i = 0; i < n && zero; i++) {
+      zero = (chunk[i] == 0);
+    }
+    /* the split files are fresh and read as zeros already */
+    res = zero ? 0 : gdo_user_store_write(chunk, n, index);
+  }
+  if (res < 0) {
+    LOG_ERR("FS-Provision: user migration err %d", res);
+    return res;
+  }
+  return gdo_fs_remove(GDO_USER_INFOR_FULL_PATH);
+}
+
+/*
+ * One directory listing instead of an fs_stat per file: every managed file that is
+ * missing is created, one with the wrong size is resized in place.
+ */
+bool createFileIfNotExist()
+{
+  ssize_t found[ARRAY_SIZE(managed_files)];
+  struct gdo_fs_dir dirp;
+  struct fs_dirent entry;
+  bool flag   = true;
+  bool legacy = false;
+  int res;
+
+  for (size_t i = 0; i < ARRAY_SIZE(managed_files); i++) {
+    found[i] = -1;
+  }
+  gdo_fs_access_lock();
+  res = gdo_fs_io_opendir(&dirp, GDO_DISK_MOUNT_PT);
+  if (res == 0) {
+    while (gdo_fs_io_readdir(&dirp, &entry) == 0 && entry.name[0] != 0) {
+      if (entry.type != FS_DIR_ENTRY_FILE) {
+        continue;
+      }
+      if (GDO_USER_STORE_SPLIT && strcmp(entry.name, strrchr(GDO_USER_INFOR_FULL_PATH, '/') + 1) == 0) {
+        legacy = true;
+        continue;
+      }
+      for (size_t i = 0; i < ARRAY_SIZE(managed_files); i++) {
+        if (strcmp(entry.name, strrchr(managed_files[i].path, '/') + 1) == 0) {
+          found[i] = entry.size;
+          break;
+        }
+      }
+    }
+    gdo_fs_io_closedir(&dirp);
+  }
+  k_mutex_unlock(&fileaccess);
+  if (res != 0) {
+    LOG_ERR("FS-Provision: open dir %s err %d", GDO_DISK_MOUNT_PT, res);
+    return false;
+  }
+  if (legacy) {
+    if (gdo_fs_user_migrate() != 0) {
+      return false;
+    }
+    /* recreated by the migration */
+    found[gdo_fs_managed_find(GDO_USER_HOT_FULL_PATH)]  = 0;
+    found[gdo_fs_managed_find(GDO_USER_COLD_FULL_PATH)] = 0;
+  }
+
+  for (size_t i = 0; i < ARRAY_SIZE(managed_files); i++) {
+    const struct gdo_fs_managed_file *mf = &managed_files[i];
+
+    if (gdo_fs_file_flags(i, mf->path) & GDO_FS_FILE_ROUTED) {
+      /* provisioned as its two split files */
+      continue;
+    }
+    if (found[i] < 0) {
+      flag &= gdo_fs_create_file(mf->path, mf->size);
+      continue;
+    }
+    /* a sparse file is shorter on flash than its logical size by design, its map has the size */
+    int size = GDO_FS_SPARSE_FILES ? gdo_fs_file_size(mf->path) : found[i];
+    if (size != (int) mf->size) {
+      LOG_INF("FS-Provision: %s is %d bytes, expected %u", mf->path, size, mf->size);
+      flag &= (gdo_fs_resize_file(mf->path, mf->size) == 0);
+    }
+  }
+  return flag;
+}
+
+uint32_t gdo_fs_init_time_us(void)
+{
+  return fs_ready_us;
+}
+
+static bool gdo_file_system_prepare()
 {
   /*read build timer in ex flash */
   /*compare*/
   LOG_INF("Build time %s", BUILD_TIMESTAMP);
-  char date[20];
+  char date[sizeof(BUILD_TIMESTAMP)];
   gdo_flash_read_offset(GDO_BUILD_TIME_OFFSET, (uint8_t *) date, sizeof(BUILD_TIMESTAMP));
+  date[sizeof(date) - 1] = 0;
   /*build time is same*/
   LOG_INF("build save %s", date);
-  memset(date, 0, 20);
   if (strcmp(date, BUILD_TIMESTAMP) == 0) {
     LOG_INF("FILE NOT RESET");
     if (gdo_disk_init(GDO_DISK_MOUNT_PT) != 0) {
@@ -733,8 +2317,9 @@ bool gdo_file_system_init()
     }
     return createFileIfNotExist();
   }
-  gdo_flash_earse_region(GDO_BUILD_TIME_OFFSET, 4096);
+  /* the cache erases the sector on flush only if the old stamp is in the way */
   gdo_flash_write_offset(GDO_BUILD_TIME_OFFSET, BUILD_TIMESTAMP, sizeof(BUILD_TIMESTAMP));
+  gdo_flash_flush();
 
   if (GDO_FS_INIT_TYPE == GDO_FS_FORMAT) {
     if (!gdo_flash_earse_region(SPI_FLASH_FS_REGION_OFFSET, SPI_FLASH_FS_SECTOR_SIZE)) {
@@ -745,11 +2330,7 @@ bool gdo_file_system_init()
       LOG_ERR("FS-INIT: disk");
       return false;
     }
-    return gdo_fs_create_file(GDO_USER_INFOR_FULL_PATH, GDO_MAX_USER_SUPORT * sizeof(gdo_user_infor)) &&
-           gdo_fs_create_file(SCHEDULE_CURRENT_FILE_FULL_PATH, SCHEDULE_NUM * sizeof(struct schedule_data)) &&
-           gdo_fs_create_file(SCHEDULE_BACKUP_FILE_FULL_PATH, SCHEDULE_NUM * sizeof(struct schedule_data)) &&
-           /*todo log file here*/
-           gdo_fs_create_file(HOME_CFG_FILE_FULL_PATH, HOME_CFG_FILE_SIZE);
+    return gdo_fs_reset_files(GDO_FS_FORMAT) && (gdo_event_log_clear() == 0);
   }
 
   if (gdo_disk_init(GDO_DISK_MOUNT_PT) != 0) {
@@ -762,21 +2343,54 @@ bool gdo_file_system_init()
   }
   bool flag = true;
   if (GDO_FS_INIT_TYPE & GDO_FS_LOG_FILE) {
-    // todo log file
+    flag = (gdo_event_log_clear() == 0);
   }
+  /* user, schedule and home config files by their reset bit */
+  flag &= gdo_fs_reset_files(GDO_FS_INIT_TYPE);
+  return flag && createFileIfNotExist();
+}
 
-  if (GDO_FS_INIT_TYPE & GDO_FS_USER_INFO) {
-    /*neu file da ton tai*/
-    flag = gdo_fs_create_file(GDO_USER_INFOR_FULL_PATH, GDO_MAX_USER_SUPORT * sizeof(gdo_user_infor));
-  }
+bool gdo_file_system_init()
+{
+  uint32_t start = k_cycle_get_32();
 
-  if (GDO_FS_INIT_TYPE & GDO_FS_SCHEDULE) {
-    flag = gdo_fs_create_file(SCHEDULE_CURRENT_FILE_FULL_PATH, SCHEDULE_NUM * sizeof(struct schedule_data)) &&
-           gdo_fs_create_file(SCHEDULE_BACKUP_FILE_FULL_PATH, SCHEDULE_NUM * sizeof(struct schedule_data));
+  if (gdo_fs_backend_mount_all() != 0) {
+    LOG_ERR("FS-INIT: storage backend");
+    return false;
   }
-
-  if (GDO_FS_INIT_TYPE & GDO_FS_HOME_CFG) {
-    flag = gdo_fs_create_file(HOME_CFG_FILE_FULL_PATH, HOME_CFG_FILE_SIZE);
+  if (!gdo_file_system_prepare()) {
+    return false;
   }
-  return flag && createFileIfNotExist();
+  if (gdo_fs_async_init() != 0) {
+    LOG_ERR("FS-INIT: storage queue");
+    return false;
+  }
+  if (gdo_event_log_init() != 0) {
+    LOG_ERR("FS-INIT: event log");
+    return false;
+  }
+  if (gdo_kv_init() != 0) {
+    LOG_ERR("FS-INIT: kv store");
+    return false;
+  }
+  if (gdo_schedule_store_init() != 0) {
+    LOG_ERR("FS-INIT: schedule store");
+    return false;
+  }
+  /* before the index build so the user records it reads are checked */
+  if (gdo_fs_integrity_init() != 0) {
+    LOG_ERR("FS-INIT: integrity");
+    return false;
+  }
+  if (gdo_user_bulk_recover() != 0) {
+    LOG_ERR("FS-INIT: user batch");
+    return false;
+  }
+  if (gdo_user_index_build() != 0) {
+    LOG_ERR("FS-INIT: user index");
+    return false;
+  }
+  fs_ready_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+  LOG_INF("FS ready in %u us", fs_ready_us);
+  return true;
 }
\ No newline at end of file
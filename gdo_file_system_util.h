@@ -7,6 +7,15 @@ extern "C" {
 
 #include <stddef.h>
 
+/**
+ * One segment of a batched record access: @p len bytes at byte offset @p index of the file.
+ */
+struct gdo_fs_iovec {
+  size_t index;
+  void *buff;
+  size_t len;
+};
+
 enum file_status {
   FILE_ERROR = 0x00,
   FILE_EXIST,
@@ -29,6 +38,9 @@ enum file_status {
  * @note The `file_name` parameter should not contain any directory separators ( "\","_").
  * @note The `base_path` parameter should be a valid base path in the file system where the file will be created.
  * @note The function may return false if there are permission issues or if the disk is full.
+ * @note Managed files (user, schedule, home config) are created empty with an extent map
+ *       (GDO_FS_SPARSE_FILES) and read as zeros up to @p size_file where nothing was written, so
+ *       a reset does not write the file.
  *
  */
 bool gdo_fs_create_file(const char *full_path_file, size_t size_file);
@@ -51,6 +63,8 @@ bool gdo_fs_create_file(const char *full_path_file, size_t size_file);
  * @note The `buff` parameter should point to a valid memory location containing the data to be written.
  * @note The `len` parameter should be the length of the data buffer in bytes.
  * @note The function may return -1 if there are permission issues, disk full, or if the file does not exist.
+ * @note A file listed in GDO_FS_COMPRESSED_FILES is appended as compressed frames, @p len is still
+ *       returned on success.
  */
 int gdo_fs_write_file(const char *disk, const char *full_path_file, void *buff, size_t len);
 
@@ -72,10 +86,25 @@ int gdo_fs_write_file(const char *disk, const char *full_path_file, void *buff,
  * @note The `buff` parameter should point to a valid memory location where the read data will be stored.
  * @note The `len` parameter should be the maximum number of bytes to read from the file.
  * @note The function may return -1 if there are permission issues, if the file does not exist, or if an error occurs during the read operation.
+ * @note A compressed file (GDO_FS_COMPRESSED_FILES) is decompressed from its start and may return
+ *       fewer than @p len bytes; it needs a window sized reader on the stack.
  *
  */
 int gdo_fs_read_file(const char *disk, const char *full_path_file, void *buff, size_t len);
 
+struct gdo_fs_lz_reader;
+
+/**
+ * @brief Reads a file front to back across calls, decompressing it if it is compressed.
+ *
+ * @param[in,out] reader  Cursor from gdo_fs_lz_reader_init() (gdo_fs_compress.h), kept between calls.
+ *
+ * @return Number of bytes read, 0 at the end of the file, or a negative value on error.
+ *
+ * @note The cursor is meaningless once the file was recreated.
+ */
+int gdo_fs_read_file_seq(const char *full_path_file, struct gdo_fs_lz_reader *reader, void *buff, size_t len);
+
 /**
  * @brief Writes data to a specific index within a file in the file system.
  *
@@ -90,6 +119,8 @@ int gdo_fs_read_file(const char *disk, const char *full_path_file, void *buff, s
  * @return An integer representing the number of bytes successfully written to the file at the specified index. 
  *         Returns -1 if an error occurs during the write operation.
  *
+ * @note The record is compared with the file first (GDO_FS_WRITE_COMPARE): unchanged data is not
+ *       written at all and otherwise only the changed byte range is, @p len is returned either way.
  */
 int gdo_fs_write_file_index(const char *disk, const char *full_path_file, void *buff, size_t len, size_t index);
 
@@ -107,8 +138,58 @@ int gdo_fs_write_file_index(const char *disk, const char *full_path_file, void *
  * @return An integer representing the number of bytes successfully read from the file at the specified index.
  *         Returns -1 if an error occurs during the read operation.
  *
+ * @note With GDO_FS_INTEGRITY, -1 is also returned when a record fully covered by the read fails
+ *       its CRC check; the scrubber then tries to repair it.
  */
 int gdo_fs_read_file_index(const char *disk, const char *full_path_file, void *buff, size_t len, size_t index);
+
+/**
+ * @brief gdo_fs_read_file_index() without the record CRC check (GDO_FS_INTEGRITY).
+ *
+ * For the integrity layer itself, which must see the bytes as stored to check or repair them.
+ *
+ * @return Number of bytes read, or -1 on error.
+ */
+int gdo_fs_read_file_index_raw(const char *full_path_file, void *buff, size_t len, size_t index);
+
+/**
+ * @brief Writes several segments of a file under one lock, one open and one sync.
+ *
+ * Use this instead of repeated gdo_fs_write_file_index calls for batch updates (full schedule rewrite,
+ * bulk user provisioning): the whole batch costs a single littlefs commit.
+ *
+ * @param[in] disk            The name of the disk where the file exists.
+ * @param[in] full_path_file  The full path of the file where the data will be written.
+ * @param[in] iov             Array of segments, applied in order.
+ * @param[in] iovcnt          Number of segments in @p iov.
+ *
+ * @return Total number of bytes written, or a negative value if any segment failed.
+ *         Segments written before the failure are committed.
+ */
+int gdo_fs_writev_index(const char *disk, const char *full_path_file, const struct gdo_fs_iovec *iov, size_t iovcnt);
+
+/**
+ * @brief Reads several segments of a file under one lock and one open.
+ *
+ * @param[in] disk            The name of the disk where the file exists.
+ * @param[in] full_path_file  The full path of the file from which data will be read.
+ * @param[in] iov             Array of segments to fill, each must be read completely.
+ * @param[in] iovcnt          Number of segments in @p iov.
+ *
+ * @return Total number of bytes read, or a negative value if any segment failed.
+ */
+int gdo_fs_readv_index(const char *disk, const char *full_path_file, const struct gdo_fs_iovec *iov, size_t iovcnt);
+
+/**
+ * @brief Narrows a segment about to be written to the bytes that differ from the file, the
+ *        comparison gdo_fs_write_file_index() does (GDO_FS_WRITE_COMPARE).
+ *
+ * The caller holds the file write lock, or otherwise keeps the file from changing until the write.
+ *
+ * @return 0 with @p iov narrowed (len 0 if nothing changed), or a negative error with @p iov as it was.
+ */
+int gdo_fs_iov_narrow(const char *full_path_file, struct gdo_fs_iovec *iov);
+
 /**
  * @brief Deletes all files within a specified directory in the file system.
  *
@@ -120,21 +201,155 @@ int gdo_fs_read_file_index(const char *disk, const char *full_path_file, void *b
  * @return An integer representing the number of files successfully deleted.
  *         Returns -1 if an error occurs during the deletion process.
  *
+ * @note Subdirectories are removed recursively. For the mount point itself the partition is
+ *       reformatted instead (GDO_FS_FAST_WIPE) and 0 is returned; when the format is not
+ *       possible or file locks stay held, the tree is walked instead.
  */
 int gdo_fs_delete_all_file(const char *disk, const char *path);
 
+enum gdo_fs_delete_flags {
+  GDO_FS_DELETE_ROOT      = 0x01, /* remove @p path itself too */
+  GDO_FS_DELETE_FAST_WIPE = 0x02, /* format instead when @p path is the mount point, walk if that fails */
+};
+
+/**
+ * Progress of gdo_fs_delete_tree(): @p path was just removed, @p removed entries so far.
+ * After a fast wipe it is called once with the mount point and 0.
+ */
+typedef void (*gdo_fs_delete_cb_t)(const char *path, uint32_t removed, void *user_data);
+
+/**
+ * @brief Removes everything below a directory, subdirectories included.
+ *
+ * Walks the tree with a bounded explicit stack (GDO_FS_DELETE_MAX_DEPTH levels) and never unlinks
+ * while a directory is open for listing. Each entry is removed under its file lock.
+ *
+ * @param[in] path      Directory to empty.
+ * @param[in] flags     Bitmask of gdo_fs_delete_flags.
+ * @param[in] cb        Progress callback, may be NULL.
+ * @param[in] user_data Passed to @p cb.
+ *
+ * @return Number of entries removed (0 after a fast wipe), or a negative error code.
+ *         Entries removed before an error stay removed.
+ */
+int gdo_fs_delete_tree(const char *path, uint8_t flags, gdo_fs_delete_cb_t cb, void *user_data);
+
+/**
+ * @brief Erases a sector-aligned region of the external flash.
+ *
+ * Cached data of the erased sectors is discarded, not written back. Goes through the same
+ * planner as gdo_flash_earse_region_ex().
+ */
 bool gdo_flash_earse_region(off_t region_offset, size_t sector_size);
 
+/**
+ * @brief Erases a sector aligned range, skipping sectors that are already blank.
+ *
+ * Dirty sectors are erased in the largest aligned blocks the part supports (32K/64K).
+ *
+ * @param[out] erased Bytes really erased, may be NULL.
+ */
+bool gdo_flash_earse_region_ex(off_t region_offset, size_t size, size_t *erased);
+
+/**
+ * @brief Resets a file of the registry (gdo_fs_files.h) by its reset policy, see gdo_fs_reset_file().
+ *
+ * @return true on success, also for a file outside the registry, which is left alone.
+ */
 bool gdo_fs_delete_file(const char *disk, const char *full_path_file);
 
+/**
+ * @brief Removes a file for good, under its file lock. A registry file comes back at the next
+ *        createFileIfNotExist(), use gdo_fs_delete_file() to reset one instead.
+ *
+ * @return 0 on success, or a negative error code (-ENOENT if the file does not exist).
+ */
+int gdo_fs_unlink(const char *full_path_file);
+
+/**
+ * @brief Returns the current size of a file, the logical size for a sparse one.
+ *
+ * @return Size in bytes, or a negative error code (-ENOENT if the file does not exist).
+ */
+int gdo_fs_file_size(const char *full_path_file);
+
+struct fs_statvfs;
+
+/**
+ * @brief Capacity and free blocks of the mount @p path is under, from its backend.
+ *
+ * @return 0 on success, or a negative error code (-ENOENT if no backend serves @p path).
+ */
+int gdo_fs_statvfs(const char *path, struct fs_statvfs *stat);
+
+/**
+ * @brief Checks whether a file exists, an open cached handle counts as existing.
+ *
+ * @return FILE_EXIST, FILE_NOT_EXIST, or FILE_ERROR if the file system could not be queried.
+ */
+uint8_t gdo_fs_file_exist(const char *full_path_file);
+
+/**
+ * @brief Atomically renames a file, replacing @p to_path if it exists.
+ *
+ * On littlefs the destination is either the old or the new file after a power loss, never a mix.
+ *
+ * @return 0 on success, or a negative error code.
+ */
+int gdo_fs_rename(const char *from_path, const char *to_path);
+
+/**
+ * @brief Commits every pending write held by the open handle cache.
+ *
+ * The record accessors keep recently used files open. Writes are synced immediately unless
+ * GDO_FS_HANDLE_CACHE_WRITE_THROUGH is 0, in which case this must be called at safe points.
+ *
+ * @return 0 on success, or the first negative error code returned by fs_sync.
+ */
+int gdo_fs_cache_flush(void);
+
+/**
+ * @brief Syncs and closes every cached file handle, e.g. before unmounting the file system.
+ *
+ * @return 0 on success, or the first negative error code returned by fs_sync/fs_close.
+ */
+int gdo_fs_cache_close_all(void);
+
 // int lsdir(const char *disk, const char *path);
 
+/**
+ * @brief Updates bytes of the external flash at any offset and length.
+ *
+ * The data goes into a write-back sector cache (read-modify-write), so callers no longer erase
+ * before writing. It reaches the flash when the sector is evicted or on gdo_flash_flush().
+ */
 bool gdo_flash_write_offset(off_t region_offset, uint8_t *buff_write, size_t len);
 
+/**
+ * @brief Reads bytes of the external flash, pending cached writes included.
+ */
 bool gdo_flash_read_offset(off_t region_offset, uint8_t *buff_read, size_t len);
 
+/**
+ * @brief Writes every dirty cached sector to the flash, erasing a sector only when needed.
+ */
+bool gdo_flash_flush(void);
+
+/**
+ * @brief Creates the missing managed files and resizes the ones with a wrong size.
+ *
+ * Driven by one listing of GDO_DISK_MOUNT_PT; existing files of the right size are not opened.
+ * A single file user table is first moved to the split layout (GDO_USER_STORE_SPLIT).
+ */
+bool createFileIfNotExist();
+
 bool gdo_file_system_init();
 
+/**
+ * @brief Time gdo_file_system_init() took on this boot, in us (0 before it returned true).
+ */
+uint32_t gdo_fs_init_time_us(void);
+
 void gdo_littlefs_test(); 
 #ifdef __cplusplus
 }
@@ -0,0 +1,358 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_flash_cache.h"
+#include "gdo_fs_stats.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+struct flash_cache_line {
+  off_t base;
+  uint32_t last_use;
+  uint16_t dirty_lo; /* dirty byte range [dirty_lo, dirty_hi) inside the sector */
+  uint16_t dirty_hi;
+  bool valid;
+  bool needs_erase; /* a pending byte sets a bit that is 0 on the flash */
+  uint8_t data[GDO_FLASH_SECTOR_SIZE];
+};
+
+K_MUTEX_DEFINE(flashaccess);
+
+static struct flash_cache_line cache_lines[GDO_FLASH_CACHE_SECTORS];
+static uint32_t cache_clock;
+
+static const struct device *flash_cache_dev(void)
+{
+  const struct device *flash_dev = DEVICE_DT_GET(DT_ALIAS(spi_flash0));
+
+  if (!device_is_ready(flash_dev)) {
+    LOG_ERR("%s: device not ready.\n", flash_dev->name);
+    return NULL;
+  }
+  return flash_dev;
+}
+
+/* driver calls, counted here so the raw_* stats see real flash traffic and not cache hits */
+static int flash_cache_dev_read(const struct device *flash_dev, off_t offset, void *data, size_t len)
+{
+  uint32_t start = GDO_FS_STAT_START();
+  int rc         = flash_read(flash_dev, offset, data, len);
+
+  GDO_FS_STAT_END(GDO_FS_STAT_RAW_READ, start, rc, len);
+  return rc;
+}
+
+static int flash_cache_dev_program(const struct device *flash_dev, off_t offset, const void *data, size_t len)
+{
+  uint32_t start = GDO_FS_STAT_START();
+  int rc         = flash_write(flash_dev, offset, data, len);
+
+  GDO_FS_STAT_END(GDO_FS_STAT_RAW_PROGRAM, start, rc, len);
+  return rc;
+}
+
+static int flash_cache_dev_erase(const struct device *flash_dev, off_t offset, size_t size)
+{
+  uint32_t start = GDO_FS_STAT_START();
+  int rc         = flash_erase(flash_dev, offset, size);
+
+  GDO_FS_STAT_END(GDO_FS_STAT_RAW_ERASE, start, rc, size);
+  return rc;
+}
+
+static int flash_cache_line_flush(struct flash_cache_line *line)
+{
+  const struct device *flash_dev = flash_cache_dev();
+  size_t lo = line->dirty_lo;
+  size_t hi = line->dirty_hi;
+  int rc;
+
+  if (!line->valid || lo >= hi) {
+    return 0;
+  }
+  if (flash_dev == NULL) {
+    return -ENODEV;
+  }
+  if (line->needs_erase) {
+    rc = flash_cache_dev_erase(flash_dev, line->base, GDO_FLASH_SECTOR_SIZE);
+    if (rc != 0) {
+      LOG_ERR("Flash erase failed! %d\n", rc);
+      return rc;
+    }
+    /* the whole sector is blank now, program everything that is not erased state */
+    lo = 0;
+    hi = GDO_FLASH_SECTOR_SIZE;
+    while (lo < hi && line->data[lo] == 0xFF) {
+      lo++;
+    }
+    while (hi > lo && line->data[hi - 1] == 0xFF) {
+      hi--;
+    }
+  }
+  if (lo < hi) {
+    rc = flash_cache_dev_program(flash_dev, line->base + lo, &line->data[lo], hi - lo);
+    if (rc != 0) {
+      LOG_ERR("Flash write failed! %d\n", rc);
+      return rc;
+    }
+  }
+  line->dirty_lo    = GDO_FLASH_SECTOR_SIZE;
+  line->dirty_hi    = 0;
+  line->needs_erase = false;
+  return 0;
+}
+
+static struct flash_cache_line *flash_cache_find(off_t base)
+{
+  for (int i = 0; i < GDO_FLASH_CACHE_SECTORS; i++) {
+    if (cache_lines[i].valid && cache_lines[i].base == base) {
+      cache_lines[i].last_use = ++cache_clock;
+      return &cache_lines[i];
+    }
+  }
+  return NULL;
+}
+
+/* Get the line of a sector, evicting the LRU one. @p load is false when the caller overwrites all of it. */
+static struct flash_cache_line *flash_cache_alloc(off_t base, bool load, int *err)
+{
+  struct flash_cache_line *line = flash_cache_find(base);
+  const struct device *flash_dev;
+
+  *err = 0;
+  if (line != NULL) {
+    return line;
+  }
+  line = &cache_lines[0];
+  for (int i = 0; i < GDO_FLASH_CACHE_SECTORS; i++) {
+    if (!cache_lines[i].valid) {
+      line = &cache_lines[i];
+      break;
+    }
+    if (cache_lines[i].last_use < line->last_use) {
+      line = &cache_lines[i];
+    }
+  }
+  *err = flash_cache_line_flush(line);
+  if (*err != 0) {
+    return NULL;
+  }
+  line->valid = false;
+  if (load) {
+    flash_dev = flash_cache_dev();
+    if (flash_dev == NULL) {
+      *err = -ENODEV;
+      return NULL;
+    }
+    *err = flash_cache_dev_read(flash_dev, base, line->data, GDO_FLASH_SECTOR_SIZE);
+    if (*err != 0) {
+      LOG_ERR("Flash read failed! %d", *err);
+      return NULL;
+    }
+  } else {
+    memset(line->data, 0xFF, GDO_FLASH_SECTOR_SIZE);
+  }
+  line->base        = base;
+  line->valid       = true;
+  /* without loading, the flash content is unknown and the flush has to erase */
+  line->needs_erase = !load;
+  line->dirty_lo    = GDO_FLASH_SECTOR_SIZE;
+  line->dirty_hi    = 0;
+  line->last_use    = ++cache_clock;
+  return line;
+}
+
+int gdo_flash_cache_read(off_t offset, void *buff, size_t len)
+{
+  uint8_t *out = buff;
+  int rc       = 0;
+
+  k_mutex_lock(&flashaccess, K_FOREVER);
+  while (len > 0 && rc == 0) {
+    off_t base   = ROUND_DOWN(offset, GDO_FLASH_SECTOR_SIZE);
+    size_t start = offset - base;
+    size_t chunk = MIN(len, GDO_FLASH_SECTOR_SIZE - start);
+    struct flash_cache_line *line = flash_cache_find(base);
+
+    if (line != NULL) {
+      memcpy(out, &line->data[start], chunk);
+    } else {
+      const struct device *flash_dev = flash_cache_dev();
+      rc = (flash_dev == NULL) ? -ENODEV : flash_cache_dev_read(flash_dev, offset, out, chunk);
+    }
+    offset += chunk;
+    out += chunk;
+    len -= chunk;
+  }
+  k_mutex_unlock(&flashaccess);
+  return rc;
+}
+
+int gdo_flash_cache_write(off_t offset, const void *buff, size_t len)
+{
+  const uint8_t *in = buff;
+  int rc            = 0;
+
+  k_mutex_lock(&flashaccess, K_FOREVER);
+  while (len > 0) {
+    off_t base   = ROUND_DOWN(offset, GDO_FLASH_SECTOR_SIZE);
+    size_t start = offset - base;
+    size_t chunk = MIN(len, GDO_FLASH_SECTOR_SIZE - start);
+    struct flash_cache_line *line = flash_cache_alloc(base, chunk != GDO_FLASH_SECTOR_SIZE, &rc);
+
+    if (line == NULL) {
+      break;
+    }
+    for (size_t i = 0; i < chunk && !line->needs_erase; i++) {
+      if ((line->data[start + i] & in[i]) != in[i]) {
+        line->needs_erase = true;
+      }
+    }
+    memcpy(&line->data[start], in, chunk);
+    line->dirty_lo = MIN(line->dirty_lo, start);
+    line->dirty_hi = MAX(line->dirty_hi, start + chunk);
+    offset += chunk;
+    in += chunk;
+    len -= chunk;
+  }
+  k_mutex_unlock(&flashaccess);
+  return rc;
+}
+
+static uint8_t blank_buf[GDO_FLASH_BLANK_CHECK_CHUNK];
+
+/* A read error counts as not blank, the sector is simply erased */
+static bool flash_cache_sector_blank(const struct device *flash_dev, off_t base)
+{
+  for (size_t pos = 0; pos < GDO_FLASH_SECTOR_SIZE; pos += sizeof(blank_buf)) {
+    if (flash_cache_dev_read(flash_dev, base + pos, blank_buf, sizeof(blank_buf)) != 0) {
+      return false;
+    }
+    for (size_t i = 0; i < sizeof(blank_buf); i++) {
+      if (blank_buf[i] != 0xFF) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/*
+ * Erases the dirty sectors (bit i of @p dirty = sector i) of an aligned block of @p size:
+ * in one go when enough of them are dirty, else split into the next smaller erase unit.
+ */
+static int flash_cache_erase_block(const struct device *flash_dev, off_t base, size_t size, uint32_t dirty,
+                                   size_t *erased)
+{
+  size_t sectors = size / GDO_FLASH_SECTOR_SIZE;
+  size_t next;
+  int rc = 0;
+
+  if (dirty == 0) {
+    return 0;
+  }
+  if (size == GDO_FLASH_SECTOR_SIZE ||
+      (size_t) __builtin_popcount(dirty) * 100 >= sectors * GDO_FLASH_ERASE_MERGE_PERCENT) {
+    rc = flash_cache_dev_erase(flash_dev, base, size);
+    if (rc == 0) {
+      *erased += size;
+    }
+    return rc;
+  }
+  next = (size > GDO_FLASH_ERASE_BLOCK_SMALL && GDO_FLASH_ERASE_BLOCK_SMALL != 0) ? GDO_FLASH_ERASE_BLOCK_SMALL
+                                                                                   : GDO_FLASH_SECTOR_SIZE;
+  size_t per = next / GDO_FLASH_SECTOR_SIZE;
+  for (size_t i = 0; i < sectors && rc == 0; i += per) {
+    rc = flash_cache_erase_block(flash_dev, base + i * GDO_FLASH_SECTOR_SIZE, next, (dirty >> i) & BIT_MASK(per),
+                                 erased);
+  }
+  return rc;
+}
+
+int gdo_flash_cache_erase_ex(off_t offset, size_t size, size_t *erased)
+{
+  const struct device *flash_dev = flash_cache_dev();
+  off_t end                      = offset + (off_t) size;
+  size_t done                    = 0;
+  int rc                         = 0;
+
+  if (flash_dev == NULL) {
+    return -ENODEV;
+  }
+  if (offset % GDO_FLASH_SECTOR_SIZE != 0 || size % GDO_FLASH_SECTOR_SIZE != 0) {
+    LOG_ERR("Flash erase %lx+%x not sector aligned\n", (long) offset, size);
+    return -EINVAL;
+  }
+  k_mutex_lock(&flashaccess, K_FOREVER);
+  /* pending data inside the erased range is dropped, not written first */
+  for (int i = 0; i < GDO_FLASH_CACHE_SECTORS; i++) {
+    struct flash_cache_line *line = &cache_lines[i];
+
+    if (line->valid && line->base + GDO_FLASH_SECTOR_SIZE > offset && line->base < end) {
+      line->valid    = false;
+      line->dirty_lo = GDO_FLASH_SECTOR_SIZE;
+      line->dirty_hi = 0;
+    }
+  }
+  for (off_t pos = offset; pos < end && rc == 0;) {
+    size_t block = GDO_FLASH_SECTOR_SIZE;
+    uint32_t dirty = 0;
+
+    if (GDO_FLASH_ERASE_BLOCK_LARGE != 0 && pos % GDO_FLASH_ERASE_BLOCK_LARGE == 0 &&
+        end - pos >= GDO_FLASH_ERASE_BLOCK_LARGE) {
+      block = GDO_FLASH_ERASE_BLOCK_LARGE;
+    } else if (GDO_FLASH_ERASE_BLOCK_SMALL != 0 && pos % GDO_FLASH_ERASE_BLOCK_SMALL == 0 &&
+               end - pos >= GDO_FLASH_ERASE_BLOCK_SMALL) {
+      block = GDO_FLASH_ERASE_BLOCK_SMALL;
+    }
+    for (size_t i = 0; i < block / GDO_FLASH_SECTOR_SIZE; i++) {
+      if (!flash_cache_sector_blank(flash_dev, pos + i * GDO_FLASH_SECTOR_SIZE)) {
+        dirty |= BIT(i);
+      }
+    }
+    rc = flash_cache_erase_block(flash_dev, pos, block, dirty, &done);
+    pos += block;
+  }
+  if (rc != 0) {
+    LOG_ERR("Flash erase failed! %d\n", rc);
+  }
+  k_mutex_unlock(&flashaccess);
+  if (erased != NULL) {
+    *erased = done;
+  }
+  return rc;
+}
+
+int gdo_flash_cache_erase(off_t offset, size_t size)
+{
+  return gdo_flash_cache_erase_ex(offset, size, NULL);
+}
+
+int gdo_flash_cache_flush(void)
+{
+  int res = 0;
+
+  k_mutex_lock(&flashaccess, K_FOREVER);
+  for (int i = 0; i < GDO_FLASH_CACHE_SECTORS; i++) {
+    int rc = flash_cache_line_flush(&cache_lines[i]);
+    res    = (res != 0) ? res : rc;
+  }
+  k_mutex_unlock(&flashaccess);
+  return res;
+}
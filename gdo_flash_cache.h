@@ -0,0 +1,100 @@
+#ifndef _GDO_FLASH_CACHE_H_
+#define _GDO_FLASH_CACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Erase unit of the external SPI NOR, also the cache line size */
+#ifndef GDO_FLASH_SECTOR_SIZE
+#ifdef CONFIG_SPI_NOR_FLASH_LAYOUT_PAGE_SIZE
+#define GDO_FLASH_SECTOR_SIZE CONFIG_SPI_NOR_FLASH_LAYOUT_PAGE_SIZE
+#else
+#define GDO_FLASH_SECTOR_SIZE 4096
+#endif
+#endif
+
+/*
+ * Raw regions of the external_flash partition (outside littlefs), sector aligned.
+ * Override in gdo_config.h when the partition layout changes.
+ */
+#ifndef GDO_EXT_FLASH_BASE
+#if defined(CONFIG_PARTITION_MANAGER_ENABLED)
+#include <pm_config.h>
+#define GDO_EXT_FLASH_BASE PM_EXTERNAL_FLASH_ADDRESS
+#else
+#define GDO_EXT_FLASH_BASE GDO_BUILD_TIME_OFFSET
+#endif
+#endif
+
+#ifndef GDO_EVENT_LOG_REGION_OFFSET
+#define GDO_EVENT_LOG_REGION_OFFSET (GDO_EXT_FLASH_BASE + 0x10000)
+#endif
+#ifndef GDO_EVENT_LOG_REGION_SIZE
+#define GDO_EVENT_LOG_REGION_SIZE 0x40000
+#endif
+
+#ifndef GDO_KV_REGION_OFFSET
+#define GDO_KV_REGION_OFFSET (GDO_EVENT_LOG_REGION_OFFSET + GDO_EVENT_LOG_REGION_SIZE)
+#endif
+#ifndef GDO_KV_REGION_SIZE
+#define GDO_KV_REGION_SIZE (4 * GDO_FLASH_SECTOR_SIZE)
+#endif
+
+/* Number of sectors held in RAM, GDO_FLASH_SECTOR_SIZE bytes each */
+#ifndef GDO_FLASH_CACHE_SECTORS
+#define GDO_FLASH_CACHE_SECTORS 2
+#endif
+
+/*
+ * Block erase sizes of the part (MX25R64 / W25Q16JV: 32K and 64K). An aligned run of dirty
+ * sectors is erased with the largest block that fits; set a size to 0 if the part lacks it.
+ */
+#ifndef GDO_FLASH_ERASE_BLOCK_LARGE
+#define GDO_FLASH_ERASE_BLOCK_LARGE 0x10000
+#endif
+#ifndef GDO_FLASH_ERASE_BLOCK_SMALL
+#define GDO_FLASH_ERASE_BLOCK_SMALL 0x8000
+#endif
+
+/* A block is erased whole once at least this share (%) of its sectors is not blank */
+#ifndef GDO_FLASH_ERASE_MERGE_PERCENT
+#define GDO_FLASH_ERASE_MERGE_PERCENT 50
+#endif
+
+/* Read size of the blank check done before erasing a sector */
+#ifndef GDO_FLASH_BLANK_CHECK_CHUNK
+#define GDO_FLASH_BLANK_CHECK_CHUNK 256
+#endif
+
+/*
+ * Sector write-back cache behind the gdo_flash_*_offset API.
+ *
+ * Writes are read-modify-write into a cached sector and reach the flash on eviction or
+ * gdo_flash_cache_flush(). At flush a sector is only erased when some bit has to go from 0
+ * to 1, otherwise just the dirty byte range is programmed. Reads are served from cached
+ * sectors and go straight to the flash otherwise; a miss does not allocate, so one-off
+ * reads never pay for a full sector transfer.
+ *
+ * All functions return 0 on success or a negative errno.
+ */
+int gdo_flash_cache_read(off_t offset, void *buff, size_t len);
+int gdo_flash_cache_write(off_t offset, const void *buff, size_t len);
+int gdo_flash_cache_erase(off_t offset, size_t size);
+
+/*
+ * Erase planner behind gdo_flash_cache_erase(). Sectors that already read as blank are
+ * skipped and the rest is erased in the largest aligned blocks the part supports.
+ * @p erased (may be NULL) receives the bytes really erased.
+ */
+int gdo_flash_cache_erase_ex(off_t offset, size_t size, size_t *erased);
+int gdo_flash_cache_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,331 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_file_system_util.h"
+#include "gdo_fs_async.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+enum gdo_fs_req_op {
+  GDO_FS_REQ_READ_INDEX = 0x00,
+  GDO_FS_REQ_WRITE_INDEX,
+  GDO_FS_REQ_READV_INDEX,
+  GDO_FS_REQ_WRITEV_INDEX,
+  GDO_FS_REQ_APPEND,
+  GDO_FS_REQ_CREATE_FILE,
+  GDO_FS_REQ_DELETE_FILE,
+  GDO_FS_REQ_DELETE_ALL_FILE,
+  GDO_FS_REQ_FLASH_ERASE,
+};
+
+enum gdo_fs_req_state {
+  GDO_FS_REQ_PENDING = 0x00,
+  GDO_FS_REQ_RUNNING,
+  GDO_FS_REQ_CANCELLED,
+  GDO_FS_REQ_DONE,
+};
+
+struct gdo_fs_req {
+  struct k_work work;
+  struct k_poll_signal signal;
+  struct k_sem done;
+  gdo_fs_req_cb_t cb;
+  void *user_data;
+  void *buff;
+  const struct gdo_fs_iovec *iov;
+  size_t len; /* bytes, file size or iov count */
+  size_t index; /* byte offset in the file or on the flash */
+  int result;
+  uint8_t op;
+  uint8_t state;
+  char path[GDO_FS_MAX_PATH_LEN];
+};
+
+K_MEM_SLAB_DEFINE_STATIC(req_slab, sizeof(struct gdo_fs_req), GDO_FS_ASYNC_REQ_NUM, __alignof__(struct gdo_fs_req));
+K_THREAD_STACK_DEFINE(storage_stack, GDO_FS_ASYNC_STACK_SIZE);
+
+static struct k_work_q storage_q;
+static struct k_spinlock req_lock;
+static bool storage_q_started;
+
+static int req_execute(struct gdo_fs_req *req)
+{
+  switch (req->op) {
+    case GDO_FS_REQ_READ_INDEX:
+      return gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, req->path, req->buff, req->len, req->index);
+    case GDO_FS_REQ_WRITE_INDEX:
+      return gdo_fs_write_file_index(GDO_DISK_MOUNT_PT, req->path, req->buff, req->len, req->index);
+    case GDO_FS_REQ_READV_INDEX:
+      return gdo_fs_readv_index(GDO_DISK_MOUNT_PT, req->path, req->iov, req->len);
+    case GDO_FS_REQ_WRITEV_INDEX:
+      return gdo_fs_writev_index(GDO_DISK_MOUNT_PT, req->path, req->iov, req->len);
+    case GDO_FS_REQ_APPEND:
+      return gdo_fs_write_file(GDO_DISK_MOUNT_PT, req->path, req->buff, req->len);
+    case GDO_FS_REQ_CREATE_FILE:
+      return gdo_fs_create_file(req->path, req->len) ? 0 : -EIO;
+    case GDO_FS_REQ_DELETE_FILE:
+      return gdo_fs_delete_file(GDO_DISK_MOUNT_PT, req->path) ? 0 : -EIO;
+    case GDO_FS_REQ_DELETE_ALL_FILE:
+      return gdo_fs_delete_all_file(GDO_DISK_MOUNT_PT, req->path);
+    case GDO_FS_REQ_FLASH_ERASE:
+      return gdo_flash_earse_region(req->index, req->len) ? 0 : -EIO;
+    default:
+      return -EINVAL;
+  }
+}
+
+static void req_complete(struct gdo_fs_req *req, int result)
+{
+  req->result = result;
+  if (req->cb != NULL) {
+    /* the request stays allocated, the callback may release it; not touched afterwards */
+    req->cb(req, result, req->user_data);
+    return;
+  }
+  k_poll_signal_raise(&req->signal, result);
+  k_sem_give(&req->done);
+}
+
+static void req_handler(struct k_work *work)
+{
+  struct gdo_fs_req *req = CONTAINER_OF(work, struct gdo_fs_req, work);
+  k_spinlock_key_t key   = k_spin_lock(&req_lock);
+
+  if (req->state == GDO_FS_REQ_CANCELLED) {
+    /* cancelled after the queue picked it up, gdo_fs_req_cancel left the completion to us */
+    k_spin_unlock(&req_lock, key);
+    req_complete(req, -ECANCELED);
+    return;
+  }
+  req->state = GDO_FS_REQ_RUNNING;
+  k_spin_unlock(&req_lock, key);
+
+  int result = req_execute(req);
+
+  key        = k_spin_lock(&req_lock);
+  req->state = GDO_FS_REQ_DONE;
+  k_spin_unlock(&req_lock, key);
+  req_complete(req, result);
+}
+
+static struct gdo_fs_req *req_alloc(uint8_t op, const char *full_path_file, gdo_fs_req_cb_t cb, void *user_data)
+{
+  struct gdo_fs_req *req;
+
+  if (!storage_q_started) {
+    LOG_ERR("FS-ASYNC: queue not started");
+    return NULL;
+  }
+  if (full_path_file != NULL && GDO_FS_MAX_PATH_LEN <= strlen(full_path_file)) {
+    LOG_ERR("FS-ASYNC: file path too long");
+    return NULL;
+  }
+  if (k_mem_slab_alloc(&req_slab, (void **) &req, K_NO_WAIT) != 0) {
+    LOG_ERR("FS-ASYNC: request pool exhausted");
+    return NULL;
+  }
+  memset(req, 0, sizeof(*req));
+  k_work_init(&req->work, req_handler);
+  k_poll_signal_init(&req->signal);
+  k_sem_init(&req->done, 0, 1);
+  req->op        = op;
+  req->cb        = cb;
+  req->user_data = user_data;
+  req->state     = GDO_FS_REQ_PENDING;
+  if (full_path_file != NULL) {
+    strcpy(req->path, full_path_file);
+  }
+  return req;
+}
+
+static struct gdo_fs_req *req_submit(struct gdo_fs_req *req)
+{
+  if (k_work_submit_to_queue(&storage_q, &req->work) < 0) {
+    LOG_ERR("FS-ASYNC: submit failed");
+    k_mem_slab_free(&req_slab, req);
+    return NULL;
+  }
+  return req;
+}
+
+int gdo_fs_async_init(void)
+{
+  static const struct k_work_queue_config cfg = {
+      .name = "gdo_storage",
+  };
+
+  if (storage_q_started) {
+    return 0;
+  }
+  k_work_queue_init(&storage_q);
+  k_work_queue_start(&storage_q, storage_stack, K_THREAD_STACK_SIZEOF(storage_stack), GDO_FS_ASYNC_PRIORITY, &cfg);
+  storage_q_started = true;
+  return 0;
+}
+
+int gdo_fs_async_schedule(struct k_work_delayable *work, k_timeout_t delay)
+{
+  if (!storage_q_started) {
+    return -ENODEV;
+  }
+  return k_work_reschedule_for_queue(&storage_q, work, delay);
+}
+
+struct gdo_fs_req *gdo_fs_submit_read_index(const char *full_path_file, void *buff, size_t len, size_t index,
+                                            gdo_fs_req_cb_t cb, void *user_data)
+{
+  struct gdo_fs_req *req = req_alloc(GDO_FS_REQ_READ_INDEX, full_path_file, cb, user_data);
+
+  if (req == NULL) {
+    return NULL;
+  }
+  req->buff  = buff;
+  req->len   = len;
+  req->index = index;
+  return req_submit(req);
+}
+
+struct gdo_fs_req *gdo_fs_submit_write_index(const char *full_path_file, const void *buff, size_t len, size_t index,
+                                             gdo_fs_req_cb_t cb, void *user_data)
+{
+  struct gdo_fs_req *req = req_alloc(GDO_FS_REQ_WRITE_INDEX, full_path_file, cb, user_data);
+
+  if (req == NULL) {
+    return NULL;
+  }
+  req->buff  = (void *) buff;
+  req->len   = len;
+  req->index = index;
+  return req_submit(req);
+}
+
+struct gdo_fs_req *gdo_fs_submit_readv_index(const char *full_path_file, const struct gdo_fs_iovec *iov, size_t iovcnt,
+                                             gdo_fs_req_cb_t cb, void *user_data)
+{
+  struct gdo_fs_req *req = req_alloc(GDO_FS_REQ_READV_INDEX, full_path_file, cb, user_data);
+
+  if (req == NULL) {
+    return NULL;
+  }
+  req->iov = iov;
+  req->len = iovcnt;
+  return req_submit(req);
+}
+
+struct gdo_fs_req *gdo_fs_submit_writev_index(const char *full_path_file, const struct gdo_fs_iovec *iov, size_t iovcnt,
+                                              gdo_fs_req_cb_t cb, void *user_data)
+{
+  struct gdo_fs_req *req = req_alloc(GDO_FS_REQ_WRITEV_INDEX, full_path_file, cb, user_data);
+
+  if (req == NULL) {
+    return NULL;
+  }
+  req->iov = iov;
+  req->len = iovcnt;
+  return req_submit(req);
+}
+
+struct gdo_fs_req *gdo_fs_submit_append(const char *full_path_file, const void *buff, size_t len,
+                                        gdo_fs_req_cb_t cb, void *user_data)
+{
+  struct gdo_fs_req *req = req_alloc(GDO_FS_REQ_APPEND, full_path_file, cb, user_data);
+
+  if (req == NULL) {
+    return NULL;
+  }
+  req->buff = (void *) buff;
+  req->len  = len;
+  return req_submit(req);
+}
+
+struct gdo_fs_req *gdo_fs_submit_create_file(const char *full_path_file, size_t size_file,
+                                             gdo_fs_req_cb_t cb, void *user_data)
+{
+  struct gdo_fs_req *req = req_alloc(GDO_FS_REQ_CREATE_FILE, full_path_file, cb, user_data);
+
+  if (req == NULL) {
+    return NULL;
+  }
+  req->len = size_file;
+  return req_submit(req);
+}
+
+struct gdo_fs_req *gdo_fs_submit_delete_file(const char *full_path_file, gdo_fs_req_cb_t cb, void *user_data)
+{
+  struct gdo_fs_req *req = req_alloc(GDO_FS_REQ_DELETE_FILE, full_path_file, cb, user_data);
+
+  return (req == NULL) ? NULL : req_submit(req);
+}
+
+struct gdo_fs_req *gdo_fs_submit_delete_all_file(const char *path, gdo_fs_req_cb_t cb, void *user_data)
+{
+  struct gdo_fs_req *req = req_alloc(GDO_FS_REQ_DELETE_ALL_FILE, path, cb, user_data);
+
+  return (req == NULL) ? NULL : req_submit(req);
+}
+
+struct gdo_fs_req *gdo_fs_submit_flash_erase(off_t region_offset, size_t size, gdo_fs_req_cb_t cb, void *user_data)
+{
+  struct gdo_fs_req *req = req_alloc(GDO_FS_REQ_FLASH_ERASE, NULL, cb, user_data);
+
+  if (req == NULL) {
+    return NULL;
+  }
+  req->index = region_offset;
+  req->len   = size;
+  return req_submit(req);
+}
+
+int gdo_fs_req_cancel(struct gdo_fs_req *req)
+{
+  k_spinlock_key_t key = k_spin_lock(&req_lock);
+
+  if (req->state != GDO_FS_REQ_PENDING) {
+    k_spin_unlock(&req_lock, key);
+    return -EBUSY;
+  }
+  req->state = GDO_FS_REQ_CANCELLED;
+  /* under req_lock so the handler cannot start in between; a busy work item already left
+   * the queue and its handler completes the request when it sees the cancelled state */
+  bool pending = k_work_cancel(&req->work) == 0;
+  k_spin_unlock(&req_lock, key);
+
+  if (pending) {
+    req_complete(req, -ECANCELED);
+  }
+  return 0;
+}
+
+struct k_poll_signal *gdo_fs_req_signal(struct gdo_fs_req *req)
+{
+  return &req->signal;
+}
+
+int gdo_fs_req_wait(struct gdo_fs_req *req, k_timeout_t timeout)
+{
+  if (k_sem_take(&req->done, timeout) != 0) {
+    return -EAGAIN;
+  }
+  int result = req->result;
+
+  k_mem_slab_free(&req_slab, req);
+  return result;
+}
+
+void gdo_fs_req_release(struct gdo_fs_req *req)
+{
+  k_mem_slab_free(&req_slab, req);
+}
@@ -0,0 +1,112 @@
+#ifndef _GDO_FS_ASYNC_H_
+#define _GDO_FS_ASYNC_H_
+
+#include <zephyr/kernel.h>
+#include <stddef.h>
+#include "gdo_file_system_util.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Number of requests that can be in flight at the same time */
+#ifndef GDO_FS_ASYNC_REQ_NUM
+#define GDO_FS_ASYNC_REQ_NUM 8
+#endif
+
+#ifndef GDO_FS_ASYNC_STACK_SIZE
+#define GDO_FS_ASYNC_STACK_SIZE 2048
+#endif
+
+/* Below the BLE/Matter/UART threads so flash work only uses their idle time */
+#ifndef GDO_FS_ASYNC_PRIORITY
+#define GDO_FS_ASYNC_PRIORITY K_LOWEST_APPLICATION_THREAD_PRIO
+#endif
+
+struct gdo_fs_req;
+
+/**
+ * Completion callback, runs on the storage thread.
+ *
+ * @param req       The finished request, still owned by the caller: release it with
+ *                  gdo_fs_req_release(), here or later.
+ * @param result    Return value of the matching synchronous gdo_fs_* call, -ECANCELED if cancelled.
+ * @param user_data Pointer given at submission.
+ */
+typedef void (*gdo_fs_req_cb_t)(struct gdo_fs_req *req, int result, void *user_data);
+
+/**
+ * @brief Start the storage work queue. Called by gdo_file_system_init.
+ *
+ * @return 0 on success.
+ */
+int gdo_fs_async_init(void);
+
+/**
+ * @brief (Re)schedule background work on the storage thread, behind the queued requests.
+ *
+ * For housekeeping that must stay out of the way of foreground flash access.
+ *
+ * @return As k_work_reschedule_for_queue(), -ENODEV before gdo_fs_async_init().
+ */
+int gdo_fs_async_schedule(struct k_work_delayable *work, k_timeout_t delay);
+
+/*
+ * Submission functions queue the operation on the storage thread and return immediately.
+ * Requests run in submission order. Buffers (and iov arrays) are not copied and must stay
+ * valid until completion.
+ *
+ * The caller owns the returned request until it gives it back, so the pointer cannot be
+ * reused behind its back. With a callback, call gdo_fs_req_release() once the callback has
+ * run (the callback itself may do it). With cb == NULL, wait for it with gdo_fs_req_wait(),
+ * or k_poll() on gdo_fs_req_signal() and then call gdo_fs_req_release().
+ *
+ * All return NULL when the request pool is exhausted or the queue is not started.
+ */
+struct gdo_fs_req *gdo_fs_submit_read_index(const char *full_path_file, void *buff, size_t len, size_t index,
+                                            gdo_fs_req_cb_t cb, void *user_data);
+struct gdo_fs_req *gdo_fs_submit_write_index(const char *full_path_file, const void *buff, size_t len, size_t index,
+                                             gdo_fs_req_cb_t cb, void *user_data);
+struct gdo_fs_req *gdo_fs_submit_readv_index(const char *full_path_file, const struct gdo_fs_iovec *iov, size_t iovcnt,
+                                             gdo_fs_req_cb_t cb, void *user_data);
+struct gdo_fs_req *gdo_fs_submit_writev_index(const char *full_path_file, const struct gdo_fs_iovec *iov, size_t iovcnt,
+                                              gdo_fs_req_cb_t cb, void *user_data);
+struct gdo_fs_req *gdo_fs_submit_append(const char *full_path_file, const void *buff, size_t len,
+                                        gdo_fs_req_cb_t cb, void *user_data);
+struct gdo_fs_req *gdo_fs_submit_create_file(const char *full_path_file, size_t size_file,
+                                             gdo_fs_req_cb_t cb, void *user_data);
+struct gdo_fs_req *gdo_fs_submit_delete_file(const char *full_path_file, gdo_fs_req_cb_t cb, void *user_data);
+struct gdo_fs_req *gdo_fs_submit_delete_all_file(const char *path, gdo_fs_req_cb_t cb, void *user_data);
+struct gdo_fs_req *gdo_fs_submit_flash_erase(off_t region_offset, size_t size, gdo_fs_req_cb_t cb, void *user_data);
+
+/**
+ * @brief Cancel a request that has not started yet.
+ *
+ * A cancelled request completes with -ECANCELED (callback or signal). Valid until the
+ * request is released.
+ *
+ * @return 0 if cancelled, -EBUSY if it is already running, finished or cancelled.
+ */
+int gdo_fs_req_cancel(struct gdo_fs_req *req);
+
+/**
+ * @brief Poll signal raised with the result when a request submitted without callback completes.
+ */
+struct k_poll_signal *gdo_fs_req_signal(struct gdo_fs_req *req);
+
+/**
+ * @brief Wait for a request submitted without callback and release it.
+ *
+ * @return The operation result, or -EAGAIN on timeout (the request is kept in that case).
+ */
+int gdo_fs_req_wait(struct gdo_fs_req *req, k_timeout_t timeout);
+
+/**
+ * @brief Return a completed request to the pool.
+ */
+void gdo_fs_req_release(struct gdo_fs_req *req);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_fs_backend.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+struct gdo_fs_backend_mount {
+  const char *mnt_point;
+  const struct gdo_fs_backend *backend;
+};
+
+/* Mount points and what stores them, a path goes to the mount point it is under */
+static const struct gdo_fs_backend_mount backend_mounts[] = {
+#if (GDO_FS_RAMDISK_FILES > 0)
+    {GDO_FS_RAMDISK_MOUNT_PT, &gdo_fs_backend_ram},
+#endif
+#if (GDO_FS_BACKEND_POSIX)
+    {GDO_DISK_MOUNT_PT, &gdo_fs_backend_posix},
+#else
+    {GDO_DISK_MOUNT_PT, &gdo_fs_backend_zephyr},
+#endif
+};
+
+const struct gdo_fs_backend *gdo_fs_backend_find(const char *path)
+{
+  for (size_t i = 0; i < ARRAY_SIZE(backend_mounts); i++) {
+    size_t len = strlen(backend_mounts[i].mnt_point);
+
+    if (strncmp(path, backend_mounts[i].mnt_point, len) == 0 && (path[len] == '/' || path[len] == 0)) {
+      return backend_mounts[i].backend;
+    }
+  }
+  return NULL;
+}
+
+int gdo_fs_backend_mount_all(void)
+{
+  int res = 0;
+
+  for (size_t i = 0; i < ARRAY_SIZE(backend_mounts); i++) {
+    const struct gdo_fs_backend_mount *m = &backend_mounts[i];
+
+    if (m->backend->mount == NULL) {
+      continue;
+    }
+    int rc = m->backend->mount(m->mnt_point);
+    if (rc != 0) {
+      LOG_ERR("FS-Backend: mount %s on %s err %d", m->mnt_point, m->backend->name, rc);
+      res = (res != 0) ? res : rc;
+    }
+  }
+  return res;
+}
@@ -0,0 +1,129 @@
+#ifndef _GDO_FS_BACKEND_H_
+#define _GDO_FS_BACKEND_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+/* Types and flags of the gdo_fs API only (FS_O_*, FS_SEEK_*, fs_dirent, fs_statvfs), no fs_* call */
+#include <zephyr/fs/fs.h>
+#include "gdo_config.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 1: GDO_DISK_MOUNT_PT is stored in files of the host under GDO_FS_POSIX_ROOT instead of
+ * littlefs, for native_sim and host builds (benchmarks, sanitizers, valgrind).
+ */
+#ifndef GDO_FS_BACKEND_POSIX
+#define GDO_FS_BACKEND_POSIX 0
+#endif
+
+#ifndef GDO_FS_POSIX_ROOT
+#define GDO_FS_POSIX_ROOT "gdo_fs"
+#endif
+
+/* What statvfs reports for GDO_FS_POSIX_ROOT, littlefs_storage of spyder_nrf52840 */
+#ifndef GDO_FS_POSIX_CAPACITY
+#define GDO_FS_POSIX_CAPACITY 0x80000
+#endif
+#ifndef GDO_FS_POSIX_BLOCK_SIZE
+#define GDO_FS_POSIX_BLOCK_SIZE 4096
+#endif
+
+/* Files of the RAM disk, 0 leaves it out */
+#ifndef GDO_FS_RAMDISK_FILES
+#define GDO_FS_RAMDISK_FILES 0
+#endif
+
+/* Capacity of one RAM disk file, allocated statically */
+#ifndef GDO_FS_RAMDISK_FILE_SIZE
+#define GDO_FS_RAMDISK_FILE_SIZE 1024
+#endif
+
+/* Volatile files live under this mount point, lost on reset */
+#ifndef GDO_FS_RAMDISK_MOUNT_PT
+#define GDO_FS_RAMDISK_MOUNT_PT "/ram"
+#endif
+
+struct gdo_fs_backend;
+
+/* An open file of any backend */
+struct gdo_fs_file {
+  const struct gdo_fs_backend *backend;
+  union {
+#if !(GDO_FS_BACKEND_POSIX)
+    struct fs_file_t zfs;
+#endif
+    int fd;
+    struct {
+      int16_t node;
+      uint16_t gen;
+      size_t pos;
+    } ram;
+  };
+};
+
+/* An open directory of any backend */
+struct gdo_fs_dir {
+  const struct gdo_fs_backend *backend;
+  union {
+#if !(GDO_FS_BACKEND_POSIX)
+    struct fs_dir_t zfs;
+#endif
+    void *host;
+    size_t next;
+  };
+};
+
+/*
+ * Storage under the gdo_fs_* API. Paths are full paths including the mount point, modes and
+ * whence values are the Zephyr FS_O_* and FS_SEEK_* ones, return values follow the fs_* calls
+ * (0 or a negative errno, byte counts for read and write). Every call is made with fileaccess
+ * held, so a backend needs no lock of its own. mount and format may be NULL. statvfs reports
+ * the capacity of the mount @p path is under.
+ */
+struct gdo_fs_backend {
+  const char *name;
+  int (*mount)(const char *mnt_point);
+  int (*format)(const char *mnt_point);
+  int (*open)(struct gdo_fs_file *file, const char *path, fs_mode_t flags);
+  int (*close)(struct gdo_fs_file *file);
+  ssize_t (*read)(struct gdo_fs_file *file, void *buff, size_t len);
+  ssize_t (*write)(struct gdo_fs_file *file, const void *buff, size_t len);
+  int (*seek)(struct gdo_fs_file *file, off_t offset, int whence);
+  int (*truncate)(struct gdo_fs_file *file, off_t length);
+  int (*sync)(struct gdo_fs_file *file);
+  int (*stat)(const char *path, struct fs_dirent *entry);
+  int (*statvfs)(const char *path, struct fs_statvfs *stat);
+  int (*unlink)(const char *path);
+  int (*rename)(const char *from, const char *to);
+  int (*opendir)(struct gdo_fs_dir *dir, const char *path);
+  int (*readdir)(struct gdo_fs_dir *dir, struct fs_dirent *entry);
+  int (*closedir)(struct gdo_fs_dir *dir);
+};
+
+#if (GDO_FS_BACKEND_POSIX)
+extern const struct gdo_fs_backend gdo_fs_backend_posix;
+#else
+extern const struct gdo_fs_backend gdo_fs_backend_zephyr;
+#endif
+extern const struct gdo_fs_backend gdo_fs_backend_ram;
+
+/**
+ * @brief Backend of the mount point @p path is under, or NULL.
+ */
+const struct gdo_fs_backend *gdo_fs_backend_find(const char *path);
+
+/**
+ * @brief Mount every backend, called once by gdo_file_system_init().
+ *
+ * @return 0 or the first error.
+ */
+int gdo_fs_backend_mount_all(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
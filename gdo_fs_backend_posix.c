@@ -0,0 +1,308 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include "gdo_config.h"
+#include "gdo_fs_backend.h"
+
+#if (GDO_FS_BACKEND_POSIX)
+
+#include <zephyr/fs/fs.h>
+#include <zephyr/sys/util.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/* Host files, a gdo path /lfs1/x is GDO_FS_POSIX_ROOT/lfs1/x */
+#define POSIX_PATH_MAX (sizeof(GDO_FS_POSIX_ROOT) + GDO_FS_MAX_PATH_LEN)
+
+static int posix_path(char *host, const char *path)
+{
+  if (snprintf(host, POSIX_PATH_MAX, "%s%s", GDO_FS_POSIX_ROOT, path) >= (int) POSIX_PATH_MAX) {
+    return -ENAMETOOLONG;
+  }
+  return 0;
+}
+
+static int posix_mkdir(const char *host)
+{
+  return (mkdir(host, 0755) == 0 || errno == EEXIST) ? 0 : -errno;
+}
+
+static int posix_mount(const char *mnt_point)
+{
+  char host[POSIX_PATH_MAX];
+  int res = posix_mkdir(GDO_FS_POSIX_ROOT);
+
+  if (res == 0) {
+    res = posix_path(host, mnt_point);
+  }
+  return (res == 0) ? posix_mkdir(host) : res;
+}
+
+/* Removes everything under @p host, depth first, the directory itself stays */
+static int posix_clear(char *host, size_t len)
+{
+  DIR *dir = opendir(host);
+  struct dirent *ent;
+  int res = 0;
+
+  if (dir == NULL) {
+    return -errno;
+  }
+  while (res == 0 && (ent = readdir(dir)) != NULL) {
+    struct stat st;
+
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+      continue;
+    }
+    if (snprintf(host + len, POSIX_PATH_MAX - len, "/%s", ent->d_name) >= (int) (POSIX_PATH_MAX - len)) {
+      res = -ENAMETOOLONG;
+    } else if (lstat(host, &st) != 0) {
+      res = -errno;
+    } else if (S_ISDIR(st.st_mode)) {
+      res = posix_clear(host, strlen(host));
+      if (res == 0 && rmdir(host) != 0) {
+        res = -errno;
+      }
+    } else if (unlink(host) != 0) {
+      res = -errno;
+    }
+    host[len] = 0;
+  }
+  closedir(dir);
+  return res;
+}
+
+static int posix_format(const char *mnt_point)
+{
+  char host[POSIX_PATH_MAX];
+  int res = posix_path(host, mnt_point);
+
+  return (res == 0) ? posix_clear(host, strlen(host)) : res;
+}
+
+static int posix_open(struct gdo_fs_file *file, const char *path, fs_mode_t flags)
+{
+  char host[POSIX_PATH_MAX];
+  int res = posix_path(host, path);
+
+  if (res != 0) {
+    return res;
+  }
+  file->fd = open(host, O_RDWR | ((flags & FS_O_CREATE) ? O_CREAT : 0) | ((flags & FS_O_APPEND) ? O_APPEND : 0),
+                  0644);
+  return (file->fd < 0) ? -errno : 0;
+}
+
+static int posix_close(struct gdo_fs_file *file)
+{
+  return (close(file->fd) == 0) ? 0 : -errno;
+}
+
+static ssize_t posix_read(struct gdo_fs_file *file, void *buff, size_t len)
+{
+  ssize_t res = read(file->fd, buff, len);
+
+  return (res < 0) ? -errno : res;
+}
+
+static ssize_t posix_write(struct gdo_fs_file *file, const void *buff, size_t len)
+{
+  ssize_t res = write(file->fd, buff, len);
+
+  return (res < 0) ? -errno : res;
+}
+
+static int posix_seek(struct gdo_fs_file *file, off_t offset, int whence)
+{
+  int host_whence = (whence == FS_SEEK_END) ? SEEK_END : (whence == FS_SEEK_CUR) ? SEEK_CUR : SEEK_SET;
+
+  return (lseek(file->fd, offset, host_whence) < 0) ? -errno : 0;
+}
+
+static int posix_truncate(struct gdo_fs_file *file, off_t length)
+{
+  return (ftruncate(file->fd, length) == 0) ? 0 : -errno;
+}
+
+static int posix_sync(struct gdo_fs_file *file)
+{
+  return (fsync(file->fd) == 0) ? 0 : -errno;
+}
+
+static int posix_stat(const char *path, struct fs_dirent *entry)
+{
+  char host[POSIX_PATH_MAX];
+  const char *name = strrchr(path, '/');
+  struct stat st;
+  int res = posix_path(host, path);
+
+  if (res != 0) {
+    return res;
+  }
+  if (stat(host, &st) != 0) {
+    return -errno;
+  }
+  entry->type = S_ISDIR(st.st_mode) ? FS_DIR_ENTRY_DIR : FS_DIR_ENTRY_FILE;
+  entry->size = S_ISDIR(st.st_mode) ? 0 : st.st_size;
+  snprintf(entry->name, sizeof(entry->name), "%s", (name != NULL) ? name + 1 : path);
+  return 0;
+}
+
+/* Blocks taken by the files under @p host, each file rounded up to whole blocks like littlefs */
+static int posix_used(char *host, size_t len, uint32_t *blocks)
+{
+  DIR *dir = opendir(host);
+  struct dirent *ent;
+  int res = 0;
+
+  if (dir == NULL) {
+    return -errno;
+  }
+  while (res == 0 && (ent = readdir(dir)) != NULL) {
+    struct stat st;
+
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+      continue;
+    }
+    if (snprintf(host + len, POSIX_PATH_MAX - len, "/%s", ent->d_name) >= (int) (POSIX_PATH_MAX - len)) {
+      res = -ENAMETOOLONG;
+    } else if (lstat(host, &st) != 0) {
+      res = -errno;
+    } else if (S_ISDIR(st.st_mode)) {
+      res = posix_used(host, strlen(host), blocks);
+    } else {
+      *blocks += DIV_ROUND_UP((uint64_t) st.st_size, GDO_FS_POSIX_BLOCK_SIZE);
+    }
+    host[len] = 0;
+  }
+  closedir(dir);
+  return res;
+}
+
+/*
+ * A fixed GDO_FS_POSIX_CAPACITY, not the host file system: the fill levels of the benchmark
+ * and the free space checks must see the partition the firmware has.
+ */
+static int posix_statvfs(const char *path, struct fs_statvfs *stat)
+{
+  char host[POSIX_PATH_MAX];
+  uint32_t total = GDO_FS_POSIX_CAPACITY / GDO_FS_POSIX_BLOCK_SIZE;
+  uint32_t used  = 0;
+  int res        = posix_path(host, path);
+
+  if (res == 0) {
+    res = posix_used(host, strlen(host), &used);
+  }
+  if (res != 0) {
+    return res;
+  }
+  stat->f_bsize  = GDO_FS_POSIX_BLOCK_SIZE;
+  stat->f_frsize = GDO_FS_POSIX_BLOCK_SIZE;
+  stat->f_blocks = total;
+  stat->f_bfree  = (used < total) ? total - used : 0;
+  return 0;
+}
+
+/* fs_unlink removes empty directories too */
+static int posix_unlink(const char *path)
+{
+  char host[POSIX_PATH_MAX];
+  int res = posix_path(host, path);
+
+  if (res != 0) {
+    return res;
+  }
+  return (remove(host) == 0) ? 0 : -errno;
+}
+
+static int posix_rename(const char *from, const char *to)
+{
+  char host_from[POSIX_PATH_MAX];
+  char host_to[POSIX_PATH_MAX];
+  int res = posix_path(host_from, from);
+
+  if (res == 0) {
+    res = posix_path(host_to, to);
+  }
+  if (res != 0) {
+    return res;
+  }
+  return (rename(host_from, host_to) == 0) ? 0 : -errno;
+}
+
+static int posix_opendir(struct gdo_fs_dir *dir, const char *path)
+{
+  char host[POSIX_PATH_MAX];
+  int res = posix_path(host, path);
+
+  if (res != 0) {
+    return res;
+  }
+  dir->host = opendir(host);
+  return (dir->host == NULL) ? -errno : 0;
+}
+
+static int posix_readdir(struct gdo_fs_dir *dir, struct fs_dirent *entry)
+{
+  struct dirent *ent;
+
+  do {
+    errno = 0;
+    ent   = readdir(dir->host);
+  } while (ent != NULL && (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0));
+  if (ent == NULL) {
+    /* end of directory */
+    entry->name[0] = 0;
+    return -errno;
+  }
+  struct stat st;
+
+  if (fstatat(dirfd(dir->host), ent->d_name, &st, 0) != 0) {
+    return -errno;
+  }
+  entry->type = S_ISDIR(st.st_mode) ? FS_DIR_ENTRY_DIR : FS_DIR_ENTRY_FILE;
+  entry->size = S_ISDIR(st.st_mode) ? 0 : st.st_size;
+  snprintf(entry->name, sizeof(entry->name), "%s", ent->d_name);
+  return 0;
+}
+
+static int posix_closedir(struct gdo_fs_dir *dir)
+{
+  return (closedir(dir->host) == 0) ? 0 : -errno;
+}
+
+const struct gdo_fs_backend gdo_fs_backend_posix = {
+    .name     = "posix",
+    .mount    = posix_mount,
+    .format   = posix_format,
+    .open     = posix_open,
+    .close    = posix_close,
+    .read     = posix_read,
+    .write    = posix_write,
+    .seek     = posix_seek,
+    .truncate = posix_truncate,
+    .sync     = posix_sync,
+    .stat     = posix_stat,
+    .statvfs  = posix_statvfs,
+    .unlink   = posix_unlink,
+    .rename   = posix_rename,
+    .opendir  = posix_opendir,
+    .readdir  = posix_readdir,
+    .closedir = posix_closedir,
+};
+
+#endif
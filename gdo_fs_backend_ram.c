@@ -0,0 +1,294 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fs.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_fs_backend.h"
+
+#if (GDO_FS_RAMDISK_FILES > 0)
+
+/*
+ * Flat RAM disk: a fixed table of files of fixed capacity under GDO_FS_RAMDISK_MOUNT_PT, no
+ * directories. An open file names its node and the node generation, so a handle left open on
+ * a removed file fails with -EBADF instead of reaching whatever took the node.
+ */
+struct ram_node {
+  char path[GDO_FS_MAX_PATH_LEN];
+  size_t size;
+  uint16_t gen;
+  bool used;
+  uint8_t data[GDO_FS_RAMDISK_FILE_SIZE];
+};
+
+static struct ram_node ram_nodes[GDO_FS_RAMDISK_FILES];
+
+static int ram_find(const char *path)
+{
+  for (int i = 0; i < GDO_FS_RAMDISK_FILES; i++) {
+    if (ram_nodes[i].used && strcmp(ram_nodes[i].path, path) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static struct ram_node *ram_node_of(struct gdo_fs_file *file)
+{
+  struct ram_node *node = &ram_nodes[file->ram.node];
+
+  return (node->used && node->gen == file->ram.gen) ? node : NULL;
+}
+
+static void ram_release(struct ram_node *node)
+{
+  node->used = false;
+  node->gen++;
+}
+
+static int ram_format(const char *mnt_point)
+{
+  for (int i = 0; i < GDO_FS_RAMDISK_FILES; i++) {
+    if (ram_nodes[i].used) {
+      ram_release(&ram_nodes[i]);
+    }
+  }
+  return 0;
+}
+
+static int ram_open(struct gdo_fs_file *file, const char *path, fs_mode_t flags)
+{
+  int id = ram_find(path);
+
+  if (id < 0) {
+    if (!(flags & FS_O_CREATE)) {
+      return -ENOENT;
+    }
+    if (strlen(path) >= GDO_FS_MAX_PATH_LEN) {
+      return -ENAMETOOLONG;
+    }
+    for (id = 0; id < GDO_FS_RAMDISK_FILES && ram_nodes[id].used; id++) {
+    }
+    if (id == GDO_FS_RAMDISK_FILES) {
+      return -ENOSPC;
+    }
+    strcpy(ram_nodes[id].path, path);
+    ram_nodes[id].size = 0;
+    ram_nodes[id].used = true;
+  }
+  file->ram.node = id;
+  file->ram.gen  = ram_nodes[id].gen;
+  file->ram.pos  = 0;
+  return 0;
+}
+
+static int ram_close(struct gdo_fs_file *file)
+{
+  return 0;
+}
+
+static ssize_t ram_read(struct gdo_fs_file *file, void *buff, size_t len)
+{
+  struct ram_node *node = ram_node_of(file);
+
+  if (node == NULL) {
+    return -EBADF;
+  }
+  len = (file->ram.pos >= node->size) ? 0 : MIN(len, node->size - file->ram.pos);
+  memcpy(buff, &node->data[file->ram.pos], len);
+  file->ram.pos += len;
+  return len;
+}
+
+static ssize_t ram_write(struct gdo_fs_file *file, const void *buff, size_t len)
+{
+  struct ram_node *node = ram_node_of(file);
+
+  if (node == NULL) {
+    return -EBADF;
+  }
+  if (file->ram.pos + len > GDO_FS_RAMDISK_FILE_SIZE) {
+    return -ENOSPC;
+  }
+  if (file->ram.pos > node->size) {
+    /* written past the end, the gap reads as zeros */
+    memset(&node->data[node->size], 0, file->ram.pos - node->size);
+  }
+  memcpy(&node->data[file->ram.pos], buff, len);
+  file->ram.pos += len;
+  node->size = MAX(node->size, file->ram.pos);
+  return len;
+}
+
+static int ram_seek(struct gdo_fs_file *file, off_t offset, int whence)
+{
+  struct ram_node *node = ram_node_of(file);
+  off_t base;
+
+  if (node == NULL) {
+    return -EBADF;
+  }
+  switch (whence) {
+  case FS_SEEK_SET:
+    base = 0;
+    break;
+  case FS_SEEK_CUR:
+    base = file->ram.pos;
+    break;
+  case FS_SEEK_END:
+    base = node->size;
+    break;
+  default:
+    return -EINVAL;
+  }
+  if (base + offset < 0 || base + offset > GDO_FS_RAMDISK_FILE_SIZE) {
+    return -EINVAL;
+  }
+  file->ram.pos = base + offset;
+  return 0;
+}
+
+static int ram_truncate(struct gdo_fs_file *file, off_t length)
+{
+  struct ram_node *node = ram_node_of(file);
+
+  if (node == NULL) {
+    return -EBADF;
+  }
+  if (length < 0 || length > GDO_FS_RAMDISK_FILE_SIZE) {
+    return -ENOSPC;
+  }
+  if (length > node->size) {
+    memset(&node->data[node->size], 0, length - node->size);
+  }
+  node->size = length;
+  return 0;
+}
+
+static int ram_sync(struct gdo_fs_file *file)
+{
+  return (ram_node_of(file) != NULL) ? 0 : -EBADF;
+}
+
+static int ram_stat(const char *path, struct fs_dirent *entry)
+{
+  int id = ram_find(path);
+
+  if (id < 0) {
+    if (strcmp(path, GDO_FS_RAMDISK_MOUNT_PT) != 0) {
+      return -ENOENT;
+    }
+    entry->type = FS_DIR_ENTRY_DIR;
+    entry->size = 0;
+    strcpy(entry->name, GDO_FS_RAMDISK_MOUNT_PT + 1);
+    return 0;
+  }
+  entry->type = FS_DIR_ENTRY_FILE;
+  entry->size = ram_nodes[id].size;
+  strncpy(entry->name, ram_nodes[id].path + sizeof(GDO_FS_RAMDISK_MOUNT_PT), sizeof(entry->name) - 1);
+  entry->name[sizeof(entry->name) - 1] = 0;
+  return 0;
+}
+
+/* A node is one block, the disk has room for GDO_FS_RAMDISK_FILES of them */
+static int ram_statvfs(const char *path, struct fs_statvfs *stat)
+{
+  stat->f_bsize  = GDO_FS_RAMDISK_FILE_SIZE;
+  stat->f_frsize = GDO_FS_RAMDISK_FILE_SIZE;
+  stat->f_blocks = GDO_FS_RAMDISK_FILES;
+  stat->f_bfree  = 0;
+  for (int i = 0; i < GDO_FS_RAMDISK_FILES; i++) {
+    if (!ram_nodes[i].used) {
+      stat->f_bfree++;
+    }
+  }
+  return 0;
+}
+
+static int ram_unlink(const char *path)
+{
+  int id = ram_find(path);
+
+  if (id < 0) {
+    return -ENOENT;
+  }
+  ram_release(&ram_nodes[id]);
+  return 0;
+}
+
+static int ram_rename(const char *from, const char *to)
+{
+  int id = ram_find(from);
+  int old;
+
+  if (id < 0) {
+    return -ENOENT;
+  }
+  if (strlen(to) >= GDO_FS_MAX_PATH_LEN) {
+    return -ENAMETOOLONG;
+  }
+  old = ram_find(to);
+  if (old >= 0 && old != id) {
+    ram_release(&ram_nodes[old]);
+  }
+  strcpy(ram_nodes[id].path, to);
+  return 0;
+}
+
+static int ram_opendir(struct gdo_fs_dir *dir, const char *path)
+{
+  if (strcmp(path, GDO_FS_RAMDISK_MOUNT_PT) != 0) {
+    return -ENOENT;
+  }
+  dir->next = 0;
+  return 0;
+}
+
+static int ram_readdir(struct gdo_fs_dir *dir, struct fs_dirent *entry)
+{
+  while (dir->next < GDO_FS_RAMDISK_FILES && !ram_nodes[dir->next].used) {
+    dir->next++;
+  }
+  if (dir->next == GDO_FS_RAMDISK_FILES) {
+    /* end of directory */
+    entry->name[0] = 0;
+    return 0;
+  }
+  return ram_stat(ram_nodes[dir->next++].path, entry);
+}
+
+static int ram_closedir(struct gdo_fs_dir *dir)
+{
+  return 0;
+}
+
+const struct gdo_fs_backend gdo_fs_backend_ram = {
+    .name     = "ram",
+    .format   = ram_format,
+    .open     = ram_open,
+    .close    = ram_close,
+    .read     = ram_read,
+    .write    = ram_write,
+    .seek     = ram_seek,
+    .truncate = ram_truncate,
+    .sync     = ram_sync,
+    .stat     = ram_stat,
+    .statvfs  = ram_statvfs,
+    .unlink   = ram_unlink,
+    .rename   = ram_rename,
+    .opendir  = ram_opendir,
+    .readdir  = ram_readdir,
+    .closedir = ram_closedir,
+};
+
+#endif
@@ -0,0 +1,140 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fs.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_fs_backend.h"
+
+/* The POSIX build has no littlefs mount and links no fs_* calls */
+#if !(GDO_FS_BACKEND_POSIX)
+
+/* Zephyr VFS, littlefs on the external flash partition described in gdo_file_system_util.c */
+extern struct fs_mount_t *mountpoint;
+
+/* What zfs_mount() mounted itself, NULL if the mount point was set up elsewhere (fstab) */
+static struct fs_mount_t *zfs_mounted;
+
+static int zfs_mount(const char *mnt_point)
+{
+  int res;
+
+  if (strcmp(mnt_point, mountpoint->mnt_point) != 0) {
+    /* mounted by the devicetree fstab, nothing to do */
+    return 0;
+  }
+  res = fs_mount(mountpoint);
+  if (res == -EBUSY) {
+    /* already mounted, by an earlier init or someone else, the format leaves it alone */
+    return 0;
+  }
+  if (res == 0) {
+    zfs_mounted = mountpoint;
+  }
+  return res;
+}
+
+static int zfs_open(struct gdo_fs_file *file, const char *path, fs_mode_t flags)
+{
+  fs_file_t_init(&file->zfs);
+  return fs_open(&file->zfs, path, flags);
+}
+
+static int zfs_close(struct gdo_fs_file *file)
+{
+  return fs_close(&file->zfs);
+}
+
+static ssize_t zfs_read(struct gdo_fs_file *file, void *buff, size_t len)
+{
+  return fs_read(&file->zfs, buff, len);
+}
+
+static ssize_t zfs_write(struct gdo_fs_file *file, const void *buff, size_t len)
+{
+  return fs_write(&file->zfs, buff, len);
+}
+
+static int zfs_seek(struct gdo_fs_file *file, off_t offset, int whence)
+{
+  return fs_seek(&file->zfs, offset, whence);
+}
+
+static int zfs_truncate(struct gdo_fs_file *file, off_t length)
+{
+  return fs_truncate(&file->zfs, length);
+}
+
+static int zfs_sync(struct gdo_fs_file *file)
+{
+  return fs_sync(&file->zfs);
+}
+
+static int zfs_opendir(struct gdo_fs_dir *dir, const char *path)
+{
+  fs_dir_t_init(&dir->zfs);
+  return fs_opendir(&dir->zfs, path);
+}
+
+static int zfs_readdir(struct gdo_fs_dir *dir, struct fs_dirent *entry)
+{
+  return fs_readdir(&dir->zfs, entry);
+}
+
+static int zfs_closedir(struct gdo_fs_dir *dir)
+{
+  return fs_closedir(&dir->zfs);
+}
+
+#if defined(CONFIG_FILE_SYSTEM_MKFS)
+/* One format instead of an unlink per file */
+static int zfs_format(const char *mnt_point)
+{
+  int res;
+
+  /* only a partition this backend mounted, its fs_mount_t is known */
+  if (zfs_mounted == NULL || strcmp(mnt_point, zfs_mounted->mnt_point) != 0) {
+    return -ENOTSUP;
+  }
+  res = fs_unmount(zfs_mounted);
+  if (res == 0) {
+    res    = fs_mkfs(zfs_mounted->type, (uintptr_t) zfs_mounted->storage_dev, zfs_mounted->fs_data, 0);
+    int rc = fs_mount(zfs_mounted);
+    res    = (res != 0) ? res : rc;
+  }
+  return res;
+}
+#endif
+
+const struct gdo_fs_backend gdo_fs_backend_zephyr = {
+    .name  = "zephyr",
+    .mount = zfs_mount,
+#if defined(CONFIG_FILE_SYSTEM_MKFS)
+    .format = zfs_format,
+#endif
+    .open     = zfs_open,
+    .close    = zfs_close,
+    .read     = zfs_read,
+    .write    = zfs_write,
+    .seek     = zfs_seek,
+    .truncate = zfs_truncate,
+    .sync     = zfs_sync,
+    .stat     = fs_stat,
+    .statvfs  = fs_statvfs,
+    .unlink   = fs_unlink,
+    .rename   = fs_rename,
+    .opendir  = zfs_opendir,
+    .readdir  = zfs_readdir,
+    .closedir = zfs_closedir,
+};
+#endif
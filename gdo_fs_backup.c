@@ -0,0 +1,227 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_file_system_util.h"
+#include "gdo_user_infor_util.h"
+#include "gdo_schedule.h"
+#include "gdo_schedule_store.h"
+#include "gdo_fs_backup.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+/* Matches the layout documented in gdo_fs_backup.h, the target is little endian */
+struct backup_header {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t part;
+  uint16_t len;
+  uint32_t offset;
+  uint32_t image_size;
+  uint32_t part_size;
+  uint32_t crc;
+} __packed;
+
+BUILD_ASSERT(sizeof(struct backup_header) == GDO_FS_BACKUP_HEADER_SIZE, "backup header layout");
+BUILD_ASSERT(GDO_FS_BACKUP_PAYLOAD_MAX >= sizeof(struct schedule_data), "backup chunk below one schedule record");
+
+struct backup_part {
+  const char *path; /* NULL: the schedule store */
+  size_t size;
+  size_t record; /* chunks of this part hold whole records */
+};
+
+static const struct backup_part backup_parts[GDO_FS_BACKUP_PART_NUM] = {
+    [GDO_FS_BACKUP_USER]     = {GDO_USER_INFOR_FULL_PATH, GDO_MAX_USER_SUPORT * sizeof(gdo_user_infor), 1},
+    [GDO_FS_BACKUP_SCHEDULE] = {NULL, SCHEDULE_NUM * sizeof(struct schedule_data), sizeof(struct schedule_data)},
+    [GDO_FS_BACKUP_HOME_CFG] = {HOME_CFG_FILE_FULL_PATH, HOME_CFG_FILE_SIZE, 1},
+};
+
+/* Part holding image byte @p offset and where the part starts, -1 past the end */
+static int backup_part_find(uint32_t offset, uint32_t *start)
+{
+  uint32_t base = 0;
+
+  for (int i = 0; i < GDO_FS_BACKUP_PART_NUM; i++) {
+    if (offset < base + backup_parts[i].size) {
+      *start = base;
+      return i;
+    }
+    base += backup_parts[i].size;
+  }
+  return -1;
+}
+
+/* A cursor may only sit at a record boundary of its part, or at the end */
+static bool backup_offset_valid(uint32_t offset)
+{
+  uint32_t start;
+  int part = backup_part_find(offset, &start);
+
+  if (part < 0) {
+    return offset == gdo_fs_backup_image_size();
+  }
+  return (offset - start) % backup_parts[part].record == 0;
+}
+
+static uint32_t backup_crc(const struct backup_header *header, const uint8_t *payload)
+{
+  struct backup_header tmp = *header;
+
+  tmp.crc = 0;
+  return crc32_ieee_update(crc32_ieee((const uint8_t *) &tmp, sizeof(tmp)), payload, header->len);
+}
+
+static int backup_read(const struct backup_part *part, uint8_t *buff, size_t len, size_t index)
+{
+  struct schedule_data data;
+
+  if (part->path != NULL) {
+    return gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, part->path, buff, len, index) == len ? 0 : -EIO;
+  }
+  for (size_t done = 0; done < len; done += sizeof(data)) {
+    if (gdo_schedule_store_read((index + done) / sizeof(data), &data) != 0) {
+      return -EIO;
+    }
+    memcpy(buff + done, &data, sizeof(data));
+  }
+  return 0;
+}
+
+static int backup_write(const struct backup_part *part, const uint8_t *buff, size_t len, size_t index)
+{
+  struct schedule_data data;
+
+  if (part->path != NULL) {
+    return gdo_fs_write_file_index(GDO_DISK_MOUNT_PT, part->path, (void *) buff, len, index) == len ? 0 : -EIO;
+  }
+  for (size_t done = 0; done < len; done += sizeof(data)) {
+    memcpy(&data, buff + done, sizeof(data));
+    if (gdo_schedule_store_write((index + done) / sizeof(data), &data) != 0) {
+      return -EIO;
+    }
+  }
+  return 0;
+}
+
+uint32_t gdo_fs_backup_image_size(void)
+{
+  uint32_t size = 0;
+
+  for (int i = 0; i < GDO_FS_BACKUP_PART_NUM; i++) {
+    size += backup_parts[i].size;
+  }
+  return size;
+}
+
+/*==================== producer ====================*/
+
+int gdo_fs_backup_begin(struct gdo_fs_backup *it, uint32_t offset)
+{
+  if (!backup_offset_valid(offset)) {
+    return -EINVAL;
+  }
+  it->offset = offset;
+  return 0;
+}
+
+int gdo_fs_backup_next(struct gdo_fs_backup *it, uint8_t *chunk, size_t size)
+{
+  struct backup_header header;
+  uint32_t start;
+  int part = backup_part_find(it->offset, &start);
+
+  if (part < 0) {
+    return 0;
+  }
+  const struct backup_part *p = &backup_parts[part];
+  size_t len                  = MIN(size - MIN(size, sizeof(header)), p->size - (it->offset - start));
+
+  len = MIN(len, UINT16_MAX);
+  len -= len % p->record;
+  if (len == 0) {
+    return -EINVAL;
+  }
+  if (backup_read(p, chunk + sizeof(header), len, it->offset - start) != 0) {
+    LOG_ERR("FS-BACKUP: read of part %d at %u failed", part, it->offset - start);
+    return -EIO;
+  }
+  header = (struct backup_header){
+      .magic      = GDO_FS_BACKUP_MAGIC,
+      .version    = GDO_FS_BACKUP_VERSION,
+      .part       = part,
+      .len        = len,
+      .offset     = it->offset,
+      .image_size = gdo_fs_backup_image_size(),
+      .part_size  = p->size,
+  };
+  header.crc = backup_crc(&header, chunk + sizeof(header));
+  memcpy(chunk, &header, sizeof(header));
+  it->offset += len;
+  return sizeof(header) + len;
+}
+
+/*==================== consumer ====================*/
+
+int gdo_fs_restore_begin(struct gdo_fs_restore *it, uint32_t offset)
+{
+  if (!backup_offset_valid(offset)) {
+    return -EINVAL;
+  }
+  it->offset = offset;
+  return 0;
+}
+
+int gdo_fs_restore_put(struct gdo_fs_restore *it, const uint8_t *chunk, size_t len)
+{
+  uint32_t image_size = gdo_fs_backup_image_size();
+  struct backup_header header;
+  uint32_t start;
+  int res;
+
+  if (len < sizeof(header)) {
+    return -EBADMSG;
+  }
+  memcpy(&header, chunk, sizeof(header));
+  if (header.magic != GDO_FS_BACKUP_MAGIC || header.len != len - sizeof(header) ||
+      header.crc != backup_crc(&header, chunk + sizeof(header))) {
+    return -EBADMSG;
+  }
+  if (header.version != GDO_FS_BACKUP_VERSION || header.image_size != image_size ||
+      header.part >= GDO_FS_BACKUP_PART_NUM || header.part_size != backup_parts[header.part].size) {
+    LOG_ERR("FS-BACKUP: image v%u of %u bytes does not match this layout", header.version, header.image_size);
+    return -ENOTSUP;
+  }
+  /* the chunk must lie in its part and hold whole records */
+  if (backup_part_find(header.offset, &start) != header.part || header.len == 0 ||
+      header.offset + header.len > start + header.part_size || !backup_offset_valid(header.offset) ||
+      header.len % backup_parts[header.part].record != 0) {
+    return -EBADMSG;
+  }
+  if (header.offset + header.len <= it->offset) {
+    return it->offset == image_size;
+  }
+  if (header.offset != it->offset) {
+    return -ESPIPE;
+  }
+  res = backup_write(&backup_parts[header.part], chunk + sizeof(header), header.len, header.offset - start);
+  if (res != 0) {
+    LOG_ERR("FS-BACKUP: restore of part %u at %u failed", header.part, header.offset - start);
+    return res;
+  }
+  it->offset += header.len;
+  return it->offset == image_size;
+}
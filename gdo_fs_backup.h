@@ -0,0 +1,110 @@
+#ifndef _GDO_FS_BACKUP_H_
+#define _GDO_FS_BACKUP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Largest chunk, header included. The default fits one notification of a 247 byte ATT MTU
+ * (NUS) and one mcumgr SMP buffer.
+ */
+#ifndef GDO_FS_BACKUP_CHUNK_SIZE
+#define GDO_FS_BACKUP_CHUNK_SIZE 240
+#endif
+
+#define GDO_FS_BACKUP_MAGIC   0x4B424447 /* "GDBK" */
+#define GDO_FS_BACKUP_VERSION 1
+
+/* Archived content, in image order */
+enum gdo_fs_backup_part {
+  GDO_FS_BACKUP_USER = 0,
+  GDO_FS_BACKUP_SCHEDULE,
+  GDO_FS_BACKUP_HOME_CFG,
+  GDO_FS_BACKUP_PART_NUM,
+};
+
+/*
+ * Chunk header, little endian, followed by the payload:
+ *   u32 magic, u8 version, u8 part (enum gdo_fs_backup_part), u16 payload length,
+ *   u32 payload offset in the image, u32 image size, u32 part size,
+ *   u32 crc32_ieee of the header with the crc field zero, then of the payload.
+ * The image is the concatenation of the parts. Every chunk says where it goes, so a transfer
+ * restarts from any chunk offset.
+ */
+#define GDO_FS_BACKUP_HEADER_SIZE 24
+
+#define GDO_FS_BACKUP_PAYLOAD_MAX (GDO_FS_BACKUP_CHUNK_SIZE - GDO_FS_BACKUP_HEADER_SIZE)
+
+/*
+ * Streaming backup and restore of the user table, the schedule table and the home config.
+ *
+ * The producer reads the next piece straight into the caller's chunk buffer and the consumer
+ * writes each chunk into place before it returns, so neither side holds more than one chunk.
+ * The user table goes through GDO_USER_INFOR_FULL_PATH and the schedule table through the
+ * schedule store, so the image does not depend on how either is laid out on flash. Schedule
+ * chunks hold whole records only.
+ *
+ * Each chunk is consistent on its own, the image is not a snapshot: changes made during a
+ * backup may be in some chunks and not in others.
+ */
+
+/* Producer cursor, the offset is the next image byte and can be set to resume a transfer */
+struct gdo_fs_backup {
+  uint32_t offset;
+};
+
+/* Consumer cursor, the offset is the next image byte expected, everything before is written */
+struct gdo_fs_restore {
+  uint32_t offset;
+};
+
+/**
+ * @brief Size of the image this build produces and accepts.
+ */
+uint32_t gdo_fs_backup_image_size(void);
+
+/**
+ * @brief Start (@p offset 0) or resume a backup.
+ *
+ * @return 0, or -EINVAL if @p offset is past the end of the image.
+ */
+int gdo_fs_backup_begin(struct gdo_fs_backup *it, uint32_t offset);
+
+/**
+ * @brief Produce the next chunk into @p chunk.
+ *
+ * @param[out] chunk Buffer of @p size bytes, at least a header and one schedule record.
+ *
+ * @return Chunk length, 0 after the last chunk, -EINVAL if @p size is too small,
+ *         -EIO if the data cannot be read. The cursor only moves on success.
+ */
+int gdo_fs_backup_next(struct gdo_fs_backup *it, uint8_t *chunk, size_t size);
+
+/**
+ * @brief Start (@p offset 0) or resume a restore at the offset a previous restore reached.
+ *
+ * @return 0, or -EINVAL if @p offset is past the end of the image.
+ */
+int gdo_fs_restore_begin(struct gdo_fs_restore *it, uint32_t offset);
+
+/**
+ * @brief Check one chunk and write it into place.
+ *
+ * A chunk already written (offset below the cursor) is accepted again without effect, so a
+ * retransmitted chunk is harmless.
+ *
+ * @return 1 once the last chunk is written, 0 for more, -EBADMSG on a bad header or CRC,
+ *         -ENOTSUP if the image is for another layout, -ESPIPE if the chunk is not the one
+ *         expected (resume from it->offset), -EIO if the write failed.
+ */
+int gdo_fs_restore_put(struct gdo_fs_restore *it, const uint8_t *chunk, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,409 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include "gdo_config.h"
+#include "gdo_fs_benchmark.h"
+
+#if (GDO_FS_BENCHMARK)
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gdo_file_system_util.h"
+#include "gdo_flash_cache.h"
+#include "gdo_fs_view.h"
+#include "gdo_fs_stats.h"
+#if defined(CONFIG_FLASH_SIMULATOR_STATS)
+#include <zephyr/stats/stats.h>
+#endif
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+#ifndef GDO_FS_BENCH_ITERATIONS
+#define GDO_FS_BENCH_ITERATIONS 100
+#endif
+
+/* Raw range used by the gdo_flash_* cases, must not overlap live data */
+#ifndef GDO_FS_BENCH_FLASH_OFFSET
+#define GDO_FS_BENCH_FLASH_OFFSET (GDO_KV_REGION_OFFSET + GDO_KV_REGION_SIZE)
+#endif
+#define BENCH_FLASH_SIZE (16 * GDO_FLASH_SECTOR_SIZE)
+
+#define BENCH_FILE        GDO_DISK_MOUNT_PT "/bench.bin"
+#define BENCH_FILE_RENAME GDO_DISK_MOUNT_PT "/bench.ren"
+#define BENCH_FILLER      GDO_DISK_MOUNT_PT "/bench.fill"
+#define BENCH_RECORDS     32
+#define BENCH_MAX_RECORD  1024
+#define BENCH_IOV         4
+
+static const size_t bench_sizes[] = {16, 64, 256, BENCH_MAX_RECORD};
+static const uint8_t bench_fill_percent[] = {0, 50, 90};
+
+static uint8_t bench_buf[BENCH_IOV * BENCH_MAX_RECORD];
+static uint32_t bench_samples[GDO_FS_BENCH_ITERATIONS];
+
+struct bench_flash_counters {
+  uint32_t erases;
+  uint32_t programs;
+};
+
+#if defined(CONFIG_FLASH_SIMULATOR_STATS)
+static int bench_stats_walk(struct stats_hdr *hdr, void *arg, const char *name, uint16_t off)
+{
+  struct bench_flash_counters *counters = arg;
+  uint32_t value                        = *(uint32_t *) ((uint8_t *) hdr + off);
+
+  if (strcmp(name, "flash_erase_calls") == 0) {
+    counters->erases = value;
+  } else if (strcmp(name, "flash_write_calls") == 0) {
+    counters->programs = value;
+  }
+  return 0;
+}
+#endif
+
+static bool bench_flash_counters_get(struct bench_flash_counters *counters)
+{
+  memset(counters, 0, sizeof(*counters));
+#if defined(CONFIG_FLASH_SIMULATOR_STATS)
+  struct stats_hdr *hdr = stats_group_find("flash_sim_stats");
+  if (hdr != NULL) {
+    stats_walk(hdr, bench_stats_walk, counters);
+    return true;
+  }
+#endif
+#if (GDO_FS_STATS) && (GDO_FS_STATS_FLASH_AREA)
+  /* on target: the raw region calls plus the littlefs partition calls */
+  struct gdo_fs_stat_entry entry;
+
+  gdo_fs_stats_get(GDO_FS_STAT_RAW_ERASE, &entry);
+  counters->erases = entry.count;
+  gdo_fs_stats_get(GDO_FS_STAT_PART_ERASE, &entry);
+  counters->erases += entry.count;
+  gdo_fs_stats_get(GDO_FS_STAT_RAW_PROGRAM, &entry);
+  counters->programs = entry.count;
+  gdo_fs_stats_get(GDO_FS_STAT_PART_PROGRAM, &entry);
+  counters->programs += entry.count;
+  return true;
+#else
+  return false;
+#endif
+}
+
+/*==================== cases ====================*/
+/* Each op gets the record size and the iteration number and returns < 0 on failure */
+
+static size_t bench_index(size_t size, size_t i)
+{
+  return ((i * 7) % BENCH_RECORDS) * size;
+}
+
+static int bench_setup_file(size_t size)
+{
+  return gdo_fs_create_file(BENCH_FILE, BENCH_RECORDS * size) ? 0 : -EIO;
+}
+
+static int bench_setup_empty_file(size_t size)
+{
+  return gdo_fs_create_file(BENCH_FILE, 0) ? 0 : -EIO;
+}
+
+static int bench_setup_flash(size_t size)
+{
+  return gdo_flash_earse_region(GDO_FS_BENCH_FLASH_OFFSET, BENCH_FLASH_SIZE) ? 0 : -EIO;
+}
+
+static int bench_create_file(size_t size, size_t i)
+{
+  return gdo_fs_create_file(BENCH_FILE, BENCH_RECORDS * size) ? 0 : -EIO;
+}
+
+static int bench_write_file(size_t size, size_t i)
+{
+  return gdo_fs_write_file(GDO_DISK_MOUNT_PT, BENCH_FILE, bench_buf, size);
+}
+
+static int bench_read_file(size_t size, size_t i)
+{
+  return gdo_fs_read_file(GDO_DISK_MOUNT_PT, BENCH_FILE, bench_buf, size);
+}
+
+static int bench_write_file_index(size_t size, size_t i)
+{
+  bench_buf[0] = i;
+  return gdo_fs_write_file_index(GDO_DISK_MOUNT_PT, BENCH_FILE, bench_buf, size, bench_index(size, i));
+}
+
+static int bench_read_file_index(size_t size, size_t i)
+{
+  return gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, BENCH_FILE, bench_buf, size, bench_index(size, i));
+}
+
+static void bench_iov(struct gdo_fs_iovec *iov, size_t size, size_t i)
+{
+  for (int k = 0; k < BENCH_IOV; k++) {
+    iov[k].index = bench_index(size, i + k);
+    iov[k].buff  = &bench_buf[k * size];
+    iov[k].len   = size;
+  }
+}
+
+static int bench_writev_index(size_t size, size_t i)
+{
+  struct gdo_fs_iovec iov[BENCH_IOV];
+
+  bench_buf[0] = i;
+  bench_iov(iov, size, i);
+  return gdo_fs_writev_index(GDO_DISK_MOUNT_PT, BENCH_FILE, iov, BENCH_IOV);
+}
+
+static int bench_view_index(size_t size, size_t i)
+{
+  /* the pool only holds GDO_FS_VIEW_BUFFER_SIZE, larger sizes measure that prefix */
+  size_t len = (size > GDO_FS_VIEW_BUFFER_SIZE) ? GDO_FS_VIEW_BUFFER_SIZE : size;
+  const void *view = gdo_fs_view_index(BENCH_FILE, len, bench_index(size, i));
+
+  if (view == NULL) {
+    return -ENOMEM;
+  }
+  gdo_fs_release_view(view);
+  return 0;
+}
+
+static int bench_readv_index(size_t size, size_t i)
+{
+  struct gdo_fs_iovec iov[BENCH_IOV];
+
+  bench_iov(iov, size, i);
+  return gdo_fs_readv_index(GDO_DISK_MOUNT_PT, BENCH_FILE, iov, BENCH_IOV);
+}
+
+static int bench_file_size(size_t size, size_t i)
+{
+  return gdo_fs_file_size(BENCH_FILE);
+}
+
+static int bench_file_exist(size_t size, size_t i)
+{
+  return (gdo_fs_file_exist(BENCH_FILE) == FILE_EXIST) ? 0 : -EIO;
+}
+
+static int bench_rename(size_t size, size_t i)
+{
+  return (i & 1) ? gdo_fs_rename(BENCH_FILE_RENAME, BENCH_FILE) : gdo_fs_rename(BENCH_FILE, BENCH_FILE_RENAME);
+}
+
+static int bench_cache_flush(size_t size, size_t i)
+{
+  int res = gdo_fs_write_file_index(GDO_DISK_MOUNT_PT, BENCH_FILE, bench_buf, size, bench_index(size, i));
+  return (res < 0) ? res : gdo_fs_cache_flush();
+}
+
+static int bench_delete_file(size_t size, size_t i)
+{
+  return gdo_fs_delete_file(GDO_DISK_MOUNT_PT, HOME_CFG_FILE_FULL_PATH) ? 0 : -EIO;
+}
+
+static int bench_provision(size_t size, size_t i)
+{
+  /* the startup pass with every managed file already in place */
+  return createFileIfNotExist() ? 0 : -EIO;
+}
+
+static int bench_delete_all_file(size_t size, size_t i)
+{
+  /* the factory reset path, bench_provision puts the managed files back before each pass */
+  return gdo_fs_delete_all_file(GDO_DISK_MOUNT_PT, GDO_DISK_MOUNT_PT);
+}
+
+static int bench_flash_write(size_t size, size_t i)
+{
+  off_t offset = GDO_FS_BENCH_FLASH_OFFSET + (off_t) ((i * size) % BENCH_FLASH_SIZE);
+
+  bench_buf[0] = i;
+  if (!gdo_flash_write_offset(offset, bench_buf, size)) {
+    return -EIO;
+  }
+  return gdo_flash_flush() ? 0 : -EIO;
+}
+
+static int bench_flash_read(size_t size, size_t i)
+{
+  off_t offset = GDO_FS_BENCH_FLASH_OFFSET + (off_t) ((i * size) % BENCH_FLASH_SIZE);
+  return gdo_flash_read_offset(offset, bench_buf, size) ? 0 : -EIO;
+}
+
+static off_t bench_flash_sector(size_t i)
+{
+  return GDO_FS_BENCH_FLASH_OFFSET + (off_t) ((i % (BENCH_FLASH_SIZE / GDO_FLASH_SECTOR_SIZE)) * GDO_FLASH_SECTOR_SIZE);
+}
+
+static int bench_flash_dirty(size_t size, size_t i)
+{
+  /* the erase skips blank sectors, one programmed byte gives the timed erase real work */
+  uint8_t dirty = 0x00;
+
+  if (!gdo_flash_write_offset(bench_flash_sector(i), &dirty, 1)) {
+    return -EIO;
+  }
+  return gdo_flash_flush() ? 0 : -EIO;
+}
+
+static int bench_flash_erase(size_t size, size_t i)
+{
+  return gdo_flash_earse_region(bench_flash_sector(i), GDO_FLASH_SECTOR_SIZE) ? 0 : -EIO;
+}
+
+struct bench_case {
+  const char *api;
+  int (*setup)(size_t size);
+  int (*op)(size_t size, size_t i);
+  size_t bytes_per_op; /* in records, 0 when the op moves no payload */
+  int (*prepare)(size_t size, size_t i); /* untimed, before each op, may be NULL */
+};
+
+static const struct bench_case bench_cases[] = {
+    {"gdo_fs_create_file", NULL, bench_create_file, 0, NULL},
+    {"gdo_fs_write_file", bench_setup_empty_file, bench_write_file, 1, NULL},
+    {"gdo_fs_read_file", bench_setup_file, bench_read_file, 1, NULL},
+    {"gdo_fs_write_file_index", bench_setup_file, bench_write_file_index, 1, NULL},
+    {"gdo_fs_read_file_index", bench_setup_file, bench_read_file_index, 1, NULL},
+    {"gdo_fs_writev_index", bench_setup_file, bench_writev_index, BENCH_IOV, NULL},
+    {"gdo_fs_readv_index", bench_setup_file, bench_readv_index, BENCH_IOV, NULL},
+    {"gdo_fs_view_index", bench_setup_file, bench_view_index, 1, NULL},
+    {"gdo_fs_file_size", bench_setup_file, bench_file_size, 0, NULL},
+    {"gdo_fs_file_exist", bench_setup_file, bench_file_exist, 0, NULL},
+    {"gdo_fs_rename", bench_setup_file, bench_rename, 0, NULL},
+    {"gdo_fs_cache_flush", bench_setup_file, bench_cache_flush, 1, NULL},
+    {"gdo_fs_delete_file", NULL, bench_delete_file, 0, NULL},
+    {"createFileIfNotExist", NULL, bench_provision, 0, NULL},
+    {"gdo_flash_write_offset", bench_setup_flash, bench_flash_write, 1, NULL},
+    {"gdo_flash_read_offset", bench_setup_flash, bench_flash_read, 1, NULL},
+    {"gdo_flash_earse_region", NULL, bench_flash_erase, 0, bench_flash_dirty},
+    /* last, it drops the filler and every file the cases above rely on */
+    {"gdo_fs_delete_all_file", NULL, bench_delete_all_file, 0, bench_provision},
+};
+
+/*==================== runner ====================*/
+
+static int bench_cmp_u32(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *) a;
+  uint32_t y = *(const uint32_t *) b;
+  return (x > y) - (x < y);
+}
+
+/* Brings the partition to @p percent of its capacity, counting what is already stored */
+static int bench_fill(uint8_t percent)
+{
+  struct fs_statvfs sbuf;
+  /* the filler of the previous level would count as used space */
+  int res = gdo_fs_unlink(BENCH_FILLER);
+  if (res != 0 && res != -ENOENT) {
+    return res;
+  }
+  if (percent == 0) {
+    return 0;
+  }
+  if (gdo_fs_statvfs(GDO_DISK_MOUNT_PT, &sbuf) != 0) {
+    return -EIO;
+  }
+  uint64_t total  = (uint64_t) sbuf.f_blocks * sbuf.f_frsize;
+  uint64_t used   = (uint64_t) (sbuf.f_blocks - sbuf.f_bfree) * sbuf.f_frsize;
+  uint64_t target = total * percent / 100;
+
+  if (target <= used) {
+    return 0;
+  }
+  return gdo_fs_create_file(BENCH_FILLER, (size_t) (target - used)) ? 0 : -EIO;
+}
+
+static void bench_run_case(const struct bench_case *bc, size_t size, uint8_t fill)
+{
+  struct bench_flash_counters before, after;
+  uint64_t total_us = 0;
+  int failures      = 0;
+
+  if (bc->setup != NULL && bc->setup(size) != 0) {
+    LOG_PRINTK("BENCH {\"api\":\"%s\",\"size\":%u,\"fill\":%u,\"error\":\"setup\"}\n", bc->api, size, fill);
+    return;
+  }
+  bool counted = bench_flash_counters_get(&before);
+  for (size_t i = 0; i < GDO_FS_BENCH_ITERATIONS; i++) {
+    if (bc->prepare != NULL) {
+      struct bench_flash_counters p0, p1;
+
+      bench_flash_counters_get(&p0);
+      if (bc->prepare(size, i) < 0) {
+        failures++;
+      }
+      /* keep the prepare traffic out of the op's counts */
+      bench_flash_counters_get(&p1);
+      before.erases += p1.erases - p0.erases;
+      before.programs += p1.programs - p0.programs;
+    }
+    uint32_t start = k_cycle_get_32();
+    if (bc->op(size, i) < 0) {
+      failures++;
+    }
+    bench_samples[i] = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    total_us += bench_samples[i];
+  }
+  bench_flash_counters_get(&after);
+  qsort(bench_samples, GDO_FS_BENCH_ITERATIONS, sizeof(bench_samples[0]), bench_cmp_u32);
+
+  uint32_t ops_per_s = total_us ? (uint32_t) ((uint64_t) GDO_FS_BENCH_ITERATIONS * 1000000U / total_us) : 0;
+  uint32_t kb_per_s  = total_us ? (uint32_t) ((uint64_t) GDO_FS_BENCH_ITERATIONS * bc->bytes_per_op * size * 1000000U /
+                                             1024U / total_us)
+                                : 0;
+  /* erase/program counts in milli-ops per operation, -1 without a counter source */
+  int32_t erases_m   = counted ? (int32_t) ((after.erases - before.erases) * 1000U / GDO_FS_BENCH_ITERATIONS) : -1;
+  int32_t programs_m = counted ? (int32_t) ((after.programs - before.programs) * 1000U / GDO_FS_BENCH_ITERATIONS) : -1;
+
+  LOG_PRINTK("BENCH {\"api\":\"%s\",\"size\":%u,\"fill\":%u,\"n\":%u,\"fail\":%d,"
+             "\"p50_us\":%u,\"p99_us\":%u,\"max_us\":%u,\"ops_s\":%u,\"kb_s\":%u,"
+             "\"erases_per_kop\":%d,\"programs_per_kop\":%d}\n",
+             bc->api,
+             size,
+             fill,
+             GDO_FS_BENCH_ITERATIONS,
+             failures,
+             bench_samples[GDO_FS_BENCH_ITERATIONS / 2],
+             bench_samples[(GDO_FS_BENCH_ITERATIONS * 99) / 100],
+             bench_samples[GDO_FS_BENCH_ITERATIONS - 1],
+             ops_per_s,
+             kb_per_s,
+             erases_m,
+             programs_m);
+}
+
+int gdo_fs_benchmark_run(void)
+{
+  memset(bench_buf, 0x5A, sizeof(bench_buf));
+  LOG_PRINTK("BENCH {\"api\":\"gdo_file_system_init\",\"ready_us\":%u}\n", gdo_fs_init_time_us());
+  for (size_t f = 0; f < ARRAY_SIZE(bench_fill_percent); f++) {
+    if (bench_fill(bench_fill_percent[f]) != 0) {
+      LOG_ERR("BENCH: fill %u%% failed", bench_fill_percent[f]);
+      return -EIO;
+    }
+    for (size_t c = 0; c < ARRAY_SIZE(bench_cases); c++) {
+      for (size_t s = 0; s < ARRAY_SIZE(bench_sizes); s++) {
+        bench_run_case(&bench_cases[c], bench_sizes[s], bench_fill_percent[f]);
+      }
+    }
+  }
+  gdo_fs_create_file(BENCH_FILE, 0);
+  bench_fill(0);
+  return 0;
+}
+#endif
@@ -0,0 +1,30 @@
+#ifndef _GDO_FS_BENCHMARK_H_
+#define _GDO_FS_BENCHMARK_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if (GDO_FS_BENCHMARK)
+/**
+ * @brief Latency/throughput benchmark of every public gdo_fs_* and gdo_flash_* function.
+ *
+ * Meant for native_sim with the flash simulator sized like the littlefs_storage partition
+ * (CONFIG_FLASH_SIMULATOR_STATS=y adds erase/program counts), benchmark/ is that application.
+ * On target GDO_FS_STATS_FLASH_AREA gives the counts instead.
+ * Each case is run over several
+ * record sizes and littlefs fill levels and printed as one JSON line prefixed with "BENCH ".
+ * Uses GDO_DISK_MOUNT_PT "/bench*" files and the raw range at GDO_FS_BENCH_FLASH_OFFSET.
+ * Destructive: the gdo_fs_delete_file case resets the home config file and the last case,
+ * gdo_fs_delete_all_file, wipes the partition and provisions the managed files again.
+ *
+ * @return 0 on success, or a negative error code if the setup failed.
+ */
+int gdo_fs_benchmark_run(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,336 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_fs_compress.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+#define LZ_MAGIC       0xA7
+#define LZ_FLAG_RESET  BIT(0) /* the window starts empty */
+#define LZ_FLAG_STORED BIT(1) /* the payload is the raw block */
+#define LZ_MIN_MATCH   3
+#define LZ_MAX_MATCH   (LZ_MIN_MATCH + 15)
+#define LZ_WINDOW_MASK (GDO_FS_COMPRESS_WINDOW - 1)
+
+BUILD_ASSERT(GDO_FS_COMPRESS_WINDOW_BITS >= 8 && GDO_FS_COMPRESS_WINDOW_BITS <= 12, "match distance is 12 bits");
+BUILD_ASSERT(GDO_FS_COMPRESS_BLOCK <= UINT16_MAX, "frame lengths are 16 bits");
+BUILD_ASSERT(GDO_FS_COMPRESS_READ_CHUNK <= UINT8_MAX, "reader buffer index is 8 bits");
+
+static const char *const compress_paths[] = {GDO_FS_COMPRESSED_FILES};
+
+/* Encoder side of a file, used under the file write lock */
+struct lz_file {
+  uint8_t history[GDO_FS_COMPRESS_WINDOW]; /* last raw bytes on flash, oldest first */
+  uint16_t history_len;
+  uint16_t frame_len;
+  bool primed; /* history matches the end of the file */
+  uint8_t frame[GDO_FS_COMPRESS_FRAME_MAX];
+};
+
+/* primed and the counters, forget() runs without the file lock */
+K_MUTEX_DEFINE(compressaccess);
+static struct lz_file lz_files[ARRAY_SIZE(compress_paths)];
+static struct gdo_fs_compress_counters compress_counters;
+
+int gdo_fs_compress_find(const char *full_path_file)
+{
+  for (int i = 0; i < (int) ARRAY_SIZE(compress_paths); i++) {
+    if (strcmp(compress_paths[i], full_path_file) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/*==================== encoder ====================*/
+
+/* Byte @p pos of history followed by the block */
+static inline uint8_t lz_byte(const struct lz_file *f, size_t hist, const uint8_t *in, size_t pos)
+{
+  return (pos < hist) ? f->history[pos] : in[pos - hist];
+}
+
+static size_t lz_frame(struct lz_file *f, uint8_t flags, size_t raw_len, size_t payload_len)
+{
+  f->frame[0] = LZ_MAGIC;
+  f->frame[1] = flags;
+  f->frame[2] = raw_len & 0xFF;
+  f->frame[3] = raw_len >> 8;
+  f->frame[4] = payload_len & 0xFF;
+  f->frame[5] = payload_len >> 8;
+  f->frame_len = GDO_FS_COMPRESS_HEADER + payload_len;
+  return f->frame_len;
+}
+
+size_t gdo_fs_compress_encode(int id, const uint8_t *in, size_t len, const uint8_t **frame)
+{
+  struct lz_file *f = &lz_files[id];
+  uint8_t *out      = f->frame + GDO_FS_COMPRESS_HEADER;
+  uint8_t flags     = 0;
+  size_t flag_at    = 0;
+  size_t bit        = 8;
+  size_t o          = 0;
+  size_t hist;
+
+  k_mutex_lock(&compressaccess, K_FOREVER);
+  if (!f->primed) {
+    f->history_len = 0;
+    flags |= LZ_FLAG_RESET;
+  }
+  hist = f->history_len;
+  k_mutex_unlock(&compressaccess);
+  *frame = f->frame;
+
+  for (size_t i = 0; i < len;) {
+    size_t max       = MIN(LZ_MAX_MATCH, len - i);
+    size_t reach     = MIN(GDO_FS_COMPRESS_WINDOW, hist + i);
+    size_t best_len  = 0;
+    size_t best_dist = 0;
+
+    /* brute force over a small window, appends are short */
+    for (size_t dist = 1; dist <= reach && max >= LZ_MIN_MATCH; dist++) {
+      size_t n = 0;
+
+      while (n < max && lz_byte(f, hist, in, hist + i - dist + n) == in[i + n]) {
+        n++;
+      }
+      if (n > best_len) {
+        best_len  = n;
+        best_dist = dist;
+        if (n == max) {
+          break;
+        }
+      }
+    }
+    if (bit == 8) {
+      if (o + 1 >= len) {
+        goto stored;
+      }
+      flag_at      = o++;
+      out[flag_at] = 0;
+      bit          = 0;
+    }
+    if (best_len >= LZ_MIN_MATCH) {
+      if (o + 2 >= len) {
+        goto stored;
+      }
+      out[flag_at] |= BIT(bit);
+      out[o++] = (best_dist - 1) & 0xFF;
+      out[o++] = (((best_dist - 1) >> 8) << 4) | (best_len - LZ_MIN_MATCH);
+      i += best_len;
+    } else {
+      if (o + 1 >= len) {
+        goto stored;
+      }
+      out[o++] = in[i++];
+    }
+    bit++;
+  }
+  return lz_frame(f, flags, len, o);
+
+stored:
+  memcpy(out, in, len);
+  return lz_frame(f, flags | LZ_FLAG_STORED, len, len);
+}
+
+void gdo_fs_compress_commit(int id, const uint8_t *in, size_t len, bool written)
+{
+  struct lz_file *f = &lz_files[id];
+
+  k_mutex_lock(&compressaccess, K_FOREVER);
+  if (!written) {
+    /* the frame may be partly on flash, never reference it */
+    f->primed = false;
+  } else if (len >= GDO_FS_COMPRESS_WINDOW) {
+    memcpy(f->history, in + len - GDO_FS_COMPRESS_WINDOW, GDO_FS_COMPRESS_WINDOW);
+    f->history_len = GDO_FS_COMPRESS_WINDOW;
+    f->primed      = true;
+  } else {
+    size_t keep = MIN(f->history_len, GDO_FS_COMPRESS_WINDOW - len);
+
+    memmove(f->history, f->history + f->history_len - keep, keep);
+    memcpy(f->history + keep, in, len);
+    f->history_len = keep + len;
+    f->primed      = true;
+  }
+  if (written) {
+    compress_counters.raw += len;
+    compress_counters.stored += f->frame_len;
+  }
+  k_mutex_unlock(&compressaccess);
+}
+
+void gdo_fs_compress_forget(const char *full_path_file)
+{
+  int id = (full_path_file != NULL) ? gdo_fs_compress_find(full_path_file) : -1;
+
+  k_mutex_lock(&compressaccess, K_FOREVER);
+  for (int i = 0; i < (int) ARRAY_SIZE(compress_paths); i++) {
+    if (full_path_file == NULL || i == id) {
+      lz_files[i].primed = false;
+    }
+  }
+  k_mutex_unlock(&compressaccess);
+}
+
+void gdo_fs_compress_get_counters(struct gdo_fs_compress_counters *counters)
+{
+  k_mutex_lock(&compressaccess, K_FOREVER);
+  *counters = compress_counters;
+  k_mutex_unlock(&compressaccess);
+}
+
+/*==================== decoder ====================*/
+
+void gdo_fs_lz_reader_init(struct gdo_fs_lz_reader *reader)
+{
+  memset(reader, 0, sizeof(*reader));
+}
+
+/* Next file byte, -ENODATA at the end of the file */
+static int lz_next(struct gdo_fs_lz_reader *r, gdo_fs_lz_source_t source, void *ctx)
+{
+  if (r->in_pos == r->in_len) {
+    int res = source(ctx, r->pos, r->in, sizeof(r->in));
+
+    if (res <= 0) {
+      return (res == 0) ? -ENODATA : -EIO;
+    }
+    r->pos += res;
+    r->in_len = res;
+    r->in_pos = 0;
+  }
+  return r->in[r->in_pos++];
+}
+
+/* Next byte of the current frame payload */
+static int lz_payload(struct gdo_fs_lz_reader *r, gdo_fs_lz_source_t source, void *ctx)
+{
+  if (r->comp_left == 0) {
+    return -EIO;
+  }
+  r->comp_left--;
+  return lz_next(r, source, ctx);
+}
+
+static int lz_frame_begin(struct gdo_fs_lz_reader *r, gdo_fs_lz_source_t source, void *ctx)
+{
+  uint8_t h[GDO_FS_COMPRESS_HEADER];
+
+  for (size_t i = 0; i < sizeof(h); i++) {
+    int c = lz_next(r, source, ctx);
+
+    if (c < 0) {
+      return c;
+    }
+    h[i] = c;
+  }
+  r->frame_flags = h[1];
+  r->raw_left    = h[2] | (h[3] << 8);
+  r->comp_left   = h[4] | (h[5] << 8);
+  if (h[0] != LZ_MAGIC || r->raw_left == 0 || r->raw_left > GDO_FS_COMPRESS_BLOCK ||
+      r->comp_left > GDO_FS_COMPRESS_BLOCK || ((r->frame_flags & LZ_FLAG_STORED) && r->comp_left != r->raw_left)) {
+    return -EIO;
+  }
+  if (r->frame_flags & LZ_FLAG_RESET) {
+    memset(r->window, 0, sizeof(r->window));
+    r->wpos = 0;
+  }
+  r->tokens     = 0;
+  r->match_left = 0;
+  return 0;
+}
+
+static inline void lz_emit(struct gdo_fs_lz_reader *r, uint8_t c, uint8_t *buff, size_t *done)
+{
+  buff[(*done)++]                       = c;
+  r->window[r->wpos++ & LZ_WINDOW_MASK] = c;
+  r->raw_left--;
+}
+
+int gdo_fs_lz_read(struct gdo_fs_lz_reader *r, gdo_fs_lz_source_t source, void *ctx, uint8_t *buff, size_t len)
+{
+  size_t done = 0;
+  int c       = 0;
+
+  while (done < len) {
+    if (r->match_left > 0) {
+      lz_emit(r, r->window[(r->wpos - r->match_dist) & LZ_WINDOW_MASK], buff, &done);
+      r->match_left--;
+      continue;
+    }
+    if (r->raw_left == 0) {
+      if (r->comp_left != 0) {
+        c = -EIO;
+        break;
+      }
+      c = lz_frame_begin(r, source, ctx);
+      if (c < 0) {
+        break;
+      }
+      continue;
+    }
+    if (r->frame_flags & LZ_FLAG_STORED) {
+      c = lz_payload(r, source, ctx);
+      if (c < 0) {
+        break;
+      }
+      lz_emit(r, c, buff, &done);
+      continue;
+    }
+    if (r->tokens == 0) {
+      c = lz_payload(r, source, ctx);
+      if (c < 0) {
+        break;
+      }
+      r->flag   = c;
+      r->tokens = 8;
+    }
+    bool match = r->flag & 1;
+
+    r->flag >>= 1;
+    r->tokens--;
+    c = lz_payload(r, source, ctx);
+    if (c < 0) {
+      break;
+    }
+    if (!match) {
+      lz_emit(r, c, buff, &done);
+      continue;
+    }
+    int c2 = lz_payload(r, source, ctx);
+
+    if (c2 < 0) {
+      c = c2;
+      break;
+    }
+    r->match_dist = (c | ((c2 >> 4) << 8)) + 1;
+    r->match_left = (c2 & 0x0F) + LZ_MIN_MATCH;
+    if (r->match_left > r->raw_left) {
+      c = -EIO;
+      break;
+    }
+  }
+  if (c == -ENODATA) {
+    /* end of the file, or of a frame cut by a power loss during its append */
+    return done;
+  }
+  if (c < 0) {
+    LOG_ERR("FS-LZ: corrupt stream at %u", r->pos);
+    return -EIO;
+  }
+  return done;
+}
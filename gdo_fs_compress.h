@@ -0,0 +1,119 @@
+#ifndef _GDO_FS_COMPRESS_H_
+#define _GDO_FS_COMPRESS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "gdo_config.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Files stored compressed, a comma separated list of full paths, e.g.
+ *   #define GDO_FS_COMPRESSED_FILES GDO_DISK_MOUNT_PT "/audit", GDO_DISK_MOUNT_PT "/history"
+ * Only append (gdo_fs_write_file) and sequential reads (gdo_fs_read_file, gdo_fs_read_file_seq)
+ * are allowed on them. The list must stay the same for the life of the files.
+ */
+#ifndef GDO_FS_COMPRESSED_FILES
+#define GDO_FS_COMPRESSED_FILES
+#endif
+
+/* Match window 1 << bits bytes, 8..12. Costs that much RAM per file and per reader */
+#ifndef GDO_FS_COMPRESS_WINDOW_BITS
+#define GDO_FS_COMPRESS_WINDOW_BITS 8
+#endif
+
+/* Largest raw block compressed into one frame, longer appends are split */
+#ifndef GDO_FS_COMPRESS_BLOCK
+#define GDO_FS_COMPRESS_BLOCK 256
+#endif
+
+/* File bytes a reader fetches at once */
+#ifndef GDO_FS_COMPRESS_READ_CHUNK
+#define GDO_FS_COMPRESS_READ_CHUNK 32
+#endif
+
+#define GDO_FS_COMPRESS_WINDOW     (1 << GDO_FS_COMPRESS_WINDOW_BITS)
+#define GDO_FS_COMPRESS_HEADER     6
+#define GDO_FS_COMPRESS_FRAME_MAX  (GDO_FS_COMPRESS_HEADER + GDO_FS_COMPRESS_BLOCK)
+
+/*
+ * LZSS frames, one or more per append:
+ *   u8 magic, u8 flags, u16 raw length, u16 payload length (little endian), payload.
+ * The payload is groups of a flag byte and 8 tokens, bit clear: one literal byte, bit set: a
+ * 2 byte match of 3..18 bytes up to GDO_FS_COMPRESS_WINDOW back. A block that does not shrink
+ * is stored as is. Matches reach back into the previous appends of the file, so short similar
+ * events compress against each other; the first frame written after a boot, or after the file
+ * was recreated, starts a new window.
+ */
+
+/* Sequential reader, gdo_fs_lz_reader_init() before the first read */
+struct gdo_fs_lz_reader {
+  size_t pos; /* file offset of the next byte fetched */
+  uint8_t in[GDO_FS_COMPRESS_READ_CHUNK];
+  uint8_t in_pos;
+  uint8_t in_len;
+  uint8_t window[GDO_FS_COMPRESS_WINDOW];
+  uint16_t wpos;
+  uint16_t raw_left;  /* of the current frame */
+  uint16_t comp_left; /* of the current frame */
+  uint8_t frame_flags;
+  uint8_t flag;
+  uint8_t tokens;
+  uint16_t match_dist;
+  uint8_t match_left;
+};
+
+/* Fetches up to @p len file bytes at @p pos, returns the count (0 at the end) or < 0 */
+typedef int (*gdo_fs_lz_source_t)(void *ctx, size_t pos, uint8_t *buff, size_t len);
+
+struct gdo_fs_compress_counters {
+  uint32_t raw;    /* bytes appended */
+  uint32_t stored; /* bytes written for them, headers included */
+};
+
+/**
+ * @brief Id of a compressed file, or -1.
+ */
+int gdo_fs_compress_find(const char *full_path_file);
+
+/**
+ * @brief Compress @p len <= GDO_FS_COMPRESS_BLOCK bytes appended to file @p id into one frame.
+ *
+ * The frame lives in a buffer of the file, valid until the next call for the same file. Called
+ * with the file write lock held.
+ *
+ * @return Frame length.
+ */
+size_t gdo_fs_compress_encode(int id, const uint8_t *in, size_t len, const uint8_t **frame);
+
+/**
+ * @brief The frame of @p in was @p written or not, the window follows what is on flash.
+ */
+void gdo_fs_compress_commit(int id, const uint8_t *in, size_t len, bool written);
+
+/**
+ * @brief The file was recreated, removed or renamed (NULL: every file), its next frame starts a
+ *        new window.
+ */
+void gdo_fs_compress_forget(const char *full_path_file);
+
+void gdo_fs_lz_reader_init(struct gdo_fs_lz_reader *reader);
+
+/**
+ * @brief Decompress the next bytes of a file read through @p source.
+ *
+ * A frame cut by a power loss during its append ends the stream.
+ *
+ * @return Bytes decompressed into @p buff, 0 at the end, -EIO on corrupt data or a failed fetch.
+ */
+int gdo_fs_lz_read(struct gdo_fs_lz_reader *reader, gdo_fs_lz_source_t source, void *ctx, uint8_t *buff, size_t len);
+
+void gdo_fs_compress_get_counters(struct gdo_fs_compress_counters *counters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
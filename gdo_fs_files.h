@@ -0,0 +1,128 @@
+#ifndef _GDO_FS_FILES_H_
+#define _GDO_FS_FILES_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_schedule.h"
+#include "gdo_user_infor_util.h"
+#include "gdo_file_system_util.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* What gdo_fs_delete_file() and a boot reset do to a file */
+enum gdo_fs_file_reset {
+  GDO_FILE_RESET_EMPTY = 0, /* recreated at its full size, every record reads as zeros */
+  GDO_FILE_RESET_KEEP,      /* left as it is */
+  GDO_FILE_RESET_SCHEDULES, /* as EMPTY, and gdo_schedule_store_clear() empties the journaled store */
+  GDO_FILE_RESET_USERS,     /* as EMPTY, after gdo_user_bulk_discard() drops a staged batch */
+};
+
+/*
+ * The fixed record files of the firmware, one line per file:
+ *   X(id, full path, record size, record count, GDO_FS_INIT_TYPE bit that resets it, reset policy)
+ * The file layer provisions them at boot and resets them from this list.
+ */
+#define GDO_FS_FILE_LIST(X)                                                                                         \
+  X(GDO_FILE_USERS, GDO_USER_INFOR_FULL_PATH, sizeof(gdo_user_infor), GDO_MAX_USER_SUPORT, GDO_FS_USER_INFO,         \
+    GDO_FILE_RESET_USERS)                                                                                           \
+  X(GDO_FILE_SCHEDULE, SCHEDULE_CURRENT_FILE_FULL_PATH, sizeof(struct schedule_data), SCHEDULE_NUM, GDO_FS_SCHEDULE, \
+    GDO_FILE_RESET_SCHEDULES)                                                                                       \
+  X(GDO_FILE_SCHEDULE_BACKUP, SCHEDULE_BACKUP_FILE_FULL_PATH, sizeof(struct schedule_data), SCHEDULE_NUM,           \
+    GDO_FS_SCHEDULE, GDO_FILE_RESET_EMPTY)                                                                          \
+  X(GDO_FILE_HOME_CFG, HOME_CFG_FILE_FULL_PATH, HOME_CFG_FILE_SIZE, 1, GDO_FS_HOME_CFG, GDO_FILE_RESET_EMPTY)
+
+#define GDO_FS_FILE_ID(id, path, record_size, record_count, reset_on, reset) id,
+
+enum gdo_file_id {
+  GDO_FS_FILE_LIST(GDO_FS_FILE_ID) GDO_FILE_NUM,
+};
+
+struct gdo_fs_file_desc {
+  const char *path;
+  size_t record_size;
+  size_t record_count;
+  uint8_t reset_on; /* GDO_FS_INIT_TYPE bits */
+  uint8_t reset;    /* enum gdo_fs_file_reset */
+};
+
+#define GDO_FS_FILE_DESC(id, path, record_size, record_count, reset_on, reset)                                      \
+  [id] = {path, record_size, record_count, reset_on, reset},
+
+/* Constant, so a lookup with a constant id folds to the values */
+static const struct gdo_fs_file_desc gdo_fs_files[GDO_FILE_NUM] = {GDO_FS_FILE_LIST(GDO_FS_FILE_DESC)};
+
+static inline size_t gdo_fs_file_size_of(enum gdo_file_id id)
+{
+  return gdo_fs_files[id].record_size * gdo_fs_files[id].record_count;
+}
+
+/**
+ * @brief Id of the file at @p full_path_file, or -1 if it is not in the registry.
+ */
+static inline int gdo_fs_file_find(const char *full_path_file)
+{
+  for (int id = 0; id < GDO_FILE_NUM; id++) {
+    if (strcmp(gdo_fs_files[id].path, full_path_file) == 0) {
+      return id;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief gdo_fs_read_file_index() of file @p id.
+ *
+ * The per file state of the file layer is indexed by the id, so unlike the path API this
+ * compares no path. -EINVAL if @p id is out of range.
+ */
+int gdo_fs_read_file_id(enum gdo_file_id id, void *buff, size_t len, size_t index);
+
+/**
+ * @brief gdo_fs_write_file_index() of file @p id, see gdo_fs_read_file_id().
+ */
+int gdo_fs_write_file_id(enum gdo_file_id id, const void *buff, size_t len, size_t index);
+
+/**
+ * @brief Read record @p idx of file @p id into @p buff (record_size bytes).
+ *
+ * @return The record size, -EINVAL if @p id or @p idx is out of range, -1 if the read failed.
+ */
+static inline int gdo_fs_read_record(enum gdo_file_id id, size_t idx, void *buff)
+{
+  if ((unsigned int) id >= GDO_FILE_NUM || idx >= gdo_fs_files[id].record_count) {
+    return -EINVAL;
+  }
+  return gdo_fs_read_file_id(id, buff, gdo_fs_files[id].record_size, idx * gdo_fs_files[id].record_size);
+}
+
+/**
+ * @brief Write record @p idx of file @p id from @p buff (record_size bytes).
+ *
+ * @return The record size, -EINVAL if @p id or @p idx is out of range, -1 if the write failed.
+ */
+static inline int gdo_fs_write_record(enum gdo_file_id id, size_t idx, const void *buff)
+{
+  if ((unsigned int) id >= GDO_FILE_NUM || idx >= gdo_fs_files[id].record_count) {
+    return -EINVAL;
+  }
+  return gdo_fs_write_file_id(id, buff, gdo_fs_files[id].record_size, idx * gdo_fs_files[id].record_size);
+}
+
+/**
+ * @brief Apply the reset policy of file @p id.
+ *
+ * @return true on success or for a GDO_FILE_RESET_KEEP file, false if @p id is out of range or
+ *         the file could not be recreated.
+ */
+bool gdo_fs_reset_file(enum gdo_file_id id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
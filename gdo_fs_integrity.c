@@ -0,0 +1,430 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include "gdo_config.h"
+#include "gdo_fs_integrity.h"
+
+#if (GDO_FS_INTEGRITY)
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+#include "gdo_file_system_util.h"
+#include "gdo_fs_async.h"
+#include "gdo_fs_lock.h"
+#include "gdo_fs_files.h"
+#include "gdo_user_infor_util.h"
+#include "gdo_schedule.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+/* Records are hashed in pieces of this size, on the stack */
+#define INTEGRITY_CHUNK 64
+
+/* Stored CRC of a record that was never sealed, the check passes */
+#define INTEGRITY_UNSEALED 0
+
+struct integrity_file {
+  const char *path;
+  const char *crc_path;
+  const char *backup_path; /* same layout, NULL if none */
+  size_t record_size;
+  size_t count;
+  size_t first; /* first entry in crc_pool */
+};
+
+/* Indexed by enum gdo_file_id */
+static const struct integrity_file integrity_files[] = {
+    [GDO_FILE_USERS] = {GDO_USER_INFOR_FULL_PATH, GDO_FS_INTEGRITY_SIDECAR(GDO_USER_INFOR_FULL_PATH), NULL,
+                        sizeof(gdo_user_infor), GDO_MAX_USER_SUPORT, 0},
+    [GDO_FILE_SCHEDULE] = {SCHEDULE_CURRENT_FILE_FULL_PATH, GDO_FS_INTEGRITY_SIDECAR(SCHEDULE_CURRENT_FILE_FULL_PATH),
+                           SCHEDULE_BACKUP_FILE_FULL_PATH, sizeof(struct schedule_data), SCHEDULE_NUM,
+                           GDO_MAX_USER_SUPORT},
+    [GDO_FILE_SCHEDULE_BACKUP] = {SCHEDULE_BACKUP_FILE_FULL_PATH,
+                                  GDO_FS_INTEGRITY_SIDECAR(SCHEDULE_BACKUP_FILE_FULL_PATH),
+                                  SCHEDULE_CURRENT_FILE_FULL_PATH, sizeof(struct schedule_data), SCHEDULE_NUM,
+                                  GDO_MAX_USER_SUPORT + SCHEDULE_NUM},
+    [GDO_FILE_HOME_CFG] = {HOME_CFG_FILE_FULL_PATH, GDO_FS_INTEGRITY_SIDECAR(HOME_CFG_FILE_FULL_PATH), NULL,
+                           HOME_CFG_FILE_SIZE, 1, GDO_MAX_USER_SUPORT + 2 * SCHEDULE_NUM},
+};
+BUILD_ASSERT(ARRAY_SIZE(integrity_files) == GDO_FILE_NUM, "one entry per registry file");
+
+#define INTEGRITY_RECORDS (GDO_MAX_USER_SUPORT + 2 * SCHEDULE_NUM + 1)
+
+/* RAM copy of the sidecars plus per record state, only touched under integrityaccess (never held over I/O) */
+K_MUTEX_DEFINE(integrityaccess);
+static uint32_t crc_pool[INTEGRITY_RECORDS];
+static uint8_t verified_pool[(INTEGRITY_RECORDS + 7) / 8];
+static uint8_t bad_pool[(INTEGRITY_RECORDS + 7) / 8];
+static struct gdo_fs_integrity_counters counters;
+
+static struct k_work_delayable scrub_work;
+static size_t scrub_cursor;
+static uint32_t last_foreground;
+
+static const struct integrity_file *integrity_get(int id)
+{
+  return (id >= 0 && id < GDO_FILE_NUM) ? &integrity_files[id] : NULL;
+}
+
+static const struct integrity_file *integrity_find(const char *full_path_file)
+{
+  return integrity_get(gdo_fs_file_find(full_path_file));
+}
+
+static bool pool_test(const uint8_t *pool, size_t n)
+{
+  return pool[n / 8] & BIT(n % 8);
+}
+
+static void pool_set(uint8_t *pool, size_t n, bool on)
+{
+  if (on) {
+    pool[n / 8] |= BIT(n % 8);
+  } else {
+    pool[n / 8] &= ~BIT(n % 8);
+  }
+}
+
+static uint32_t integrity_seal_value(uint32_t crc)
+{
+  return (crc == INTEGRITY_UNSEALED) ? 1 : crc;
+}
+
+/* CRC of record r as stored in the file, without the read check */
+static int integrity_record_crc(const struct integrity_file *f, size_t r, uint32_t *crc, bool *all_zero)
+{
+  uint8_t chunk[INTEGRITY_CHUNK];
+  uint32_t value = 0;
+  bool zero      = true;
+
+  for (size_t pos = 0; pos < f->record_size; pos += sizeof(chunk)) {
+    size_t n = MIN(sizeof(chunk), f->record_size - pos);
+
+    if (gdo_fs_read_file_index_raw(f->path, chunk, n, r * f->record_size + pos) != n) {
+      return -EIO;
+    }
+    value = crc32_ieee_update(value, chunk, n);
+    for (size_t i = 0; i < n && zero; i++) {
+      zero = (chunk[i] == 0);
+    }
+  }
+  *crc = integrity_seal_value(value);
+  if (all_zero != NULL) {
+    *all_zero = zero;
+  }
+  return 0;
+}
+
+/* Writes the RAM entries [first, last] of a file to its sidecar */
+static void integrity_store(const struct integrity_file *f, size_t first, size_t last)
+{
+  uint32_t crcs[8];
+
+  for (size_t r = first; r <= last;) {
+    size_t n = MIN(ARRAY_SIZE(crcs), last + 1 - r);
+
+    k_mutex_lock(&integrityaccess, K_FOREVER);
+    memcpy(crcs, &crc_pool[f->first + r], n * sizeof(crcs[0]));
+    k_mutex_unlock(&integrityaccess);
+    if (gdo_fs_write_file_index(GDO_DISK_MOUNT_PT, f->crc_path, crcs, n * sizeof(crcs[0]), r * sizeof(crcs[0])) < 0) {
+      LOG_ERR("FS-Integrity: store %s", f->crc_path);
+      return;
+    }
+    r += n;
+  }
+}
+
+static void integrity_touch(void)
+{
+  last_foreground = k_uptime_get_32();
+}
+
+int gdo_fs_integrity_verify(int id, const void *buff, size_t len, size_t index)
+{
+  const struct integrity_file *f = integrity_get(id);
+  const uint8_t *data            = buff;
+  int res                        = 0;
+
+  if (f == NULL) {
+    return 0;
+  }
+  integrity_touch();
+  /* only records the read covers completely can be checked */
+  for (size_t r = DIV_ROUND_UP(index, f->record_size); r < f->count && (r + 1) * f->record_size <= index + len;
+       r++) {
+    size_t n = f->first + r;
+
+    k_mutex_lock(&integrityaccess, K_FOREVER);
+    uint32_t stored = crc_pool[n];
+    bool trusted    = GDO_FS_INTEGRITY_TRUST_VERIFIED && pool_test(verified_pool, n);
+    k_mutex_unlock(&integrityaccess);
+    if (stored == INTEGRITY_UNSEALED || trusted) {
+      continue;
+    }
+    uint32_t crc = integrity_seal_value(crc32_ieee(&data[r * f->record_size - index], f->record_size));
+
+    k_mutex_lock(&integrityaccess, K_FOREVER);
+    counters.checked++;
+    if (crc == crc_pool[n]) {
+      pool_set(verified_pool, n, true);
+    } else if (stored == crc_pool[n]) {
+      /* not rewritten meanwhile, so the data on flash is really bad */
+      counters.failed++;
+      pool_set(bad_pool, n, true);
+      res = -EBADMSG;
+    }
+    k_mutex_unlock(&integrityaccess);
+    if (res == -EBADMSG) {
+      LOG_ERR("FS-Integrity: %s record %u CRC mismatch", f->path, r);
+    }
+  }
+  if (res != 0) {
+    gdo_fs_async_schedule(&scrub_work, K_NO_WAIT);
+  }
+  return res;
+}
+
+void gdo_fs_integrity_on_write(int id, const void *buff, size_t len, size_t index)
+{
+  const struct integrity_file *f = integrity_get(id);
+  const uint8_t *data            = buff;
+
+  if (f == NULL || len == 0 || index >= f->count * f->record_size) {
+    return;
+  }
+  integrity_touch();
+  size_t first = index / f->record_size;
+  size_t last  = MIN((index + len - 1) / f->record_size, f->count - 1);
+  for (size_t r = first; r <= last; r++) {
+    size_t start = r * f->record_size;
+    uint32_t crc = INTEGRITY_UNSEALED;
+
+    if (data != NULL && start >= index && start + f->record_size <= index + len) {
+      crc = integrity_seal_value(crc32_ieee(&data[start - index], f->record_size));
+    } else if (integrity_record_crc(f, r, &crc, NULL) != 0) {
+      /* left unsealed, the scrubber seals it later */
+      crc = INTEGRITY_UNSEALED;
+    }
+    k_mutex_lock(&integrityaccess, K_FOREVER);
+    crc_pool[f->first + r] = crc;
+    pool_set(verified_pool, f->first + r, true);
+    pool_set(bad_pool, f->first + r, false);
+    k_mutex_unlock(&integrityaccess);
+  }
+  integrity_store(f, first, last);
+}
+
+void gdo_fs_integrity_forget(const char *full_path_file)
+{
+  k_mutex_lock(&integrityaccess, K_FOREVER);
+  for (size_t i = 0; i < ARRAY_SIZE(integrity_files); i++) {
+    const struct integrity_file *f = &integrity_files[i];
+
+    if (full_path_file != NULL && strcmp(f->path, full_path_file) != 0) {
+      continue;
+    }
+    for (size_t r = 0; r < f->count; r++) {
+      crc_pool[f->first + r] = INTEGRITY_UNSEALED;
+      pool_set(verified_pool, f->first + r, false);
+      pool_set(bad_pool, f->first + r, false);
+    }
+  }
+  k_mutex_unlock(&integrityaccess);
+}
+
+void gdo_fs_integrity_on_reset(const char *full_path_file)
+{
+  const struct integrity_file *f = integrity_find(full_path_file);
+
+  if (f == NULL) {
+    return;
+  }
+  gdo_fs_integrity_forget(full_path_file);
+  if (!gdo_fs_create_file(f->crc_path, f->count * sizeof(uint32_t))) {
+    LOG_ERR("FS-Integrity: reset %s", f->crc_path);
+  }
+}
+
+void gdo_fs_integrity_get_counters(struct gdo_fs_integrity_counters *out)
+{
+  k_mutex_lock(&integrityaccess, K_FOREVER);
+  *out = counters;
+  k_mutex_unlock(&integrityaccess);
+}
+
+/*==================== scrubber ====================*/
+
+static int integrity_copy_record(const struct integrity_file *from, const struct integrity_file *to, size_t r)
+{
+  uint8_t chunk[INTEGRITY_CHUNK];
+
+  for (size_t pos = 0; pos < from->record_size; pos += sizeof(chunk)) {
+    size_t n     = MIN(sizeof(chunk), from->record_size - pos);
+    size_t index = r * from->record_size + pos;
+
+    if (gdo_fs_read_file_index_raw(from->path, chunk, n, index) != n ||
+        gdo_fs_write_file_index(GDO_DISK_MOUNT_PT, to->path, chunk, n, index) != n) {
+      return -EIO;
+    }
+  }
+  return 0;
+}
+
+/* Called with the write lock of the file, and the lock of its backup when it has one */
+static void integrity_scrub_locked(const struct integrity_file *f, size_t r)
+{
+  size_t n = f->first + r;
+  uint32_t crc;
+  bool all_zero;
+
+  if (integrity_record_crc(f, r, &crc, &all_zero) != 0) {
+    return;
+  }
+  k_mutex_lock(&integrityaccess, K_FOREVER);
+  uint32_t stored = crc_pool[n];
+  counters.checked++;
+  if (stored == crc) {
+    pool_set(verified_pool, n, true);
+    pool_set(bad_pool, n, false);
+  }
+  k_mutex_unlock(&integrityaccess);
+  if (stored == crc) {
+    return;
+  }
+  if (stored == INTEGRITY_UNSEALED) {
+    /* seal what is there, an empty record stays unsealed so a reset costs no sidecar writes */
+    if (!all_zero) {
+      k_mutex_lock(&integrityaccess, K_FOREVER);
+      crc_pool[n] = crc;
+      k_mutex_unlock(&integrityaccess);
+      integrity_store(f, r, r);
+    }
+    return;
+  }
+
+  const struct integrity_file *backup = (f->backup_path != NULL) ? integrity_find(f->backup_path) : NULL;
+  uint32_t backup_crc;
+  bool repaired = false;
+
+  if (backup != NULL && integrity_record_crc(backup, r, &backup_crc, NULL) == 0) {
+    k_mutex_lock(&integrityaccess, K_FOREVER);
+    bool backup_good = (crc_pool[backup->first + r] == backup_crc);
+    k_mutex_unlock(&integrityaccess);
+    /* the copy rewrites the record, on_write seals it again */
+    repaired = backup_good && integrity_copy_record(backup, f, r) == 0;
+  }
+  k_mutex_lock(&integrityaccess, K_FOREVER);
+  counters.failed++;
+  if (repaired) {
+    counters.repaired++;
+  } else {
+    counters.unrepairable++;
+  }
+  /* not retried every step, the next pass of the cursor checks it again */
+  pool_set(bad_pool, n, false);
+  k_mutex_unlock(&integrityaccess);
+  if (repaired) {
+    LOG_INF("FS-Integrity: %s record %u restored from %s", f->path, r, backup->path);
+  } else {
+    LOG_ERR("FS-Integrity: %s record %u is corrupt, no good copy", f->path, r);
+  }
+}
+
+/*
+ * The write lock of the file is held from the check to the repair, so a foreground write cannot
+ * land in between and be overwritten with the older backup copy. The backup is locked for writing
+ * too, a held read lock cannot be re-entered past a queued writer. Both files are locked as a
+ * pair like gdo_fs_rename() does; the sidecar locks taken under them have fixed entries.
+ */
+static void integrity_scrub_record(const struct integrity_file *f, size_t r)
+{
+  struct gdo_fs_lock *first;
+  struct gdo_fs_lock *second = NULL;
+
+  if (f->backup_path == NULL) {
+    first = gdo_fs_lock_acquire(f->path, GDO_FS_LOCK_WRITE);
+  } else {
+    gdo_fs_lock_acquire_pair(f->path, f->backup_path, &first, &second);
+  }
+  integrity_scrub_locked(f, r);
+  if (second != NULL) {
+    gdo_fs_lock_release(second);
+  }
+  gdo_fs_lock_release(first);
+}
+
+/* Next record to check: a record flagged by a failed read first, else the round robin cursor */
+static size_t integrity_scrub_next(void)
+{
+  size_t n = INTEGRITY_RECORDS;
+
+  k_mutex_lock(&integrityaccess, K_FOREVER);
+  for (size_t i = 0; i < ARRAY_SIZE(bad_pool) && n == INTEGRITY_RECORDS; i++) {
+    if (bad_pool[i] != 0) {
+      n = i * 8 + __builtin_ctz(bad_pool[i]);
+    }
+  }
+  k_mutex_unlock(&integrityaccess);
+  if (n < INTEGRITY_RECORDS) {
+    return n;
+  }
+  n            = scrub_cursor;
+  scrub_cursor = (scrub_cursor + 1) % INTEGRITY_RECORDS;
+  return n;
+}
+
+static void integrity_scrub(struct k_work *work)
+{
+  uint32_t idle = k_uptime_get_32() - last_foreground;
+
+  if (idle < GDO_FS_SCRUB_IDLE_MS) {
+    /* foreground traffic on the checked files, come back once it settled */
+    gdo_fs_async_schedule(&scrub_work, K_MSEC(GDO_FS_SCRUB_IDLE_MS - idle));
+    return;
+  }
+  for (int i = 0; i < GDO_FS_SCRUB_RECORDS; i++) {
+    size_t n = integrity_scrub_next();
+
+    for (size_t k = 0; k < ARRAY_SIZE(integrity_files); k++) {
+      const struct integrity_file *f = &integrity_files[k];
+
+      if (n >= f->first && n < f->first + f->count) {
+        integrity_scrub_record(f, n - f->first);
+        break;
+      }
+    }
+  }
+  gdo_fs_async_schedule(&scrub_work, K_MSEC(GDO_FS_SCRUB_PERIOD_MS));
+}
+
+int gdo_fs_integrity_init(void)
+{
+  for (size_t i = 0; i < ARRAY_SIZE(integrity_files); i++) {
+    const struct integrity_file *f = &integrity_files[i];
+    size_t size                    = f->count * sizeof(uint32_t);
+
+    if (gdo_fs_file_size(f->crc_path) == (int) size &&
+        gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, f->crc_path, &crc_pool[f->first], size, 0) == size) {
+      continue;
+    }
+    /* no usable sidecar: start unsealed, the scrubber seals the records */
+    memset(&crc_pool[f->first], 0, size);
+    if (!gdo_fs_create_file(f->crc_path, size)) {
+      LOG_ERR("FS-Integrity: create %s", f->crc_path);
+      return -EIO;
+    }
+  }
+  k_work_init_delayable(&scrub_work, integrity_scrub);
+  return gdo_fs_async_schedule(&scrub_work, K_MSEC(GDO_FS_SCRUB_PERIOD_MS)) < 0 ? -EIO : 0;
+}
+#endif
@@ -0,0 +1,113 @@
+#ifndef _GDO_FS_INTEGRITY_H_
+#define _GDO_FS_INTEGRITY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 1: CRC32 per fixed size record of the user, schedule and home config files, kept in a
+ * "<file>.crc" sidecar and checked on read, plus an idle scrubber that re-checks every record
+ * and repairs a schedule record from the other schedule copy.
+ */
+#ifndef GDO_FS_INTEGRITY
+#define GDO_FS_INTEGRITY 0
+#endif
+
+/* 1: a record that passed the check is trusted until it is written again */
+#ifndef GDO_FS_INTEGRITY_TRUST_VERIFIED
+#define GDO_FS_INTEGRITY_TRUST_VERIFIED 1
+#endif
+
+/* Records checked per scrub step */
+#ifndef GDO_FS_SCRUB_RECORDS
+#define GDO_FS_SCRUB_RECORDS 2
+#endif
+
+/* Time between scrub steps */
+#ifndef GDO_FS_SCRUB_PERIOD_MS
+#define GDO_FS_SCRUB_PERIOD_MS 2000
+#endif
+
+/* A step only runs after this long without foreground access to the checked files */
+#ifndef GDO_FS_SCRUB_IDLE_MS
+#define GDO_FS_SCRUB_IDLE_MS 500
+#endif
+
+/* CRC sidecar of a record file */
+#define GDO_FS_INTEGRITY_SIDECAR(path) path ".crc"
+
+struct gdo_fs_integrity_counters {
+  uint32_t checked;      /* records checked, on read or by the scrubber */
+  uint32_t failed;       /* CRC mismatches */
+  uint32_t repaired;     /* records restored from the backup copy */
+  uint32_t unrepairable; /* mismatches without a good backup */
+};
+
+#if (GDO_FS_INTEGRITY)
+/**
+ * @brief Load the CRC sidecars (creating missing ones) and start the scrubber.
+ *
+ * Called by gdo_file_system_init after the storage queue is up. Records without a stored CRC
+ * (new sidecar, data written before the layer was enabled) are sealed by the scrubber.
+ *
+ * @return 0 or a negative error code.
+ */
+int gdo_fs_integrity_init(void);
+
+/**
+ * @brief Check the records fully covered by a read of @p len bytes at @p index of file @p id.
+ *
+ * Called by the read functions of the file system layer with the data just read. @p id is the
+ * enum gdo_file_id of the file, any other value is a file without CRCs.
+ *
+ * @return 0, or -EBADMSG if a record does not match its CRC (the scrubber is woken to repair it).
+ */
+int gdo_fs_integrity_verify(int id, const void *buff, size_t len, size_t index);
+
+/**
+ * @brief Re-seal the records touched by a write that succeeded, from the caller's file write lock.
+ *
+ * With @p buff NULL (a write that failed part way) the records are read back from the file.
+ */
+void gdo_fs_integrity_on_write(int id, const void *buff, size_t len, size_t index);
+
+/**
+ * @brief The file was recreated: drop its CRCs and recreate the sidecar.
+ */
+void gdo_fs_integrity_on_reset(const char *full_path_file);
+
+/**
+ * @brief The file is gone (NULL: every file), drop its CRCs from RAM only.
+ */
+void gdo_fs_integrity_forget(const char *full_path_file);
+
+void gdo_fs_integrity_get_counters(struct gdo_fs_integrity_counters *counters);
+#else
+static inline int gdo_fs_integrity_init(void)
+{
+  return 0;
+}
+static inline int gdo_fs_integrity_verify(int id, const void *buff, size_t len, size_t index)
+{
+  return 0;
+}
+static inline void gdo_fs_integrity_on_write(int id, const void *buff, size_t len, size_t index)
+{
+}
+static inline void gdo_fs_integrity_on_reset(const char *full_path_file)
+{
+}
+static inline void gdo_fs_integrity_forget(const char *full_path_file)
+{
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,395 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_fs_lock.h"
+#include "gdo_fs_files.h"
+#include "gdo_fs_integrity.h"
+#include "gdo_user_store.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+struct gdo_fs_lock {
+  char path[GDO_FS_MAX_PATH_LEN];
+  uint16_t refs; /* holders and waiters, the slot is free at 0 */
+  uint16_t readers;
+  uint16_t writers_waiting;
+  uint16_t write_depth;
+  k_tid_t writer;
+};
+
+K_MUTEX_DEFINE(lock_table_mutex);
+K_CONDVAR_DEFINE(lock_table_cond);
+
+/*
+ * Files the file layer locks while it already holds a lock: the CRC sidecars (under the lock
+ * of their file) and the split user files (under the lock of the user table). They have a
+ * fixed entry, after the registry files, like the registry files the scrubber nests.
+ */
+#define LOCK_SIDECAR(id, path, record_size, record_count, reset_on, reset) GDO_FS_INTEGRITY_SIDECAR(path),
+
+static const char *const lock_nested_paths[] = {
+#if (GDO_FS_INTEGRITY)
+    GDO_FS_FILE_LIST(LOCK_SIDECAR)
+#endif
+#if (GDO_USER_STORE_SPLIT)
+    GDO_USER_HOT_FULL_PATH,
+    GDO_USER_COLD_FULL_PATH,
+#endif
+};
+
+#define LOCK_FIXED (GDO_FILE_NUM + ARRAY_SIZE(lock_nested_paths))
+
+/*
+ * [0, GDO_FILE_NUM) by enum gdo_file_id, then lock_nested_paths, then GDO_FS_LOCK_SLOTS shared
+ * by any other path. Only a caller holding no lock waits for a shared entry (a pair is taken in
+ * one go), so the table never runs out under a holder that others wait for.
+ */
+static struct gdo_fs_lock lock_table[LOCK_FIXED + GDO_FS_LOCK_SLOTS];
+/* holder of gdo_fs_lock_exclusive(), other threads wait before taking a slot */
+static k_tid_t lock_table_owner;
+
+BUILD_ASSERT(GDO_FS_LOCK_SLOTS >= 2, "a rename of two files takes two shared entries");
+
+/* Fixed entry of @p full_path_file, or -1 if it takes a shared one */
+static int lock_fixed_find(const char *full_path_file)
+{
+  int id = gdo_fs_file_find(full_path_file);
+
+  for (int i = 0; id < 0 && i < ARRAY_SIZE(lock_nested_paths); i++) {
+    if (strcmp(lock_nested_paths[i], full_path_file) == 0) {
+      id = GDO_FILE_NUM + i;
+    }
+  }
+  return id;
+}
+
+#if defined(CONFIG_ASSERT)
+/* Caller holds lock_table_mutex, readers are not tracked per thread */
+static bool lock_held_by(k_tid_t thread)
+{
+  for (int i = 0; i < ARRAY_SIZE(lock_table); i++) {
+    if (lock_table[i].writer == thread) {
+      return true;
+    }
+  }
+  return false;
+}
+#endif
+
+/* Caller holds lock_table_mutex */
+static struct gdo_fs_lock *lock_entry_get(int id, const char *full_path_file)
+{
+  struct gdo_fs_lock *free_entry = NULL;
+
+  if (id >= 0) {
+    return &lock_table[id];
+  }
+  for (int i = LOCK_FIXED; i < ARRAY_SIZE(lock_table); i++) {
+    if (lock_table[i].refs == 0) {
+      if (free_entry == NULL) {
+        free_entry = &lock_table[i];
+      }
+      continue;
+    }
+    if (strcmp(lock_table[i].path, full_path_file) == 0) {
+      return &lock_table[i];
+    }
+  }
+  if (free_entry != NULL) {
+    strncpy(free_entry->path, full_path_file, GDO_FS_MAX_PATH_LEN - 1);
+    free_entry->path[GDO_FS_MAX_PATH_LEN - 1] = '\0';
+  }
+  return free_entry;
+}
+
+/* Caller holds lock_table_mutex and a reference on the entry */
+static void lock_wait(struct gdo_fs_lock *lock, k_tid_t self, enum gdo_fs_lock_mode mode)
+{
+  if (lock->writer == self) {
+    lock->write_depth++;
+  } else if (mode == GDO_FS_LOCK_WRITE) {
+    lock->writers_waiting++;
+    while (lock->readers > 0 || lock->writer != NULL) {
+      k_condvar_wait(&lock_table_cond, &lock_table_mutex, K_FOREVER);
+    }
+    lock->writers_waiting--;
+    lock->writer      = self;
+    lock->write_depth = 1;
+  } else {
+    while (lock->writer != NULL || lock->writers_waiting > 0) {
+      k_condvar_wait(&lock_table_cond, &lock_table_mutex, K_FOREVER);
+    }
+    lock->readers++;
+  }
+}
+
+static struct gdo_fs_lock *lock_acquire(int id, const char *full_path_file, enum gdo_fs_lock_mode mode)
+{
+  struct gdo_fs_lock *lock;
+  k_tid_t self = k_current_get();
+
+  k_mutex_lock(&lock_table_mutex, K_FOREVER);
+  while ((lock_table_owner != NULL && lock_table_owner != self) ||
+         (lock = lock_entry_get(id, full_path_file)) == NULL) {
+    /* a nested lock of a path without a fixed entry could wait on its own holder */
+    __ASSERT(!lock_held_by(self), "no free lock entry for nested %s", full_path_file);
+    k_condvar_wait(&lock_table_cond, &lock_table_mutex, K_FOREVER);
+  }
+  lock->refs++;
+  lock_wait(lock, self, mode);
+  k_mutex_unlock(&lock_table_mutex);
+  return lock;
+}
+
+struct gdo_fs_lock *gdo_fs_lock_acquire(const char *full_path_file, enum gdo_fs_lock_mode mode)
+{
+  /* a registry file maps to its own entry, whichever API locks it */
+  return lock_acquire(lock_fixed_find(full_path_file), full_path_file, mode);
+}
+
+void gdo_fs_lock_acquire_pair(const char *path_a, const char *path_b, struct gdo_fs_lock **lock_a,
+                              struct gdo_fs_lock **lock_b)
+{
+  int id_a     = lock_fixed_find(path_a);
+  int id_b     = lock_fixed_find(path_b);
+  bool a_first = strcmp(path_a, path_b) <= 0;
+  k_tid_t self = k_current_get();
+  struct gdo_fs_lock *a;
+  struct gdo_fs_lock *b = NULL;
+
+  k_mutex_lock(&lock_table_mutex, K_FOREVER);
+  for (;;) {
+    a = NULL;
+    if (lock_table_owner == NULL || lock_table_owner == self) {
+      a = lock_entry_get(id_a, path_a);
+    }
+    if (a != NULL) {
+      /* referenced first, so the second lookup cannot hand out the same free entry */
+      a->refs++;
+      b = lock_entry_get(id_b, path_b);
+      if (b != NULL) {
+        break;
+      }
+      a->refs--;
+    }
+    __ASSERT(!lock_held_by(self), "no free lock entries for nested %s and %s", path_a, path_b);
+    k_condvar_wait(&lock_table_cond, &lock_table_mutex, K_FOREVER);
+  }
+  b->refs++;
+  lock_wait(a_first ? a : b, self, GDO_FS_LOCK_WRITE);
+  lock_wait(a_first ? b : a, self, GDO_FS_LOCK_WRITE);
+  k_mutex_unlock(&lock_table_mutex);
+  *lock_a = a;
+  *lock_b = b;
+}
+
+struct gdo_fs_lock *gdo_fs_lock_acquire_id(int id, enum gdo_fs_lock_mode mode)
+{
+  __ASSERT_NO_MSG(id >= 0 && id < GDO_FILE_NUM);
+  return lock_acquire(id, NULL, mode);
+}
+
+void gdo_fs_lock_release(struct gdo_fs_lock *lock)
+{
+  k_mutex_lock(&lock_table_mutex, K_FOREVER);
+  if (lock->writer == k_current_get()) {
+    if (--lock->write_depth == 0) {
+      lock->writer = NULL;
+    }
+  } else {
+    __ASSERT_NO_MSG(lock->readers > 0);
+    lock->readers--;
+  }
+  lock->refs--;
+  k_condvar_broadcast(&lock_table_cond);
+  k_mutex_unlock(&lock_table_mutex);
+}
+
+/* Caller holds lock_table_mutex */
+static bool lock_table_busy(void)
+{
+  for (int i = 0; i < ARRAY_SIZE(lock_table); i++) {
+    if (lock_table[i].refs != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int gdo_fs_lock_exclusive(uint32_t timeout_ms)
+{
+  int64_t deadline = k_uptime_get() + timeout_ms;
+  k_tid_t self     = k_current_get();
+  int res          = 0;
+
+  k_mutex_lock(&lock_table_mutex, K_FOREVER);
+  while (res == 0 && ((lock_table_owner != NULL && lock_table_owner != self) || lock_table_busy())) {
+    int64_t left = deadline - k_uptime_get();
+
+    if (left <= 0) {
+      res = -EBUSY;
+      break;
+    }
+    /* close the gate first so the holders drain and no new ones come in */
+    if (lock_table_owner == NULL) {
+      lock_table_owner = self;
+    }
+    k_condvar_wait(&lock_table_cond, &lock_table_mutex, K_MSEC(left));
+  }
+  if (res == 0) {
+    lock_table_owner = self;
+  } else if (lock_table_owner == self) {
+    lock_table_owner = NULL;
+    k_condvar_broadcast(&lock_table_cond);
+  }
+  k_mutex_unlock(&lock_table_mutex);
+  return res;
+}
+
+void gdo_fs_lock_exclusive_release(void)
+{
+  k_mutex_lock(&lock_table_mutex, K_FOREVER);
+  if (lock_table_owner == k_current_get()) {
+    lock_table_owner = NULL;
+  }
+  k_condvar_broadcast(&lock_table_cond);
+  k_mutex_unlock(&lock_table_mutex);
+}
+
+#if (GDO_FS_LOCK_STRESS_TEST)
+#include "gdo_file_system_util.h"
+#include "gdo_user_infor_util.h"
+#include "gdo_schedule.h"
+
+#define STRESS_THREADS      4
+#define STRESS_STACK_SIZE   2048
+#define STRESS_DURATION_MS  10000
+/* one writer out of STRESS_WRITE_RATIO operations */
+#define STRESS_WRITE_RATIO  4
+#define STRESS_HIST_BUCKETS 16 /* bucket i counts latencies below 2^i ms */
+
+struct stress_result {
+  uint32_t ops[2];
+  uint32_t hist[2][STRESS_HIST_BUCKETS];
+  uint32_t max_ms[2];
+};
+
+static K_THREAD_STACK_ARRAY_DEFINE(stress_stacks, STRESS_THREADS, STRESS_STACK_SIZE);
+static struct k_thread stress_threads[STRESS_THREADS];
+static struct stress_result stress_results[STRESS_THREADS];
+
+static void stress_record(struct stress_result *result, int kind, uint32_t ms)
+{
+  int bucket = 0;
+
+  while (bucket < STRESS_HIST_BUCKETS - 1 && ms >= (1U << bucket)) {
+    bucket++;
+  }
+  result->ops[kind]++;
+  result->hist[kind][bucket]++;
+  result->max_ms[kind] = MAX(result->max_ms[kind], ms);
+}
+
+static void stress_worker(void *p1, void *p2, void *p3)
+{
+  struct stress_result *result = p1;
+  uint32_t seed                = (uint32_t) (uintptr_t) p2;
+  int64_t end                  = k_uptime_get() + STRESS_DURATION_MS;
+  gdo_user_infor user;
+  struct schedule_data schedule;
+
+  while (k_uptime_get() < end) {
+    seed          = seed * 1103515245U + 12345U;
+    bool write    = ((seed >> 16) % STRESS_WRITE_RATIO) == 0;
+    bool on_users = (seed >> 8) & 1;
+    int64_t start = k_uptime_get();
+
+    if (on_users) {
+      size_t index = ((seed >> 20) % GDO_MAX_USER_SUPORT) * sizeof(user);
+      if (write) {
+        gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, GDO_USER_INFOR_FULL_PATH, &user, sizeof(user), index);
+        gdo_fs_write_file_index(GDO_DISK_MOUNT_PT, GDO_USER_INFOR_FULL_PATH, &user, sizeof(user), index);
+      } else {
+        gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, GDO_USER_INFOR_FULL_PATH, &user, sizeof(user), index);
+      }
+    } else {
+      size_t index = ((seed >> 20) % SCHEDULE_NUM) * sizeof(schedule);
+      if (write) {
+        gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, SCHEDULE_CURRENT_FILE_FULL_PATH, &schedule, sizeof(schedule), index);
+        gdo_fs_write_file_index(GDO_DISK_MOUNT_PT, SCHEDULE_CURRENT_FILE_FULL_PATH, &schedule, sizeof(schedule), index);
+      } else {
+        gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, SCHEDULE_CURRENT_FILE_FULL_PATH, &schedule, sizeof(schedule), index);
+      }
+    }
+    stress_record(result, write ? 1 : 0, (uint32_t) (k_uptime_get() - start));
+  }
+}
+
+static uint32_t stress_percentile(const uint32_t *hist, uint32_t total, uint32_t permille)
+{
+  uint32_t seen = 0;
+
+  for (int i = 0; i < STRESS_HIST_BUCKETS; i++) {
+    seen += hist[i];
+    if (seen * 1000U >= total * permille) {
+      return 1U << i;
+    }
+  }
+  return 1U << (STRESS_HIST_BUCKETS - 1);
+}
+
+int gdo_fs_lock_stress_test(void)
+{
+  struct stress_result sum;
+  static const char *const kind_name[2] = {"read", "write"};
+
+  memset(stress_results, 0, sizeof(stress_results));
+  for (int i = 0; i < STRESS_THREADS; i++) {
+    k_thread_create(&stress_threads[i],
+                    stress_stacks[i],
+                    K_THREAD_STACK_SIZEOF(stress_stacks[i]),
+                    stress_worker,
+                    &stress_results[i],
+                    (void *) (uintptr_t) (i * 7919 + 1),
+                    NULL,
+                    K_LOWEST_APPLICATION_THREAD_PRIO,
+                    0,
+                    K_NO_WAIT);
+  }
+  memset(&sum, 0, sizeof(sum));
+  for (int i = 0; i < STRESS_THREADS; i++) {
+    k_thread_join(&stress_threads[i], K_FOREVER);
+    for (int kind = 0; kind < 2; kind++) {
+      sum.ops[kind] += stress_results[i].ops[kind];
+      sum.max_ms[kind] = MAX(sum.max_ms[kind], stress_results[i].max_ms[kind]);
+      for (int b = 0; b < STRESS_HIST_BUCKETS; b++) {
+        sum.hist[kind][b] += stress_results[i].hist[kind][b];
+      }
+    }
+  }
+  for (int kind = 0; kind < 2; kind++) {
+    LOG_PRINTK("lock-stress %s: threads=%d ops=%u ops_per_s=%u p50_ms<%u p99_ms<%u max_ms=%u\n",
+               kind_name[kind],
+               STRESS_THREADS,
+               sum.ops[kind],
+               sum.ops[kind] * 1000U / STRESS_DURATION_MS,
+               stress_percentile(sum.hist[kind], sum.ops[kind], 500),
+               stress_percentile(sum.hist[kind], sum.ops[kind], 990),
+               sum.max_ms[kind]);
+  }
+  return 0;
+}
+#endif
@@ -0,0 +1,97 @@
+#ifndef _GDO_FS_LOCK_H_
+#define _GDO_FS_LOCK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Number of other paths that can be locked at the same time. The registry files (gdo_fs_files.h)
+ * and the files locked under them have their own entries, these are only taken by a caller that
+ * holds no lock, so running out makes it wait but cannot deadlock.
+ */
+#ifndef GDO_FS_LOCK_SLOTS
+#define GDO_FS_LOCK_SLOTS 8
+#endif
+
+enum gdo_fs_lock_mode {
+  GDO_FS_LOCK_READ = 0x00,
+  GDO_FS_LOCK_WRITE,
+};
+
+struct gdo_fs_lock;
+
+/**
+ * @brief Take the reader-writer lock of a file.
+ *
+ * Any number of readers of a file run together; a writer is exclusive and queued writers block new
+ * readers so they cannot starve. The writer may re-enter the lock of its own file in either mode.
+ * A reader must not: readers are not tracked per thread, so a writer queued in between would make
+ * the second acquire wait for the first. Locks of different files never block each other; only
+ * the littlefs calls themselves stay serialized by the file system layer.
+ *
+ * A caller that already holds a lock may only take the lock of a registry file or of a file
+ * locked under one (CRC sidecar, split user file); two other files are locked together with
+ * gdo_fs_lock_acquire_pair().
+ *
+ * @param[in] full_path_file Path of the file, at most GDO_FS_MAX_PATH_LEN - 1 characters.
+ * @param[in] mode           GDO_FS_LOCK_READ or GDO_FS_LOCK_WRITE.
+ *
+ * @return Lock handle to pass to gdo_fs_lock_release(). Never NULL, waits for a free slot.
+ */
+struct gdo_fs_lock *gdo_fs_lock_acquire(const char *full_path_file, enum gdo_fs_lock_mode mode);
+
+/**
+ * @brief gdo_fs_lock_acquire() of registry file @p id (enum gdo_file_id), without a path lookup.
+ *
+ * Every registry file has its own entry in the lock table, the same one a path lock of it takes.
+ */
+struct gdo_fs_lock *gdo_fs_lock_acquire_id(int id, enum gdo_fs_lock_mode mode);
+
+/**
+ * @brief Write lock two files in one acquire, for operations on a pair such as a rename.
+ *
+ * The table entries of both are taken together, then the locks in path order, the order every
+ * caller locking two files uses. @p path_a and @p path_b may be the same file. Both locks are
+ * released with gdo_fs_lock_release().
+ */
+void gdo_fs_lock_acquire_pair(const char *path_a, const char *path_b, struct gdo_fs_lock **lock_a,
+                              struct gdo_fs_lock **lock_b);
+
+/**
+ * @brief Release a lock taken by gdo_fs_lock_acquire() from the same thread.
+ */
+void gdo_fs_lock_release(struct gdo_fs_lock *lock);
+
+/**
+ * @brief Wait until no file lock is held by anyone and keep other threads from taking one.
+ *
+ * For operations on the whole partition. The caller must not hold a file lock itself; it may
+ * take file locks while it is exclusive.
+ *
+ * @return 0, or -EBUSY if locks were still held after @p timeout_ms (nothing is kept then).
+ */
+int gdo_fs_lock_exclusive(uint32_t timeout_ms);
+
+/**
+ * @brief Let other threads take file locks again after gdo_fs_lock_exclusive().
+ */
+void gdo_fs_lock_exclusive_release(void);
+
+#if (GDO_FS_LOCK_STRESS_TEST)
+/**
+ * @brief Mixed read/write load from several threads over the managed files.
+ *
+ * Prints operations per second and p50/p99/max latency of reads and writes.
+ */
+int gdo_fs_lock_stress_test(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
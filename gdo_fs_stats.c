@@ -0,0 +1,259 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_fs_stats.h"
+#include "gdo_file_system_util.h"
+#if (GDO_FS_STATS_FLASH_AREA)
+#include <zephyr/storage/flash_map.h>
+#endif
+#if defined(CONFIG_SHELL)
+#include <zephyr/shell/shell.h>
+#endif
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+static const char *const stat_names[GDO_FS_STAT_OP_NUM] = {
+  [GDO_FS_STAT_OPEN]            = "open",
+  [GDO_FS_STAT_SEEK]            = "seek",
+  [GDO_FS_STAT_READ]            = "read",
+  [GDO_FS_STAT_WRITE]           = "write",
+  [GDO_FS_STAT_SYNC]            = "sync",
+  [GDO_FS_STAT_CLOSE]           = "close",
+  [GDO_FS_STAT_LOCK_WAIT]       = "lock_wait",
+  [GDO_FS_STAT_RAW_READ]        = "raw_read",
+  [GDO_FS_STAT_RAW_PROGRAM]     = "raw_program",
+  [GDO_FS_STAT_RAW_ERASE]       = "raw_erase",
+  [GDO_FS_STAT_PART_READ]       = "part_read",
+  [GDO_FS_STAT_PART_PROGRAM]    = "part_program",
+  [GDO_FS_STAT_PART_ERASE]      = "part_erase",
+  [GDO_FS_STAT_API_CREATE]      = "create_file",
+  [GDO_FS_STAT_API_READ_FILE]   = "read_file",
+  [GDO_FS_STAT_API_WRITE_FILE]  = "write_file",
+  [GDO_FS_STAT_API_READ_INDEX]  = "read_file_index",
+  [GDO_FS_STAT_API_WRITE_INDEX] = "write_file_index",
+  [GDO_FS_STAT_API_WRITE_SKIP]  = "write_index_skip",
+  [GDO_FS_STAT_API_READV]       = "readv_index",
+  [GDO_FS_STAT_API_WRITEV]      = "writev_index",
+  [GDO_FS_STAT_API_DELETE_ALL]  = "delete_all_file",
+};
+
+static struct gdo_fs_stat_entry stat_table[GDO_FS_STAT_OP_NUM];
+static struct k_spinlock stat_lock;
+
+static uint8_t stat_bucket(uint32_t us)
+{
+  /* bucket 0 is < 16 us, each next one doubles the bound */
+  uint32_t bucket = (us < 16) ? 0 : (uint32_t) (32 - __builtin_clz(us)) - 4;
+
+  return (bucket < GDO_FS_STATS_BUCKETS) ? bucket : GDO_FS_STATS_BUCKETS - 1;
+}
+
+void gdo_fs_stats_record(enum gdo_fs_stat_op op, uint32_t start_cycles, int result, size_t len)
+{
+  uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start_cycles);
+
+  if ((unsigned) op >= GDO_FS_STAT_OP_NUM) {
+    return;
+  }
+  k_spinlock_key_t key = k_spin_lock(&stat_lock);
+  struct gdo_fs_stat_entry *entry = &stat_table[op];
+
+  entry->count++;
+  if (result < 0) {
+    entry->errors++;
+  } else {
+    entry->bytes += len;
+  }
+  entry->total_us += us;
+  entry->max_us = MAX(entry->max_us, us);
+  entry->hist[stat_bucket(us)]++;
+  k_spin_unlock(&stat_lock, key);
+}
+
+int gdo_fs_stats_get(enum gdo_fs_stat_op op, struct gdo_fs_stat_entry *entry)
+{
+  if ((unsigned) op >= GDO_FS_STAT_OP_NUM || entry == NULL) {
+    return -EINVAL;
+  }
+  k_spinlock_key_t key = k_spin_lock(&stat_lock);
+  *entry = stat_table[op];
+  k_spin_unlock(&stat_lock, key);
+  return 0;
+}
+
+const char *gdo_fs_stats_name(enum gdo_fs_stat_op op)
+{
+  return ((unsigned) op < GDO_FS_STAT_OP_NUM) ? stat_names[op] : "?";
+}
+
+uint32_t gdo_fs_stats_percentile(const struct gdo_fs_stat_entry *entry, uint8_t percent)
+{
+  uint32_t target;
+  uint32_t seen = 0;
+
+  if (entry->count == 0) {
+    return 0;
+  }
+  target = (uint32_t) (((uint64_t) entry->count * percent + 99) / 100);
+  for (int i = 0; i < GDO_FS_STATS_BUCKETS - 1; i++) {
+    seen += entry->hist[i];
+    if (seen >= target) {
+      return 16u << i;
+    }
+  }
+  /* overflow bucket has no upper bound, the worst seen call stands in for it */
+  return entry->max_us;
+}
+
+void gdo_fs_stats_reset(void)
+{
+  k_spinlock_key_t key = k_spin_lock(&stat_lock);
+  memset(stat_table, 0, sizeof(stat_table));
+  k_spin_unlock(&stat_lock, key);
+}
+
+int gdo_fs_stats_free_blocks(uint32_t *free_blocks, uint32_t *total_blocks, uint32_t *block_size)
+{
+  struct fs_statvfs sbuf;
+  int rc = gdo_fs_statvfs(GDO_DISK_MOUNT_PT, &sbuf);
+
+  if (rc != 0) {
+    LOG_ERR("FS-Stats: statvfs %s err %d", GDO_DISK_MOUNT_PT, rc);
+    return rc;
+  }
+  if (free_blocks != NULL) {
+    *free_blocks = sbuf.f_bfree;
+  }
+  if (total_blocks != NULL) {
+    *total_blocks = sbuf.f_blocks;
+  }
+  if (block_size != NULL) {
+    *block_size = sbuf.f_frsize;
+  }
+  return 0;
+}
+
+#if (GDO_FS_STATS_FLASH_AREA)
+/*
+ * littlefs goes to the partition through flash_area_*, not through gdo_flash_cache, so these
+ * linker wraps are the only place its traffic can be seen. Other partition users count too.
+ */
+int __real_flash_area_read(const struct flash_area *fa, off_t off, void *dst, size_t len);
+int __real_flash_area_write(const struct flash_area *fa, off_t off, const void *src, size_t len);
+int __real_flash_area_erase(const struct flash_area *fa, off_t off, size_t len);
+
+int __wrap_flash_area_read(const struct flash_area *fa, off_t off, void *dst, size_t len)
+{
+  uint32_t start = GDO_FS_STAT_START();
+  int rc         = __real_flash_area_read(fa, off, dst, len);
+
+  GDO_FS_STAT_END(GDO_FS_STAT_PART_READ, start, rc, len);
+  return rc;
+}
+
+int __wrap_flash_area_write(const struct flash_area *fa, off_t off, const void *src, size_t len)
+{
+  uint32_t start = GDO_FS_STAT_START();
+  int rc         = __real_flash_area_write(fa, off, src, len);
+
+  GDO_FS_STAT_END(GDO_FS_STAT_PART_PROGRAM, start, rc, len);
+  return rc;
+}
+
+int __wrap_flash_area_erase(const struct flash_area *fa, off_t off, size_t len)
+{
+  uint32_t start = GDO_FS_STAT_START();
+  int rc         = __real_flash_area_erase(fa, off, len);
+
+  GDO_FS_STAT_END(GDO_FS_STAT_PART_ERASE, start, rc, len);
+  return rc;
+}
+#endif
+
+#if defined(CONFIG_SHELL)
+static int cmd_gdo_fs_stats_show(const struct shell *sh, size_t argc, char **argv)
+{
+  struct gdo_fs_stat_entry entry;
+
+  shell_print(sh, "%-16s %8s %6s %10s %8s %8s %8s %8s", "op", "count", "err", "bytes", "avg_us", "p50_us",
+              "p99_us", "max_us");
+  for (int op = 0; op < GDO_FS_STAT_OP_NUM; op++) {
+    gdo_fs_stats_get(op, &entry);
+    if (entry.count == 0) {
+      continue;
+    }
+    shell_print(sh, "%-16s %8u %6u %10llu %8u %8u %8u %8u", stat_names[op], entry.count, entry.errors,
+                (unsigned long long) entry.bytes, (uint32_t) (entry.total_us / entry.count),
+                gdo_fs_stats_percentile(&entry, 50), gdo_fs_stats_percentile(&entry, 99), entry.max_us);
+  }
+  return 0;
+}
+
+static int cmd_gdo_fs_stats_hist(const struct shell *sh, size_t argc, char **argv)
+{
+  struct gdo_fs_stat_entry entry;
+
+  for (int op = 0; op < GDO_FS_STAT_OP_NUM; op++) {
+    if (strcmp(argv[1], stat_names[op]) != 0) {
+      continue;
+    }
+    gdo_fs_stats_get(op, &entry);
+    for (int i = 0; i < GDO_FS_STATS_BUCKETS; i++) {
+      if (i == GDO_FS_STATS_BUCKETS - 1) {
+        shell_print(sh, ">=%6u us: %u", 16u << (i - 1), entry.hist[i]);
+      } else {
+        shell_print(sh, " <%6u us: %u", 16u << i, entry.hist[i]);
+      }
+    }
+    return 0;
+  }
+  shell_error(sh, "unknown op %s", argv[1]);
+  return -EINVAL;
+}
+
+static int cmd_gdo_fs_stats_reset(const struct shell *sh, size_t argc, char **argv)
+{
+  gdo_fs_stats_reset();
+  shell_print(sh, "storage stats cleared");
+  return 0;
+}
+
+static int cmd_gdo_fs_stats_df(const struct shell *sh, size_t argc, char **argv)
+{
+  uint32_t free_blocks;
+  uint32_t total_blocks;
+  uint32_t block_size;
+  int rc = gdo_fs_stats_free_blocks(&free_blocks, &total_blocks, &block_size);
+
+  if (rc != 0) {
+    shell_error(sh, "statvfs failed %d", rc);
+    return rc;
+  }
+  shell_print(sh, "%s: %u of %u blocks free, block size %u", GDO_DISK_MOUNT_PT, free_blocks, total_blocks,
+              block_size);
+  return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_gdo_fs_stats,
+                               SHELL_CMD(show, NULL, "Per call counters and latency", cmd_gdo_fs_stats_show),
+                               SHELL_CMD_ARG(hist, NULL, "Latency histogram of one op", cmd_gdo_fs_stats_hist, 2, 0),
+                               SHELL_CMD(reset, NULL, "Clear the counters", cmd_gdo_fs_stats_reset),
+                               SHELL_CMD(df, NULL, "Free littlefs blocks", cmd_gdo_fs_stats_df),
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(gdo_fs_stats, &sub_gdo_fs_stats, "Storage instrumentation", NULL);
+#endif
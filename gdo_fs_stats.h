@@ -0,0 +1,123 @@
+#ifndef _GDO_FS_STATS_H_
+#define _GDO_FS_STATS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 1: count and time the storage calls, 0: the hooks compile to nothing */
+#ifndef GDO_FS_STATS
+#define GDO_FS_STATS 1
+#endif
+
+/*
+ * 1: also count the flash_area_* calls of every partition user, littlefs included. Needs the
+ * link options -Wl,--wrap=flash_area_read,--wrap=flash_area_write,--wrap=flash_area_erase
+ */
+#ifndef GDO_FS_STATS_FLASH_AREA
+#define GDO_FS_STATS_FLASH_AREA 0
+#endif
+
+/* Latency buckets, bucket i counts calls below (16 << i) us, the last one everything above */
+#define GDO_FS_STATS_BUCKETS 12
+
+enum gdo_fs_stat_op {
+  /* littlefs primitives */
+  GDO_FS_STAT_OPEN = 0x00,
+  GDO_FS_STAT_SEEK,
+  GDO_FS_STAT_READ,
+  GDO_FS_STAT_WRITE,
+  GDO_FS_STAT_SYNC,
+  GDO_FS_STAT_CLOSE,
+  /* time spent waiting for the littlefs mutex */
+  GDO_FS_STAT_LOCK_WAIT,
+  /* gdo_flash_* raw region only, driver calls behind the sector cache */
+  GDO_FS_STAT_RAW_READ,
+  GDO_FS_STAT_RAW_PROGRAM,
+  GDO_FS_STAT_RAW_ERASE,
+  /* flash_area_* calls underneath littlefs, only with GDO_FS_STATS_FLASH_AREA */
+  GDO_FS_STAT_PART_READ,
+  GDO_FS_STAT_PART_PROGRAM,
+  GDO_FS_STAT_PART_ERASE,
+  /* public gdo_fs_* calls, end to end */
+  GDO_FS_STAT_API_CREATE,
+  GDO_FS_STAT_API_READ_FILE,
+  GDO_FS_STAT_API_WRITE_FILE,
+  GDO_FS_STAT_API_READ_INDEX,
+  GDO_FS_STAT_API_WRITE_INDEX,
+  GDO_FS_STAT_API_WRITE_SKIP, /* write_file_index calls that found the data already there */
+  GDO_FS_STAT_API_READV,
+  GDO_FS_STAT_API_WRITEV,
+  GDO_FS_STAT_API_DELETE_ALL,
+  GDO_FS_STAT_OP_NUM,
+};
+
+struct gdo_fs_stat_entry {
+  uint32_t count;
+  uint32_t errors;   /* calls that returned a negative value */
+  uint64_t bytes;    /* bytes moved (erase: bytes erased) */
+  uint64_t total_us;
+  uint32_t max_us;
+  uint32_t hist[GDO_FS_STATS_BUCKETS];
+};
+
+#if (GDO_FS_STATS)
+#define GDO_FS_STAT_START()                   k_cycle_get_32()
+#define GDO_FS_STAT_END(op, start, res, len)  gdo_fs_stats_record((op), (start), (res), (len))
+#else
+#define GDO_FS_STAT_START()                   0
+#define GDO_FS_STAT_END(op, start, res, len)  ((void) (op), (void) (start))
+#endif
+
+/**
+ * @brief Account one call that started at @p start_cycles (k_cycle_get_32()).
+ *
+ * Safe from any thread; costs one cycle read and a short spinlock section.
+ *
+ * @param[in] op           Operation being timed.
+ * @param[in] start_cycles Cycle counter taken before the call.
+ * @param[in] result       Return value of the call, negative counts as an error.
+ * @param[in] len          Bytes moved by the call.
+ */
+void gdo_fs_stats_record(enum gdo_fs_stat_op op, uint32_t start_cycles, int result, size_t len);
+
+/**
+ * @brief Copy the counters of one operation.
+ *
+ * @return 0, or -EINVAL for an unknown operation.
+ */
+int gdo_fs_stats_get(enum gdo_fs_stat_op op, struct gdo_fs_stat_entry *entry);
+
+/**
+ * @brief Printable name of an operation, "?" if unknown.
+ */
+const char *gdo_fs_stats_name(enum gdo_fs_stat_op op);
+
+/**
+ * @brief Latency percentile of an operation from its histogram.
+ *
+ * @return Upper bound in us of the bucket holding the percentile, 0 without samples.
+ */
+uint32_t gdo_fs_stats_percentile(const struct gdo_fs_stat_entry *entry, uint8_t percent);
+
+/**
+ * @brief Clear all counters.
+ */
+void gdo_fs_stats_reset(void);
+
+/**
+ * @brief Free and total blocks of the mounted file system (gdo_fs_statvfs, from the backend).
+ *
+ * @return 0 or a negative errno from the backend.
+ */
+int gdo_fs_stats_free_blocks(uint32_t *free_blocks, uint32_t *total_blocks, uint32_t *block_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,167 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_file_system_util.h"
+#include "gdo_fs_view.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+struct gdo_fs_view_slot {
+  /* first member so it is aligned like the struct, views are cast to record types */
+  uint8_t data[GDO_FS_VIEW_BUFFER_SIZE];
+  char path[GDO_FS_MAX_PATH_LEN];
+  size_t index;
+  size_t len;
+  uint16_t refs;  /* views handed out and not released, a pinned buffer is never reused */
+  bool valid;     /* data matches the file, new views may share it */
+  bool stale;     /* a write overlapped while the buffer was pinned or being filled */
+  uint32_t used;  /* LRU stamp */
+};
+
+/* Slot bookkeeping only, never held over a file access */
+K_MUTEX_DEFINE(viewaccess);
+static struct gdo_fs_view_slot view_slots[GDO_FS_VIEW_SLOTS];
+static struct gdo_fs_view_counters view_counters;
+static uint32_t view_clock;
+
+/* Caller holds viewaccess */
+static struct gdo_fs_view_slot *gdo_fs_view_find(const char *full_path_file, size_t len, size_t index)
+{
+  for (int i = 0; i < GDO_FS_VIEW_SLOTS; i++) {
+    struct gdo_fs_view_slot *slot = &view_slots[i];
+
+    if (slot->valid && slot->index == index && slot->len == len && strcmp(slot->path, full_path_file) == 0) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+/* Caller holds viewaccess. Unpinned slots only, an empty one before the least recently used. */
+static struct gdo_fs_view_slot *gdo_fs_view_victim(void)
+{
+  struct gdo_fs_view_slot *victim = NULL;
+
+  for (int i = 0; i < GDO_FS_VIEW_SLOTS; i++) {
+    struct gdo_fs_view_slot *slot = &view_slots[i];
+
+    if (slot->refs != 0) {
+      continue;
+    }
+    if (!slot->valid) {
+      return slot;
+    }
+    if (victim == NULL || (int32_t) (slot->used - victim->used) < 0) {
+      victim = slot;
+    }
+  }
+  return victim;
+}
+
+const void *gdo_fs_view_index(const char *full_path_file, size_t len, size_t index)
+{
+  struct gdo_fs_view_slot *slot;
+  int res;
+
+  if (len == 0 || len > GDO_FS_VIEW_BUFFER_SIZE || strlen(full_path_file) >= GDO_FS_MAX_PATH_LEN) {
+    return NULL;
+  }
+  k_mutex_lock(&viewaccess, K_FOREVER);
+  slot = gdo_fs_view_find(full_path_file, len, index);
+  if (slot != NULL) {
+    slot->refs++;
+    slot->used = ++view_clock;
+    view_counters.hits++;
+    k_mutex_unlock(&viewaccess);
+    return slot->data;
+  }
+  slot = gdo_fs_view_victim();
+  if (slot == NULL) {
+    view_counters.busy++;
+    k_mutex_unlock(&viewaccess);
+    return NULL;
+  }
+  /* pinned and not valid while it is filled, so nobody else shares or reuses it */
+  strcpy(slot->path, full_path_file);
+  slot->index = index;
+  slot->len   = len;
+  slot->refs  = 1;
+  slot->valid = false;
+  slot->stale = false;
+  view_counters.misses++;
+  k_mutex_unlock(&viewaccess);
+
+  res = gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, full_path_file, slot->data, len, index);
+
+  k_mutex_lock(&viewaccess, K_FOREVER);
+  if (res != len) {
+    slot->refs = 0;
+    k_mutex_unlock(&viewaccess);
+    return NULL;
+  }
+  /* a write that landed after the read already invalidated the range, keep it private then */
+  slot->valid = !slot->stale;
+  slot->used  = ++view_clock;
+  k_mutex_unlock(&viewaccess);
+  return slot->data;
+}
+
+void gdo_fs_release_view(const void *view)
+{
+  k_mutex_lock(&viewaccess, K_FOREVER);
+  for (int i = 0; i < GDO_FS_VIEW_SLOTS; i++) {
+    struct gdo_fs_view_slot *slot = &view_slots[i];
+
+    if (slot->data == view && slot->refs > 0) {
+      slot->refs--;
+      k_mutex_unlock(&viewaccess);
+      return;
+    }
+  }
+  k_mutex_unlock(&viewaccess);
+  LOG_ERR("FS-View: release of unknown view %p", view);
+}
+
+void gdo_fs_view_invalidate(const char *full_path_file, size_t index, size_t len)
+{
+  k_mutex_lock(&viewaccess, K_FOREVER);
+  for (int i = 0; i < GDO_FS_VIEW_SLOTS; i++) {
+    struct gdo_fs_view_slot *slot = &view_slots[i];
+
+    if (slot->refs == 0 && !slot->valid) {
+      continue;
+    }
+    if (full_path_file != NULL) {
+      if (strcmp(slot->path, full_path_file) != 0) {
+        continue;
+      }
+      if (len != 0 && (index >= slot->index + slot->len || slot->index >= index + len)) {
+        continue;
+      }
+    }
+    /* a pinned buffer keeps its snapshot and is recycled once released */
+    slot->valid = false;
+    slot->stale = true;
+  }
+  k_mutex_unlock(&viewaccess);
+}
+
+void gdo_fs_view_get_counters(struct gdo_fs_view_counters *counters)
+{
+  k_mutex_lock(&viewaccess, K_FOREVER);
+  *counters = view_counters;
+  k_mutex_unlock(&viewaccess);
+}
@@ -0,0 +1,64 @@
+#ifndef _GDO_FS_VIEW_H_
+#define _GDO_FS_VIEW_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "gdo_config.h"
+#include "gdo_user_infor_util.h"
+#include "gdo_schedule.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Pinned buffers shared by the views, statically allocated (not from the heap) */
+#ifndef GDO_FS_VIEW_SLOTS
+#define GDO_FS_VIEW_SLOTS 4
+#endif
+
+/* Largest view, one user or schedule record; a board short on RAM can lower it */
+#ifndef GDO_FS_VIEW_BUFFER_SIZE
+#define GDO_FS_VIEW_BUFFER_SIZE                                                                                    \
+  (sizeof(gdo_user_infor) > sizeof(struct schedule_data) ? sizeof(gdo_user_infor) : sizeof(struct schedule_data))
+#endif
+
+struct gdo_fs_view_counters {
+  uint32_t hits;   /* served from a cached buffer, no flash read and no copy */
+  uint32_t misses; /* buffer filled from the file */
+  uint32_t busy;   /* NULL returned because every buffer was pinned */
+};
+
+/**
+ * @brief Borrow a read-only view of @p len bytes at byte offset @p index of a file.
+ *
+ * The bytes are read once into a pinned buffer of a small pool; later views of the same range
+ * share that buffer until a write to the file overlaps it. A view is a snapshot: a write while
+ * it is held does not change it, the next gdo_fs_view_index() reads the new data.
+ * Every non-NULL view must be given back with gdo_fs_release_view().
+ *
+ * @return Pointer to the data (aligned for any record type), or NULL if @p len exceeds
+ *         GDO_FS_VIEW_BUFFER_SIZE, every buffer is pinned or the read failed. Callers fall back
+ *         to gdo_fs_read_file_index() on NULL.
+ */
+const void *gdo_fs_view_index(const char *full_path_file, size_t len, size_t index);
+
+/**
+ * @brief Give back a view returned by gdo_fs_view_index().
+ */
+void gdo_fs_release_view(const void *view);
+
+/**
+ * @brief Drop the cached views of a file overlapping @p len bytes at @p index.
+ *
+ * Called by the file system layer after every write. @p len 0 means the whole file,
+ * @p full_path_file NULL every file. Views still held keep their snapshot.
+ */
+void gdo_fs_view_invalidate(const char *full_path_file, size_t index, size_t len);
+
+void gdo_fs_view_get_counters(struct gdo_fs_view_counters *counters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,435 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_file_system_util.h"
+#include "gdo_flash_cache.h"
+#include "gdo_kv_store.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+#define KV_SECTOR_SIZE   GDO_FLASH_SECTOR_SIZE
+#define KV_SECTOR_NUM    (GDO_KV_REGION_SIZE / KV_SECTOR_SIZE)
+#define KV_SECTOR_MAGIC  0x4B565331 /* "KVS1" */
+#define KV_KEY_ERASED    0xFFFF
+#define KV_KEY_COMMIT    0xFFFE /* closes the copy phase of a sector */
+#define KV_LEN_TOMBSTONE 0x8000
+#define KV_ALIGN         4
+
+BUILD_ASSERT(KV_SECTOR_NUM >= 2, "kv store needs at least two sectors");
+BUILD_ASSERT((GDO_KV_REGION_OFFSET % GDO_FLASH_SECTOR_SIZE) == 0, "kv region must be sector aligned");
+
+struct kv_sector_header {
+  uint32_t magic;
+  uint32_t generation;
+  uint32_t crc;
+} __packed;
+
+struct kv_record_header {
+  uint16_t key;
+  uint16_t len; /* KV_LEN_TOMBSTONE set for a delete */
+  uint32_t crc; /* over key, len and the value */
+} __packed;
+
+#define KV_RECORD_SPACE(len) ROUND_UP(sizeof(struct kv_record_header) + (len), KV_ALIGN)
+
+/* the whole live set plus the commit marker fits in the sector a collection copies it to */
+BUILD_ASSERT(GDO_KV_MAX_KEYS * KV_RECORD_SPACE(GDO_KV_MAX_VALUE_LEN) + sizeof(struct kv_sector_header) +
+                     KV_RECORD_SPACE(0) <= KV_SECTOR_SIZE,
+             "GDO_KV_MAX_KEYS values of GDO_KV_MAX_VALUE_LEN do not fit in a sector");
+
+struct kv_index_entry {
+  uint16_t key; /* GDO_KV_KEY_INVALID when unused */
+  uint16_t len;
+  uint32_t addr; /* flash address of the record header */
+};
+
+K_MUTEX_DEFINE(kv_lock);
+
+static struct kv_index_entry kv_index[GDO_KV_MAX_KEYS];
+static uint32_t kv_active;
+static uint32_t kv_generation;
+static uint32_t kv_write_offset;
+static bool kv_ready;
+static uint8_t kv_buf[KV_RECORD_SPACE(GDO_KV_MAX_VALUE_LEN)];
+
+static off_t kv_sector_addr(uint32_t sector)
+{
+  return GDO_KV_REGION_OFFSET + (off_t) sector * KV_SECTOR_SIZE;
+}
+
+static uint32_t kv_header_crc(const struct kv_sector_header *header)
+{
+  return crc32_ieee((const uint8_t *) header, offsetof(struct kv_sector_header, crc));
+}
+
+static uint32_t kv_record_crc(const struct kv_record_header *header, const uint8_t *value, size_t len)
+{
+  uint32_t crc = crc32_ieee((const uint8_t *) header, offsetof(struct kv_record_header, crc));
+  return crc32_ieee_update(crc, value, len);
+}
+
+static struct kv_index_entry *kv_index_find(uint16_t key, bool create)
+{
+  struct kv_index_entry *free_entry = NULL;
+
+  for (int i = 0; i < GDO_KV_MAX_KEYS; i++) {
+    if (kv_index[i].key == key) {
+      return &kv_index[i];
+    }
+    if (free_entry == NULL && kv_index[i].key == GDO_KV_KEY_INVALID) {
+      free_entry = &kv_index[i];
+    }
+  }
+  if (create && free_entry != NULL) {
+    free_entry->key = key;
+  }
+  return create ? free_entry : NULL;
+}
+
+/*
+ * Append one record at the write offset of the active sector. @p value may already sit in
+ * kv_buf after the header (garbage collection). Caller holds kv_lock.
+ */
+static int kv_append(uint16_t key, uint16_t len_field, const void *value, size_t len)
+{
+  struct kv_record_header *header = (struct kv_record_header *) kv_buf;
+  size_t space = KV_RECORD_SPACE(len);
+
+  header->key = key;
+  header->len = len_field;
+  if (value != kv_buf + sizeof(*header)) {
+    memcpy(kv_buf + sizeof(*header), value, len);
+  }
+  memset(kv_buf + sizeof(*header) + len, 0xFF, space - sizeof(*header) - len);
+  header->crc = kv_record_crc(header, kv_buf + sizeof(*header), len);
+  if (!gdo_flash_write_offset(kv_sector_addr(kv_active) + kv_write_offset, kv_buf, space) || !gdo_flash_flush()) {
+    return -EIO;
+  }
+  kv_write_offset += space;
+  return 0;
+}
+
+/* Erase @p sector and make it the active one, still in its copy phase. Caller holds kv_lock. */
+static int kv_sector_start(uint32_t sector, uint32_t generation)
+{
+  struct kv_sector_header header = {
+      .magic      = KV_SECTOR_MAGIC,
+      .generation = generation,
+  };
+
+  header.crc = kv_header_crc(&header);
+  if (!gdo_flash_earse_region(kv_sector_addr(sector), KV_SECTOR_SIZE) ||
+      !gdo_flash_write_offset(kv_sector_addr(sector), (uint8_t *) &header, sizeof(header))) {
+    return -EIO;
+  }
+  kv_active       = sector;
+  kv_generation   = generation;
+  kv_write_offset = sizeof(header);
+  return 0;
+}
+
+/* Flash space of the live records, except the one of @p skip. Caller holds kv_lock. */
+static size_t kv_live_bytes(uint16_t skip)
+{
+  size_t bytes = 0;
+
+  for (int i = 0; i < GDO_KV_MAX_KEYS; i++) {
+    if (kv_index[i].key != GDO_KV_KEY_INVALID && kv_index[i].key != skip) {
+      bytes += KV_RECORD_SPACE(kv_index[i].len);
+    }
+  }
+  return bytes;
+}
+
+/*
+ * Copy every live key to the next sector of the ring. The record of @p key is dropped, and
+ * replaced by @p value when that is not NULL, in the same commit. Fails with -ENOSPC before
+ * anything is erased if the result does not fit in a sector. Caller holds kv_lock.
+ */
+static int kv_collect(uint16_t key, const void *value, size_t len)
+{
+  uint32_t old_sector = kv_active;
+  struct kv_index_entry moved[GDO_KV_MAX_KEYS];
+  struct kv_index_entry *slot = NULL;
+  size_t need = sizeof(struct kv_sector_header) + kv_live_bytes(key) + KV_RECORD_SPACE(0);
+  int res;
+
+  if (value != NULL) {
+    need += KV_RECORD_SPACE(len);
+  }
+  if (need > KV_SECTOR_SIZE) {
+    return -ENOSPC;
+  }
+  res = kv_sector_start((kv_active + 1) % KV_SECTOR_NUM, kv_generation + 1);
+  if (res != 0) {
+    return res;
+  }
+  for (int i = 0; i < GDO_KV_MAX_KEYS; i++) {
+    moved[i] = kv_index[i];
+    if (moved[i].key == key) {
+      moved[i].key = GDO_KV_KEY_INVALID;
+      slot         = &moved[i];
+    }
+    if (moved[i].key == GDO_KV_KEY_INVALID) {
+      continue;
+    }
+    /* the source sector is still intact, read the value straight into the record buffer */
+    if (!gdo_flash_read_offset(kv_index[i].addr + sizeof(struct kv_record_header), kv_buf + sizeof(struct kv_record_header),
+                               kv_index[i].len)) {
+      res = -EIO;
+      goto fail;
+    }
+    moved[i].addr = kv_sector_addr(kv_active) + kv_write_offset;
+    res = kv_append(kv_index[i].key, kv_index[i].len, kv_buf + sizeof(struct kv_record_header), kv_index[i].len);
+    if (res != 0) {
+      goto fail;
+    }
+  }
+  for (int i = 0; slot == NULL && i < GDO_KV_MAX_KEYS; i++) {
+    if (moved[i].key == GDO_KV_KEY_INVALID) {
+      slot = &moved[i];
+    }
+  }
+  if (value != NULL) {
+    if (slot == NULL) {
+      res = -ENOMEM;
+      goto fail;
+    }
+    slot->key  = key;
+    slot->len  = len;
+    slot->addr = kv_sector_addr(kv_active) + kv_write_offset;
+    res        = kv_append(key, len, value, len);
+    if (res != 0) {
+      goto fail;
+    }
+  }
+  /* until this marker is programmed, mount keeps using the old sector */
+  res = kv_append(KV_KEY_COMMIT, 0, NULL, 0);
+  if (res != 0) {
+    goto fail;
+  }
+  memcpy(kv_index, moved, sizeof(kv_index));
+  LOG_INF("KV: collected sector %u into %u", old_sector, kv_active);
+  return 0;
+
+fail:
+  /* the active sector is an uncommitted copy now, only a mount sorts that out */
+  LOG_ERR("KV: collection into sector %u failed (%d)", kv_active, res);
+  kv_ready = false;
+  return res;
+}
+
+/*
+ * Rebuild the index from one sector. Returns the offset after the last good record, and
+ * whether the commit marker was seen. Caller holds kv_lock.
+ */
+static uint32_t kv_sector_scan(uint32_t sector, bool *committed)
+{
+  struct kv_record_header *header = (struct kv_record_header *) kv_buf;
+  uint32_t offset = sizeof(struct kv_sector_header);
+
+  *committed = false;
+  memset(kv_index, 0, sizeof(kv_index));
+  while (offset + sizeof(*header) <= KV_SECTOR_SIZE) {
+    off_t addr = kv_sector_addr(sector) + offset;
+    size_t len;
+
+    if (!gdo_flash_read_offset(addr, kv_buf, sizeof(*header)) || header->key == KV_KEY_ERASED) {
+      break;
+    }
+    len = header->len & ~KV_LEN_TOMBSTONE;
+    if (len > GDO_KV_MAX_VALUE_LEN || offset + KV_RECORD_SPACE(len) > KV_SECTOR_SIZE ||
+        !gdo_flash_read_offset(addr + sizeof(*header), kv_buf + sizeof(*header), len) ||
+        header->crc != kv_record_crc(header, kv_buf + sizeof(*header), len)) {
+      LOG_ERR("KV: damaged record at 0x%x", (unsigned int) addr);
+      break;
+    }
+    if (header->key == KV_KEY_COMMIT) {
+      *committed = true;
+    } else if (header->len & KV_LEN_TOMBSTONE) {
+      struct kv_index_entry *entry = kv_index_find(header->key, false);
+      if (entry != NULL) {
+        entry->key = GDO_KV_KEY_INVALID;
+      }
+    } else {
+      struct kv_index_entry *entry = kv_index_find(header->key, true);
+      if (entry != NULL) {
+        entry->len  = len;
+        entry->addr = addr;
+      }
+    }
+    offset += KV_RECORD_SPACE(len);
+  }
+  return offset;
+}
+
+static int kv_format(void)
+{
+  memset(kv_index, 0, sizeof(kv_index));
+  int res = kv_sector_start(0, 0);
+  return (res != 0) ? res : kv_append(KV_KEY_COMMIT, 0, NULL, 0);
+}
+
+int gdo_kv_init(void)
+{
+  struct kv_sector_header header;
+  uint32_t order[KV_SECTOR_NUM];
+  uint32_t generation[KV_SECTOR_NUM];
+  int count = 0;
+  int res   = -ENOENT;
+
+  k_mutex_lock(&kv_lock, K_FOREVER);
+  kv_ready = false;
+  for (uint32_t sector = 0; sector < KV_SECTOR_NUM; sector++) {
+    if (!gdo_flash_read_offset(kv_sector_addr(sector), (uint8_t *) &header, sizeof(header)) ||
+        header.magic != KV_SECTOR_MAGIC || header.crc != kv_header_crc(&header)) {
+      continue;
+    }
+    /* insertion sort, newest first */
+    int pos = count++;
+    while (pos > 0 && (int32_t) (header.generation - generation[pos - 1]) > 0) {
+      order[pos]      = order[pos - 1];
+      generation[pos] = generation[pos - 1];
+      pos--;
+    }
+    order[pos]      = sector;
+    generation[pos] = header.generation;
+  }
+  for (int i = 0; i < count; i++) {
+    bool committed;
+    uint32_t offset = kv_sector_scan(order[i], &committed);
+
+    if (committed) {
+      kv_active       = order[i];
+      kv_generation   = generation[i];
+      kv_write_offset = offset;
+      res             = 0;
+      if (i > 0) {
+        /* a newer sector holds an unfinished collection, redo it from here */
+        res = kv_collect(GDO_KV_KEY_INVALID, NULL, 0);
+      }
+      break;
+    }
+  }
+  if (res != 0) {
+    LOG_INF("KV: no committed sector, formatting");
+    res = kv_format();
+  }
+  kv_ready = (res == 0);
+  k_mutex_unlock(&kv_lock);
+  return res;
+}
+
+int gdo_kv_read(uint16_t key, void *buff, size_t len)
+{
+  struct kv_record_header *header = (struct kv_record_header *) kv_buf;
+  int res;
+
+  k_mutex_lock(&kv_lock, K_FOREVER);
+  struct kv_index_entry *entry = kv_ready ? kv_index_find(key, false) : NULL;
+  if (entry == NULL || key == GDO_KV_KEY_INVALID) {
+    res = -ENOENT;
+    goto exit;
+  }
+  /* header and value are contiguous: one flash read */
+  if (!gdo_flash_read_offset(entry->addr, kv_buf, sizeof(*header) + entry->len)) {
+    res = -EIO;
+    goto exit;
+  }
+  if (header->crc != kv_record_crc(header, kv_buf + sizeof(*header), entry->len)) {
+    LOG_ERR("KV: crc error on key 0x%x", key);
+    res = -EIO;
+    goto exit;
+  }
+  memcpy(buff, kv_buf + sizeof(*header), MIN(len, entry->len));
+  res = entry->len;
+exit:
+  k_mutex_unlock(&kv_lock);
+  return res;
+}
+
+int gdo_kv_write(uint16_t key, const void *buff, size_t len)
+{
+  int res = 0;
+
+  if (key == GDO_KV_KEY_INVALID || key > GDO_KV_KEY_MAX || len > GDO_KV_MAX_VALUE_LEN) {
+    return -EINVAL;
+  }
+  k_mutex_lock(&kv_lock, K_FOREVER);
+  if (!kv_ready) {
+    res = -EAGAIN;
+    goto exit;
+  }
+  struct kv_index_entry *entry = kv_index_find(key, false);
+  if (entry == NULL && kv_index_find(GDO_KV_KEY_INVALID, false) == NULL) {
+    res = -ENOMEM;
+    goto exit;
+  }
+  if (kv_write_offset + KV_RECORD_SPACE(len) > KV_SECTOR_SIZE) {
+    /* the sector is full, the collection writes the new value along */
+    res = kv_collect(key, buff, len);
+    goto exit;
+  }
+  uint32_t addr = kv_sector_addr(kv_active) + kv_write_offset;
+  res = kv_append(key, len, buff, len);
+  if (res != 0) {
+    goto exit;
+  }
+  if (entry == NULL) {
+    entry = kv_index_find(key, true);
+  }
+  entry->len  = len;
+  entry->addr = addr;
+exit:
+  k_mutex_unlock(&kv_lock);
+  return res;
+}
+
+int gdo_kv_delete(uint16_t key)
+{
+  int res = 0;
+
+  k_mutex_lock(&kv_lock, K_FOREVER);
+  struct kv_index_entry *entry = kv_ready ? kv_index_find(key, false) : NULL;
+  if (entry == NULL || key == GDO_KV_KEY_INVALID) {
+    goto exit;
+  }
+  if (kv_write_offset + KV_RECORD_SPACE(0) > KV_SECTOR_SIZE) {
+    /* no room for a tombstone, the collection leaves the key out */
+    res = kv_collect(key, NULL, 0);
+    goto exit;
+  }
+  res = kv_append(key, KV_LEN_TOMBSTONE, NULL, 0);
+  if (res == 0) {
+    entry->key = GDO_KV_KEY_INVALID;
+  }
+exit:
+  k_mutex_unlock(&kv_lock);
+  return res;
+}
+
+int gdo_kv_clear(void)
+{
+  k_mutex_lock(&kv_lock, K_FOREVER);
+  int res = gdo_flash_earse_region(GDO_KV_REGION_OFFSET, GDO_KV_REGION_SIZE) ? 0 : -EIO;
+  if (res == 0) {
+    res = kv_format();
+  }
+  kv_ready = (res == 0);
+  k_mutex_unlock(&kv_lock);
+  return res;
+}
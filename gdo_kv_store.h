@@ -0,0 +1,61 @@
+#ifndef _GDO_KV_STORE_H_
+#define _GDO_KV_STORE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Distinct keys the RAM index can hold */
+#ifndef GDO_KV_MAX_KEYS
+#define GDO_KV_MAX_KEYS 16
+#endif
+
+/*
+ * Largest value. A garbage collection copies every live key into one sector, so
+ * GDO_KV_MAX_KEYS values of this length must fit in a sector together.
+ */
+#ifndef GDO_KV_MAX_VALUE_LEN
+#define GDO_KV_MAX_VALUE_LEN 240
+#endif
+
+enum gdo_kv_key {
+  GDO_KV_KEY_INVALID    = 0x0000,
+  GDO_KV_KEY_BUILD_TIME = 0x0001,
+  GDO_KV_KEY_HOME_CFG   = 0x0002,
+  GDO_KV_KEY_USER_BASE  = 0x0100, /* application keys start here */
+  GDO_KV_KEY_MAX        = 0x7FFF,
+};
+
+/*
+ * Key-value store for small hot records, log-structured over GDO_KV_REGION_OFFSET.
+ *
+ * Every update appends a CRC-checked record to the active sector (one program, no erase).
+ * A RAM index built at mount maps each key to its newest record, so a read is one flash
+ * read. When the active sector is full, live records are copied to the next sector of the
+ * ring (garbage collection), which also spreads the erases over all sectors.
+ *
+ * Functions return 0 (or a length) on success, or a negative error code.
+ */
+int gdo_kv_init(void);
+
+/**
+ * @return Length of the stored value (may be larger than @p len, the copy is truncated),
+ *         -ENOENT if the key is not set.
+ */
+int gdo_kv_read(uint16_t key, void *buff, size_t len);
+
+int gdo_kv_write(uint16_t key, const void *buff, size_t len);
+int gdo_kv_delete(uint16_t key);
+
+/**
+ * @brief Erase the region and forget every key.
+ */
+int gdo_kv_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,261 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_schedule.h"
+#include "gdo_schedule_store.h"
+#include "gdo_schedule_index.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+/* Longest single timer wait, a far away head is simply re-armed when the timer fires early */
+#ifndef GDO_SCHEDULE_INDEX_MAX_WAIT_MS
+#define GDO_SCHEDULE_INDEX_MAX_WAIT_MS (24 * 60 * 60 * 1000)
+#endif
+
+struct sched_heap_entry {
+  int64_t due;
+  uint16_t slot;
+};
+
+/*
+ * Lock order is schedule store first, then sched_index_lock: the store calls the hooks with its
+ * lock held, the index never calls into the store while holding sched_index_lock.
+ */
+K_MUTEX_DEFINE(sched_index_lock);
+static struct sched_heap_entry sched_heap[SCHEDULE_NUM];
+static int16_t sched_pos[SCHEDULE_NUM]; /* heap position of a slot, -1 when it is not pending */
+static size_t sched_heap_len;
+static gdo_schedule_next_due_t sched_next_due;
+static gdo_schedule_fire_t sched_fire;
+static void *sched_fire_data;
+
+static void sched_fire_handler(struct k_work *work);
+static void sched_timer_expiry(struct k_timer *timer);
+
+K_WORK_DEFINE(sched_fire_work, sched_fire_handler);
+K_TIMER_DEFINE(sched_timer, sched_timer_expiry, NULL);
+
+/*==================== heap, caller holds sched_index_lock ====================*/
+
+static void sched_heap_swap(size_t a, size_t b)
+{
+  struct sched_heap_entry tmp = sched_heap[a];
+
+  sched_heap[a]                 = sched_heap[b];
+  sched_heap[b]                 = tmp;
+  sched_pos[sched_heap[a].slot] = a;
+  sched_pos[sched_heap[b].slot] = b;
+}
+
+static void sched_heap_up(size_t i)
+{
+  while (i > 0 && sched_heap[(i - 1) / 2].due > sched_heap[i].due) {
+    sched_heap_swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void sched_heap_down(size_t i)
+{
+  for (;;) {
+    size_t min = i;
+    size_t l   = 2 * i + 1;
+    size_t r   = 2 * i + 2;
+
+    if (l < sched_heap_len && sched_heap[l].due < sched_heap[min].due) {
+      min = l;
+    }
+    if (r < sched_heap_len && sched_heap[r].due < sched_heap[min].due) {
+      min = r;
+    }
+    if (min == i) {
+      return;
+    }
+    sched_heap_swap(i, min);
+    i = min;
+  }
+}
+
+static void sched_heap_remove(size_t slot)
+{
+  int i = sched_pos[slot];
+
+  if (i < 0) {
+    return;
+  }
+  sched_pos[slot] = -1;
+  if ((size_t) i != --sched_heap_len) {
+    /* the last entry fills the hole and moves whichever way its key needs */
+    uint16_t moved   = sched_heap[sched_heap_len].slot;
+    sched_heap[i]    = sched_heap[sched_heap_len];
+    sched_pos[moved] = i;
+    sched_heap_up(i);
+    sched_heap_down(sched_pos[moved]);
+  }
+}
+
+static void sched_heap_set(size_t slot, int64_t due)
+{
+  int i = sched_pos[slot];
+
+  if (due == GDO_SCHEDULE_NEVER) {
+    sched_heap_remove(slot);
+    return;
+  }
+  if (i < 0) {
+    i               = sched_heap_len++;
+    sched_pos[slot] = i;
+    sched_heap[i]   = (struct sched_heap_entry){.due = due, .slot = slot};
+    sched_heap_up(i);
+    return;
+  }
+  sched_heap[i].due = due;
+  sched_heap_up(i);
+  sched_heap_down(sched_pos[slot]);
+}
+
+static void sched_heap_clear(void)
+{
+  sched_heap_len = 0;
+  for (size_t slot = 0; slot < SCHEDULE_NUM; slot++) {
+    sched_pos[slot] = -1;
+  }
+}
+
+/* One timer for the head of the heap */
+static void sched_arm(void)
+{
+  if (sched_heap_len == 0) {
+    k_timer_stop(&sched_timer);
+    return;
+  }
+  int64_t wait = sched_heap[0].due - k_uptime_get();
+
+  wait = CLAMP(wait, 0, GDO_SCHEDULE_INDEX_MAX_WAIT_MS);
+  k_timer_start(&sched_timer, K_MSEC((int32_t) wait), K_NO_WAIT);
+}
+
+/*==================== firing ====================*/
+
+static void sched_timer_expiry(struct k_timer *timer)
+{
+  /* ISR context, the callbacks run on the system work queue */
+  k_work_submit(&sched_fire_work);
+}
+
+static void sched_fire_handler(struct k_work *work)
+{
+  int64_t now = k_uptime_get();
+  struct schedule_data data;
+  gdo_schedule_fire_t fire;
+  void *user_data;
+  size_t slot;
+
+  for (;;) {
+    k_mutex_lock(&sched_index_lock, K_FOREVER);
+    if (sched_fire == NULL || sched_heap_len == 0 || sched_heap[0].due > now) {
+      if (sched_fire != NULL) {
+        sched_arm();
+      }
+      k_mutex_unlock(&sched_index_lock);
+      return;
+    }
+    slot      = sched_heap[0].slot;
+    fire      = sched_fire;
+    user_data = sched_fire_data;
+    sched_heap_remove(slot);
+    k_mutex_unlock(&sched_index_lock);
+
+    if (gdo_schedule_store_read(slot, &data) == 0) {
+      fire(slot, &data, user_data);
+    }
+    /* next occurrence from the table as it is now, the callback may have changed the slot */
+    gdo_schedule_store_reindex(slot);
+  }
+}
+
+/*==================== store hooks ====================*/
+
+void gdo_schedule_index_on_write(size_t slot, const struct schedule_data *data)
+{
+  k_mutex_lock(&sched_index_lock, K_FOREVER);
+  if (sched_next_due != NULL && slot < SCHEDULE_NUM) {
+    sched_heap_set(slot, sched_next_due(data, k_uptime_get()));
+    sched_arm();
+  }
+  k_mutex_unlock(&sched_index_lock);
+}
+
+void gdo_schedule_index_on_write_all(const struct schedule_data *table)
+{
+  k_mutex_lock(&sched_index_lock, K_FOREVER);
+  if (sched_next_due != NULL) {
+    int64_t now = k_uptime_get();
+
+    sched_heap_clear();
+    for (size_t slot = 0; slot < SCHEDULE_NUM; slot++) {
+      sched_heap_set(slot, sched_next_due(&table[slot], now));
+    }
+    sched_arm();
+  }
+  k_mutex_unlock(&sched_index_lock);
+}
+
+/*==================== API ====================*/
+
+int gdo_schedule_index_start(gdo_schedule_next_due_t next_due, gdo_schedule_fire_t fire, void *user_data)
+{
+  if (next_due == NULL || fire == NULL) {
+    return -EINVAL;
+  }
+  k_mutex_lock(&sched_index_lock, K_FOREVER);
+  sched_heap_clear();
+  sched_next_due  = next_due;
+  sched_fire      = fire;
+  sched_fire_data = user_data;
+  k_mutex_unlock(&sched_index_lock);
+  /* built under the store lock, so no slot write can slip between the copy and the heap */
+  return gdo_schedule_store_reindex(SCHEDULE_NUM);
+}
+
+void gdo_schedule_index_stop(void)
+{
+  k_mutex_lock(&sched_index_lock, K_FOREVER);
+  sched_next_due = NULL;
+  sched_fire     = NULL;
+  sched_heap_clear();
+  k_timer_stop(&sched_timer);
+  k_mutex_unlock(&sched_index_lock);
+}
+
+void gdo_schedule_index_refresh(void)
+{
+  gdo_schedule_store_reindex(SCHEDULE_NUM);
+}
+
+int gdo_schedule_index_peek(size_t *slot, int64_t *due)
+{
+  int res = -ENOENT;
+
+  k_mutex_lock(&sched_index_lock, K_FOREVER);
+  if (sched_heap_len > 0) {
+    *slot = sched_heap[0].slot;
+    *due  = sched_heap[0].due;
+    res   = 0;
+  }
+  k_mutex_unlock(&sched_index_lock);
+  return res;
+}
@@ -0,0 +1,74 @@
+#ifndef _GDO_SCHEDULE_INDEX_H_
+#define _GDO_SCHEDULE_INDEX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "gdo_schedule.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* next_due result of a schedule that never fires (disabled or empty slot) */
+#define GDO_SCHEDULE_NEVER INT64_MAX
+
+/**
+ * Next occurrence of a schedule strictly after @p now, both in k_uptime_get() milliseconds, or
+ * GDO_SCHEDULE_NEVER. Provided by the schedule engine, which owns the meaning of schedule_data and
+ * the wall clock. Called with the schedule store locked: it must only compute.
+ */
+typedef int64_t (*gdo_schedule_next_due_t)(const struct schedule_data *data, int64_t now);
+
+/**
+ * A schedule is due. Runs on the system work queue, @p data is a copy of the slot.
+ */
+typedef void (*gdo_schedule_fire_t)(size_t slot, const struct schedule_data *data, void *user_data);
+
+/*
+ * Next-due index over the schedule store.
+ *
+ * A min-heap of (next occurrence, slot) built once from the RAM table of the schedule store and
+ * kept up to date by the store on every slot write, so evaluating costs no flash access and no
+ * scan. A single k_timer is armed for the head of the heap; nothing wakes the device between two
+ * occurrences.
+ */
+
+/**
+ * @brief Build the heap from the schedule store and arm the timer.
+ *
+ * @return 0, or -EINVAL without callbacks.
+ */
+int gdo_schedule_index_start(gdo_schedule_next_due_t next_due, gdo_schedule_fire_t fire, void *user_data);
+
+/**
+ * @brief Stop the timer and drop the heap.
+ */
+void gdo_schedule_index_stop(void);
+
+/**
+ * @brief Recompute every slot, e.g. after the wall clock was set.
+ */
+void gdo_schedule_index_refresh(void);
+
+/**
+ * @brief Earliest pending schedule, O(1).
+ *
+ * @return 0, or -ENOENT if nothing is pending.
+ */
+int gdo_schedule_index_peek(size_t *slot, int64_t *due);
+
+/**
+ * @brief Re-key one slot after it was written, O(log n). Called by the schedule store.
+ */
+void gdo_schedule_index_on_write(size_t slot, const struct schedule_data *data);
+
+/**
+ * @brief Rebuild after the whole table was replaced. Called by the schedule store.
+ */
+void gdo_schedule_index_on_write_all(const struct schedule_data *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,343 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_file_system_util.h"
+#include "gdo_schedule.h"
+#include "gdo_schedule_store.h"
+#include "gdo_schedule_index.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+#define SCHED_BASE_MAGIC    0x53434842 /* "SCHB" */
+#define SCHED_JOURNAL_MAGIC 0x534A
+
+struct sched_base_header {
+  uint32_t magic;
+  uint32_t generation;
+  uint32_t crc; /* over the SCHEDULE_NUM records */
+} __packed;
+
+struct sched_journal_record {
+  uint16_t magic;
+  uint16_t slot;
+  uint32_t generation;
+  struct schedule_data data;
+  uint32_t crc; /* over everything above */
+} __packed;
+
+K_MUTEX_DEFINE(sched_store_lock);
+
+/* two base generations: a compaction replaces the older one, the previous stays until the next */
+static const char *const sched_base_path[] = {GDO_SCHEDULE_BASE_FULL_PATH, GDO_SCHEDULE_BASE_B_FULL_PATH};
+
+static struct schedule_data sched_table[SCHEDULE_NUM];
+/* previous table while a full replace is written, under sched_store_lock */
+static struct schedule_data sched_work[SCHEDULE_NUM];
+static uint32_t sched_generation;
+static uint8_t sched_base_slot;
+static size_t sched_journal_records;
+static bool sched_loaded;
+
+static uint32_t sched_record_crc(const struct sched_journal_record *rec)
+{
+  return crc32_ieee((const uint8_t *) rec, offsetof(struct sched_journal_record, crc));
+}
+
+/* Write the table as the next generation over the older base, then drop the journal. Caller holds sched_store_lock. */
+static int sched_write_base(void)
+{
+  uint8_t slot = !sched_base_slot;
+  struct sched_base_header header = {
+      .magic      = SCHED_BASE_MAGIC,
+      .generation = sched_generation + 1,
+      .crc        = crc32_ieee((const uint8_t *) sched_table, sizeof(sched_table)),
+  };
+  struct gdo_fs_iovec iov[] = {
+      {.index = 0, .buff = &header, .len = sizeof(header)},
+      {.index = sizeof(header), .buff = sched_table, .len = sizeof(sched_table)},
+  };
+
+  if (!gdo_fs_create_file(GDO_SCHEDULE_BASE_TMP_FULL_PATH, sizeof(header) + sizeof(sched_table))) {
+    return -EIO;
+  }
+  if (gdo_fs_writev_index(GDO_DISK_MOUNT_PT, GDO_SCHEDULE_BASE_TMP_FULL_PATH, iov, ARRAY_SIZE(iov)) < 0) {
+    return -EIO;
+  }
+  int res = gdo_fs_rename(GDO_SCHEDULE_BASE_TMP_FULL_PATH, sched_base_path[slot]);
+  if (res != 0) {
+    return res;
+  }
+  /* from here the old journal belongs to an older generation and is ignored if the truncate is lost */
+  sched_generation      = header.generation;
+  sched_base_slot       = slot;
+  sched_journal_records = 0;
+  return gdo_fs_create_file(GDO_SCHEDULE_JOURNAL_FULL_PATH, 0) ? 0 : -EIO;
+}
+
+static int sched_read_header(uint8_t slot, struct sched_base_header *header)
+{
+  if (gdo_fs_file_size(sched_base_path[slot]) == -ENOENT) {
+    return -ENOENT;
+  }
+  if (gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, sched_base_path[slot], header, sizeof(*header), 0) !=
+      sizeof(*header)) {
+    return -EIO;
+  }
+  return (header->magic == SCHED_BASE_MAGIC) ? 0 : -EINVAL;
+}
+
+/*
+ * Highest generation in either base header, damaged table or not, 0 if there is none; @p slot
+ * is set to the base holding it. Caller holds sched_store_lock.
+ */
+static uint32_t sched_newest_generation(uint8_t *slot)
+{
+  struct sched_base_header header;
+  uint32_t newest = 0;
+
+  *slot = 0;
+  for (uint8_t i = 0; i < ARRAY_SIZE(sched_base_path); i++) {
+    if (sched_read_header(i, &header) == 0 && header.generation > newest) {
+      newest = header.generation;
+      *slot  = i;
+    }
+  }
+  return newest;
+}
+
+static int sched_load_base(uint8_t slot)
+{
+  struct sched_base_header header;
+  int res = sched_read_header(slot, &header);
+
+  if (res != 0) {
+    return res;
+  }
+  if (gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, sched_base_path[slot], sched_table, sizeof(sched_table),
+                             sizeof(header)) != sizeof(sched_table)) {
+    return -EIO;
+  }
+  if (crc32_ieee((const uint8_t *) sched_table, sizeof(sched_table)) != header.crc) {
+    LOG_ERR("SCHEDULE-STORE: base %u generation %u crc mismatch", slot, header.generation);
+    return -EINVAL;
+  }
+  sched_generation = header.generation;
+  sched_base_slot  = slot;
+  return 0;
+}
+
+/* Seed the table from the legacy full copies, current first */
+static void sched_load_legacy(void)
+{
+  memset(sched_table, 0, sizeof(sched_table));
+  if (gdo_fs_file_size(SCHEDULE_CURRENT_FILE_FULL_PATH) == sizeof(sched_table) &&
+      gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, SCHEDULE_CURRENT_FILE_FULL_PATH, sched_table, sizeof(sched_table), 0) ==
+          sizeof(sched_table)) {
+    return;
+  }
+  if (gdo_fs_file_size(SCHEDULE_BACKUP_FILE_FULL_PATH) == sizeof(sched_table) &&
+      gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, SCHEDULE_BACKUP_FILE_FULL_PATH, sched_table, sizeof(sched_table), 0) ==
+          sizeof(sched_table)) {
+    return;
+  }
+  memset(sched_table, 0, sizeof(sched_table));
+}
+
+/* Apply the journal to the loaded base: 1 if it should be folded into a new base, 0, or negative */
+static int sched_replay_journal(void)
+{
+  struct sched_journal_record rec;
+  int size = gdo_fs_file_size(GDO_SCHEDULE_JOURNAL_FULL_PATH);
+  size_t count;
+
+  if (size == -ENOENT) {
+    return gdo_fs_create_file(GDO_SCHEDULE_JOURNAL_FULL_PATH, 0) ? 0 : -EIO;
+  }
+  if (size < 0) {
+    return size;
+  }
+  count = size / sizeof(rec);
+  sched_journal_records = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, GDO_SCHEDULE_JOURNAL_FULL_PATH, &rec, sizeof(rec), i * sizeof(rec)) !=
+        sizeof(rec)) {
+      return -EIO;
+    }
+    if (rec.magic != SCHED_JOURNAL_MAGIC || rec.crc != sched_record_crc(&rec) || rec.slot >= SCHEDULE_NUM) {
+      LOG_ERR("SCHEDULE-STORE: journal ends at damaged record %u", i);
+      break;
+    }
+    if (rec.generation != sched_generation) {
+      /* left over from before the last compaction */
+      continue;
+    }
+    sched_table[rec.slot] = rec.data;
+    sched_journal_records++;
+  }
+  /* fold what is valid into a new base so a damaged, partial or stale tail goes away */
+  return (sched_journal_records != count || (size % sizeof(rec)) != 0) ? 1 : 0;
+}
+
+int gdo_schedule_store_init(void)
+{
+  uint8_t newest_slot;
+  int res;
+
+  k_mutex_lock(&sched_store_lock, K_FOREVER);
+  uint32_t newest = sched_newest_generation(&newest_slot);
+
+  res = sched_load_base(newest_slot);
+  if (res == 0) {
+    res = sched_replay_journal();
+  } else {
+    int prev = sched_load_base(!newest_slot);
+
+    if (prev == 0) {
+      /* its journal records still apply; the damaged base is replaced right after */
+      LOG_ERR("SCHEDULE-STORE: base generation %u damaged (%d), back to generation %u", newest, res, sched_generation);
+      res = sched_replay_journal();
+      res = (res < 0) ? res : 1;
+    } else if (res == -ENOENT && prev == -ENOENT && gdo_fs_file_size(GDO_SCHEDULE_JOURNAL_FULL_PATH) == -ENOENT) {
+      /* the only time the legacy copies are read, every later boot finds a base */
+      LOG_INF("SCHEDULE-STORE: no base, migrating the legacy copies");
+      sched_load_legacy();
+      res = 1;
+    } else {
+      LOG_ERR("SCHEDULE-STORE: no valid base (%d, %d), schedules are lost", res, prev);
+      memset(sched_table, 0, sizeof(sched_table));
+      res = 1;
+    }
+  }
+  if (res > 0) {
+    /* past every generation on flash, so no stale journal record can match the new base */
+    sched_generation = MAX(sched_generation, newest);
+    res              = sched_write_base();
+  }
+  sched_loaded = (res == 0);
+  k_mutex_unlock(&sched_store_lock);
+  return res;
+}
+
+int gdo_schedule_store_read(size_t slot, struct schedule_data *data)
+{
+  if (slot >= SCHEDULE_NUM) {
+    return -EINVAL;
+  }
+  k_mutex_lock(&sched_store_lock, K_FOREVER);
+  *data = sched_table[slot];
+  k_mutex_unlock(&sched_store_lock);
+  return 0;
+}
+
+int gdo_schedule_store_read_all(struct schedule_data *data)
+{
+  k_mutex_lock(&sched_store_lock, K_FOREVER);
+  memcpy(data, sched_table, sizeof(sched_table));
+  k_mutex_unlock(&sched_store_lock);
+  return 0;
+}
+
+int gdo_schedule_store_write(size_t slot, const struct schedule_data *data)
+{
+  struct sched_journal_record rec;
+  int res = 0;
+
+  if (slot >= SCHEDULE_NUM) {
+    return -EINVAL;
+  }
+  memset(&rec, 0, sizeof(rec));
+  k_mutex_lock(&sched_store_lock, K_FOREVER);
+  if (memcmp(&sched_table[slot], data, sizeof(*data)) == 0) {
+    goto exit;
+  }
+  rec.magic      = SCHED_JOURNAL_MAGIC;
+  rec.slot       = slot;
+  rec.generation = sched_generation;
+  rec.data       = *data;
+  rec.crc        = sched_record_crc(&rec);
+  if (gdo_fs_write_file(GDO_DISK_MOUNT_PT, GDO_SCHEDULE_JOURNAL_FULL_PATH, &rec, sizeof(rec)) != sizeof(rec)) {
+    res = -EIO;
+    goto exit;
+  }
+  sched_table[slot] = *data;
+  gdo_schedule_index_on_write(slot, data);
+  if (++sched_journal_records >= GDO_SCHEDULE_JOURNAL_MAX_RECORDS && sched_write_base() != 0) {
+    /* the slot is in the journal already, the next write tries the compaction again */
+    LOG_ERR("SCHEDULE-STORE: compaction failed, journal at %u records", sched_journal_records);
+  }
+exit:
+  k_mutex_unlock(&sched_store_lock);
+  return res;
+}
+
+/* Replace the table with @p data, or zeros for NULL, as a new base. Caller holds sched_store_lock. */
+static int sched_replace(const struct schedule_data *data)
+{
+  if (!sched_loaded) {
+    /* a reset before gdo_schedule_store_init(), continue the generation on flash and keep the newest base */
+    sched_generation = sched_newest_generation(&sched_base_slot);
+  }
+  memcpy(sched_work, sched_table, sizeof(sched_work));
+  if (data != NULL) {
+    memcpy(sched_table, data, sizeof(sched_table));
+  } else {
+    memset(sched_table, 0, sizeof(sched_table));
+  }
+  int res = sched_write_base();
+  if (res != 0) {
+    memcpy(sched_table, sched_work, sizeof(sched_table));
+  } else {
+    gdo_schedule_index_on_write_all(sched_table);
+  }
+  return res;
+}
+
+int gdo_schedule_store_write_all(const struct schedule_data *data)
+{
+  k_mutex_lock(&sched_store_lock, K_FOREVER);
+  int res = sched_replace(data);
+  k_mutex_unlock(&sched_store_lock);
+  return res;
+}
+
+int gdo_schedule_store_clear(void)
+{
+  k_mutex_lock(&sched_store_lock, K_FOREVER);
+  int res = sched_replace(NULL);
+  k_mutex_unlock(&sched_store_lock);
+  return res;
+}
+
+int gdo_schedule_store_compact(void)
+{
+  k_mutex_lock(&sched_store_lock, K_FOREVER);
+  int res = (sched_journal_records == 0) ? 0 : sched_write_base();
+  k_mutex_unlock(&sched_store_lock);
+  return res;
+}
+
+int gdo_schedule_store_reindex(size_t slot)
+{
+  k_mutex_lock(&sched_store_lock, K_FOREVER);
+  if (slot < SCHEDULE_NUM) {
+    gdo_schedule_index_on_write(slot, &sched_table[slot]);
+  } else {
+    gdo_schedule_index_on_write_all(sched_table);
+  }
+  k_mutex_unlock(&sched_store_lock);
+  return 0;
+}
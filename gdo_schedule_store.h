@@ -0,0 +1,72 @@
+#ifndef _GDO_SCHEDULE_STORE_H_
+#define _GDO_SCHEDULE_STORE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "gdo_config.h"
+#include "gdo_schedule.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef GDO_SCHEDULE_BASE_FULL_PATH
+#define GDO_SCHEDULE_BASE_FULL_PATH GDO_DISK_MOUNT_PT "/sch_base"
+#endif
+
+#ifndef GDO_SCHEDULE_BASE_B_FULL_PATH
+#define GDO_SCHEDULE_BASE_B_FULL_PATH GDO_DISK_MOUNT_PT "/sch_base_b"
+#endif
+
+#ifndef GDO_SCHEDULE_BASE_TMP_FULL_PATH
+#define GDO_SCHEDULE_BASE_TMP_FULL_PATH GDO_DISK_MOUNT_PT "/sch_base.tmp"
+#endif
+
+#ifndef GDO_SCHEDULE_JOURNAL_FULL_PATH
+#define GDO_SCHEDULE_JOURNAL_FULL_PATH GDO_DISK_MOUNT_PT "/sch_jnl"
+#endif
+
+/* Journal records kept before they are folded into a new base image */
+#ifndef GDO_SCHEDULE_JOURNAL_MAX_RECORDS
+#define GDO_SCHEDULE_JOURNAL_MAX_RECORDS (2 * SCHEDULE_NUM)
+#endif
+
+/*
+ * Journaled schedule storage.
+ *
+ * The table is a base image (header with generation and CRC, then SCHEDULE_NUM records)
+ * plus an append-only journal of changed slots tagged with the base generation. A slot
+ * update is one small append. Compaction writes the next generation to a temporary file
+ * and renames it over the older of two bases (A/B), the previous generation stays until the
+ * next compaction. Journal records of another generation are ignored, so a power loss at any
+ * point recovers either the old or the new state.
+ *
+ * Start-up loads the newest base with a valid CRC. If the newest one is damaged, the previous
+ * generation plus its journal records is used and the damaged base is rewritten.
+ * SCHEDULE_CURRENT_FILE_FULL_PATH (or the backup copy) only seeds the first base, when no base
+ * and no journal exist yet.
+ *
+ * Functions return 0 on success or a negative error code.
+ */
+int gdo_schedule_store_init(void);
+int gdo_schedule_store_read(size_t slot, struct schedule_data *data);
+int gdo_schedule_store_read_all(struct schedule_data *data);
+int gdo_schedule_store_write(size_t slot, const struct schedule_data *data);
+int gdo_schedule_store_write_all(const struct schedule_data *data);
+/**
+ * @brief Empty every slot. Every schedule reset goes through here (gdo_fs_reset_file()), also
+ *        before gdo_schedule_store_init().
+ */
+int gdo_schedule_store_clear(void);
+int gdo_schedule_store_compact(void);
+
+/*
+ * Feeds the next-due index (gdo_schedule_index) from the RAM table under the store lock: one
+ * slot, or every slot for SCHEDULE_NUM. Slot writes do this on their own.
+ */
+int gdo_schedule_store_reindex(size_t slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,310 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_file_system_util.h"
+#include "gdo_fs_files.h"
+#include "gdo_user_infor_util.h"
+#include "gdo_user_index.h"
+#include "gdo_user_bulk.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+#define USER_LIST_WORDS ((GDO_MAX_USER_SUPORT + 31) / 32)
+
+#define USER_BATCH_MAGIC 0x55424154 /* "UBAT" */
+
+/* Intent file: this header, the slot of every record, then the records */
+struct user_batch_header {
+  uint32_t magic;
+  uint32_t count;
+  uint32_t crc; /* over the slots and the records */
+} __packed;
+
+#define USER_BATCH_SLOTS_INDEX        sizeof(struct user_batch_header)
+#define USER_BATCH_RECORD_INDEX(n, k) (USER_BATCH_SLOTS_INDEX + (n) * sizeof(uint16_t) + (k) * sizeof(gdo_user_infor))
+
+/* One batch at a time, slots are picked from the index and written under it */
+K_MUTEX_DEFINE(user_bulk_lock);
+static struct gdo_fs_iovec user_bulk_iov[GDO_MAX_USER_SUPORT];
+static struct gdo_fs_iovec user_batch_iov[GDO_MAX_USER_SUPORT + 2];
+static uint16_t user_batch_slots[GDO_MAX_USER_SUPORT];
+static gdo_user_infor user_bulk_record;
+static const gdo_user_infor user_bulk_zero;
+
+/* Rebuild the caller's bitmap and count from the index, which the batch write just updated */
+static int user_bulk_sync_list(uint32_t *user_list, size_t *number_user)
+{
+  gdo_user_index_entry entry;
+  size_t count = 0;
+
+  memset(user_list, 0, USER_LIST_WORDS * sizeof(uint32_t));
+  for (size_t slot = 0; slot < GDO_MAX_USER_SUPORT; slot++) {
+    gdo_user_index_get(slot, &entry);
+    if (entry.user_status != USER_NOT_EXIST) {
+      user_list[slot / 32] |= BIT(slot % 32);
+      count++;
+    }
+  }
+  *number_user = count;
+  return count;
+}
+
+/* First empty slot not already given to a user of this batch */
+static int user_bulk_claim(const bool *taken)
+{
+  gdo_user_index_entry entry;
+
+  for (size_t slot = 0; slot < GDO_MAX_USER_SUPORT; slot++) {
+    gdo_user_index_get(slot, &entry);
+    if (entry.user_status == USER_NOT_EXIST && !taken[slot]) {
+      return slot;
+    }
+  }
+  return -USER_UTIL_NO_SLOT_EMPTY;
+}
+
+/*
+ * Stage the @p count whole records of user_bulk_iov as the intent file. The rename is the commit
+ * point: before it the table is untouched, after it the batch is rolled forward even if the
+ * table write is cut. Under user_bulk_lock.
+ */
+static int user_batch_stage(size_t count)
+{
+  struct user_batch_header header = {.magic = USER_BATCH_MAGIC, .count = count};
+  size_t size                     = USER_BATCH_RECORD_INDEX(count, count);
+
+  for (size_t k = 0; k < count; k++) {
+    user_batch_slots[k] = user_bulk_iov[k].index / sizeof(gdo_user_infor);
+  }
+  header.crc = crc32_ieee((const uint8_t *) user_batch_slots, count * sizeof(uint16_t));
+  user_batch_iov[0] = (struct gdo_fs_iovec){.index = 0, .buff = &header, .len = sizeof(header)};
+  user_batch_iov[1] = (struct gdo_fs_iovec){
+      .index = USER_BATCH_SLOTS_INDEX, .buff = user_batch_slots, .len = count * sizeof(uint16_t)};
+  for (size_t k = 0; k < count; k++) {
+    header.crc = crc32_ieee_update(header.crc, user_bulk_iov[k].buff, sizeof(gdo_user_infor));
+    user_batch_iov[2 + k] = (struct gdo_fs_iovec){
+        .index = USER_BATCH_RECORD_INDEX(count, k), .buff = user_bulk_iov[k].buff, .len = sizeof(gdo_user_infor)};
+  }
+  if (!gdo_fs_create_file(GDO_USER_BATCH_TMP_FULL_PATH, size) ||
+      gdo_fs_writev_index(GDO_DISK_MOUNT_PT, GDO_USER_BATCH_TMP_FULL_PATH, user_batch_iov, count + 2) < 0) {
+    return -USER_UTIL_ACCESS_FILE_ERR;
+  }
+  return (gdo_fs_rename(GDO_USER_BATCH_TMP_FULL_PATH, GDO_USER_BATCH_FULL_PATH) == 0) ? 0 : -USER_UTIL_ACCESS_FILE_ERR;
+}
+
+/* Write the staged records to the table, then drop the intent. Under user_bulk_lock. */
+static int user_batch_apply(size_t count)
+{
+  if (gdo_fs_writev_index(GDO_DISK_MOUNT_PT, GDO_USER_INFOR_FULL_PATH, user_bulk_iov, count) < 0) {
+    /* the intent stays, the next batch or the next boot finishes it */
+    return -USER_UTIL_ACCESS_FILE_ERR;
+  }
+  return (gdo_fs_unlink(GDO_USER_BATCH_FULL_PATH) == 0) ? 0 : -USER_UTIL_ACCESS_FILE_ERR;
+}
+
+/* Roll a committed intent file forward, drop a damaged one. Under user_bulk_lock. */
+static int user_batch_recover(void)
+{
+  struct user_batch_header header;
+  int size = gdo_fs_file_size(GDO_USER_BATCH_FULL_PATH);
+  uint32_t crc;
+  int res = 0;
+
+  if (size == -ENOENT) {
+    return 0;
+  }
+  if (size < (int) sizeof(header) ||
+      gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, GDO_USER_BATCH_FULL_PATH, &header, sizeof(header), 0) !=
+          sizeof(header) ||
+      header.magic != USER_BATCH_MAGIC || header.count == 0 || header.count > GDO_MAX_USER_SUPORT ||
+      size != USER_BATCH_RECORD_INDEX(header.count, header.count) ||
+      gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, GDO_USER_BATCH_FULL_PATH, user_batch_slots,
+                             header.count * sizeof(uint16_t), USER_BATCH_SLOTS_INDEX) !=
+          header.count * sizeof(uint16_t)) {
+    res = -EINVAL;
+  }
+  /* checked whole before the first record is written */
+  crc = (res == 0) ? crc32_ieee((const uint8_t *) user_batch_slots, header.count * sizeof(uint16_t)) : 0;
+  for (size_t k = 0; res == 0 && k < header.count; k++) {
+    if (user_batch_slots[k] >= GDO_MAX_USER_SUPORT ||
+        gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, GDO_USER_BATCH_FULL_PATH, &user_bulk_record,
+                               sizeof(user_bulk_record), USER_BATCH_RECORD_INDEX(header.count, k)) !=
+            sizeof(user_bulk_record)) {
+      res = -EINVAL;
+      break;
+    }
+    crc = crc32_ieee_update(crc, (const uint8_t *) &user_bulk_record, sizeof(user_bulk_record));
+  }
+  if (res == 0 && crc != header.crc) {
+    res = -EINVAL;
+  }
+  if (res != 0) {
+    /* cannot happen after a complete rename, but never apply half a batch */
+    LOG_ERR("USER-BULK: damaged batch intent dropped");
+    return (gdo_fs_unlink(GDO_USER_BATCH_FULL_PATH) == 0) ? 0 : -USER_UTIL_ACCESS_FILE_ERR;
+  }
+  LOG_INF("USER-BULK: finishing a batch of %u users", header.count);
+  /* every record is written whole, so a cut replay is simply replayed again */
+  for (size_t k = 0; k < header.count; k++) {
+    if (gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, GDO_USER_BATCH_FULL_PATH, &user_bulk_record,
+                               sizeof(user_bulk_record), USER_BATCH_RECORD_INDEX(header.count, k)) !=
+            sizeof(user_bulk_record) ||
+        gdo_fs_write_record(GDO_FILE_USERS, user_batch_slots[k], &user_bulk_record) != sizeof(user_bulk_record)) {
+      return -USER_UTIL_ACCESS_FILE_ERR;
+    }
+  }
+  return (gdo_fs_unlink(GDO_USER_BATCH_FULL_PATH) == 0) ? 0 : -USER_UTIL_ACCESS_FILE_ERR;
+}
+
+/* Stage and write one batch of whole records. Under user_bulk_lock. */
+static int user_batch_write(size_t count)
+{
+  int res = user_batch_stage(count);
+
+  if (res == 0) {
+    res = user_batch_apply(count);
+  }
+  return res;
+}
+
+int gdo_user_bulk_recover(void)
+{
+  k_mutex_lock(&user_bulk_lock, K_FOREVER);
+  int res = user_batch_recover();
+  k_mutex_unlock(&user_bulk_lock);
+  return res;
+}
+
+int gdo_user_bulk_discard(void)
+{
+  k_mutex_lock(&user_bulk_lock, K_FOREVER);
+  int res = gdo_fs_unlink(GDO_USER_BATCH_FULL_PATH);
+  k_mutex_unlock(&user_bulk_lock);
+  return (res == 0 || res == -ENOENT) ? 0 : res;
+}
+
+int gdo_user_add_users(const gdo_user_infor *users, size_t n, uint32_t *user_list, size_t *number_user)
+{
+  struct gdo_fs_iovec *iov = user_bulk_iov;
+  bool taken[GDO_MAX_USER_SUPORT];
+  size_t count = 0;
+  int res      = 0;
+
+  memset(taken, 0, sizeof(taken));
+  k_mutex_lock(&user_bulk_lock, K_FOREVER);
+  /* an earlier batch left staged is finished before slots are picked from the index */
+  res = user_batch_recover();
+  for (size_t i = 0; i < n && res >= 0; i++) {
+    const gdo_user_infor *user = &users[i];
+    size_t j;
+
+    for (j = 0; j < count; j++) {
+      if (memcmp(((const gdo_user_infor *) iov[j].buff)->user_name, user->user_name, sizeof(user->user_name)) == 0) {
+        break;
+      }
+    }
+    if (j < count) {
+      /* repeated in the batch, the last entry wins */
+      iov[j].buff = (void *) user;
+      continue;
+    }
+    res = gdo_user_index_lookup(user->user_name, NULL);
+    if (res == -USER_UTIL_USER_NOT_EXIST) {
+      res = user_bulk_claim(taken);
+    }
+    if (res < 0) {
+      break;
+    }
+    taken[res]   = true;
+    iov[count++] = (struct gdo_fs_iovec){.index = res * sizeof(gdo_user_infor), .buff = (void *) user,
+                                         .len = sizeof(gdo_user_infor)};
+  }
+  if (res >= 0 && count > 0 && user_batch_write(count) != 0) {
+    /* a staged batch is finished later, the index follows the table until then */
+    user_bulk_sync_list(user_list, number_user);
+    res = -USER_UTIL_ACCESS_FILE_ERR;
+  }
+  if (res >= 0) {
+    res = user_bulk_sync_list(user_list, number_user);
+  }
+  k_mutex_unlock(&user_bulk_lock);
+  if (res < 0) {
+    LOG_ERR("USER-BULK: add of %u users failed %d", n, res);
+  }
+  return res;
+}
+
+int gdo_user_remove_users(gdo_user_predicate_t predicate, void *user_data, uint32_t *user_list, size_t *number_user)
+{
+  gdo_user_index_entry entry;
+  size_t count = 0;
+  int res      = 0;
+
+  k_mutex_lock(&user_bulk_lock, K_FOREVER);
+  res = user_batch_recover();
+  for (size_t slot = 0; slot < GDO_MAX_USER_SUPORT && res == 0; slot++) {
+    gdo_user_index_get(slot, &entry);
+    if (entry.user_status == USER_NOT_EXIST) {
+      continue;
+    }
+    if (gdo_fs_read_record(GDO_FILE_USERS, slot, &user_bulk_record) != sizeof(user_bulk_record)) {
+      res = -USER_UTIL_ACCESS_FILE_ERR;
+      break;
+    }
+    if (predicate(&user_bulk_record, slot, user_data)) {
+      user_bulk_iov[count++] = (struct gdo_fs_iovec){.index = slot * sizeof(gdo_user_infor),
+                                                     .buff = (void *) &user_bulk_zero, .len = sizeof(gdo_user_infor)};
+    }
+  }
+  /* whole records cleared, keys included, in one batch */
+  if (res == 0 && count > 0 && user_batch_write(count) != 0) {
+    user_bulk_sync_list(user_list, number_user);
+    res = -USER_UTIL_ACCESS_FILE_ERR;
+  }
+  if (res == 0) {
+    user_bulk_sync_list(user_list, number_user);
+    res = count;
+  }
+  k_mutex_unlock(&user_bulk_lock);
+  if (res < 0) {
+    LOG_ERR("USER-BULK: remove failed %d", res);
+  }
+  return res;
+}
+
+void gdo_user_export_begin(struct gdo_user_export *it)
+{
+  it->slot = 0;
+}
+
+int gdo_user_export_next(struct gdo_user_export *it, gdo_user_infor *user)
+{
+  gdo_user_index_entry entry;
+
+  for (; it->slot < GDO_MAX_USER_SUPORT; it->slot++) {
+    gdo_user_index_get(it->slot, &entry);
+    if (entry.user_status == USER_NOT_EXIST) {
+      continue;
+    }
+    size_t slot = it->slot++;
+    if (gdo_fs_read_record(GDO_FILE_USERS, slot, user) != sizeof(*user)) {
+      return -USER_UTIL_ACCESS_FILE_ERR;
+    }
+    return slot;
+  }
+  return -USER_UTIL_USER_NOT_EXIST;
+}
@@ -0,0 +1,96 @@
+#ifndef _GDO_USER_BULK_H_
+#define _GDO_USER_BULK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "gdo_config.h"
+#include "gdo_user_infor_util.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef GDO_USER_BATCH_FULL_PATH
+#define GDO_USER_BATCH_FULL_PATH GDO_DISK_MOUNT_PT "/user_batch"
+#endif
+
+#ifndef GDO_USER_BATCH_TMP_FULL_PATH
+#define GDO_USER_BATCH_TMP_FULL_PATH GDO_DISK_MOUNT_PT "/user_batch.tmp"
+#endif
+
+/*
+ * Batch variants of gdo_user_add_user/gdo_user_remove_user. A batch is atomic: its whole
+ * records are first staged in an intent file (written to a temporary file, then renamed to
+ * GDO_USER_BATCH_FULL_PATH), then written to the user table with one gdo_fs_writev_index.
+ * A power loss before the rename leaves the table untouched, one after it is finished by
+ * gdo_user_bulk_recover() at boot. A table write that fails after the rename is finished by the
+ * next batch or at the next boot. @p user_list (bit per slot) and @p number_user are updated in
+ * RAM only, also after a failed write so they match the index; the caller persists them once for
+ * the whole batch.
+ */
+
+/**
+ * @brief Select users for gdo_user_remove_users(), true removes @p user.
+ */
+typedef bool (*gdo_user_predicate_t)(const gdo_user_infor *user, size_t slot, void *user_data);
+
+/**
+ * @brief Add or update @p n users.
+ *
+ * A user already in the table is rewritten in its slot, a new one takes a free slot. Nothing
+ * is written unless every new user gets a slot. The same user_name twice in @p users ends in
+ * one slot holding the last entry.
+ *
+ * @return Number of users linked on success, -USER_UTIL_NO_SLOT_EMPTY if the table is too full,
+ *         -USER_UTIL_ACCESS_FILE_ERR if the user file cannot be read or written.
+ */
+int gdo_user_add_users(const gdo_user_infor *users, size_t n, uint32_t *user_list, size_t *number_user);
+
+/**
+ * @brief Remove every user for which @p predicate returns true.
+ *
+ * The whole records are cleared, keys included, in one batch.
+ *
+ * @return Number of users removed, or -USER_UTIL_ACCESS_FILE_ERR.
+ */
+int gdo_user_remove_users(gdo_user_predicate_t predicate, void *user_data, uint32_t *user_list, size_t *number_user);
+
+/**
+ * @brief Finish a batch staged before a power loss, drop a damaged intent file.
+ *
+ * Called by gdo_file_system_init before the user index is built.
+ *
+ * @return 0, or -USER_UTIL_ACCESS_FILE_ERR if the staged records cannot be written.
+ */
+int gdo_user_bulk_recover(void);
+
+/**
+ * @brief Drop a staged batch without applying it. The user table reset calls this first.
+ *
+ * @return 0 or a negative error code.
+ */
+int gdo_user_bulk_discard(void);
+
+/* Export cursor, initialise with gdo_user_export_begin() */
+struct gdo_user_export {
+  size_t slot;
+};
+
+void gdo_user_export_begin(struct gdo_user_export *it);
+
+/**
+ * @brief Copy the next existing user into @p user, one record read per call.
+ *
+ * Empty slots are skipped from the RAM index without touching flash. Each record is consistent,
+ * the sequence is not a snapshot: users added or removed during the export may be missed.
+ *
+ * @return Slot of the user, -USER_UTIL_USER_NOT_EXIST after the last one,
+ *         -USER_UTIL_ACCESS_FILE_ERR if the record cannot be read.
+ */
+int gdo_user_export_next(struct gdo_user_export *it, gdo_user_infor *user);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,256 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_file_system_util.h"
+#include "gdo_user_infor_util.h"
+#include "gdo_user_index.h"
+#include "gdo_fs_view.h"
+#include "gdo_user_store.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+/* Open addressing table, about half full when every slot is used */
+#define USER_INDEX_BUCKETS (2 * GDO_MAX_USER_SUPORT + 1)
+#define USER_INDEX_EMPTY   (-1)
+
+/* Slots read per access when the index is built from the dense hot file */
+#define USER_INDEX_BUILD_BATCH 8
+
+/* Where the user_name of a slot is confirmed: the hot file of the split layout, else the record */
+#if (GDO_USER_STORE_SPLIT)
+#define USER_INDEX_NAME_PATH   GDO_USER_HOT_FULL_PATH
+#define USER_INDEX_NAME_STRIDE sizeof(gdo_user_hot_infor)
+#define USER_INDEX_NAME_OFFSET offsetof(gdo_user_hot_infor, user_name)
+#else
+#define USER_INDEX_NAME_PATH   GDO_USER_INFOR_FULL_PATH
+#define USER_INDEX_NAME_STRIDE sizeof(gdo_user_infor)
+#define USER_INDEX_NAME_OFFSET offsetof(gdo_user_infor, user_name)
+#endif
+
+K_MUTEX_DEFINE(user_index_lock);
+
+static gdo_user_index_entry user_slots[GDO_MAX_USER_SUPORT];
+static int16_t user_buckets[USER_INDEX_BUCKETS];
+
+static uint32_t user_index_hash(const uint8_t *user_name)
+{
+  /* user_name is already a sha256 digest, its prefix is uniformly distributed */
+  return ((uint32_t) user_name[0] << 24) | ((uint32_t) user_name[1] << 16) | ((uint32_t) user_name[2] << 8) |
+         user_name[3];
+}
+
+/* Caller holds user_index_lock. The table is tiny, rehashing beats tombstone handling. */
+static void user_index_rehash(void)
+{
+  for (int i = 0; i < USER_INDEX_BUCKETS; i++) {
+    user_buckets[i] = USER_INDEX_EMPTY;
+  }
+  for (int slot = 0; slot < GDO_MAX_USER_SUPORT; slot++) {
+    if (user_slots[slot].user_status == USER_NOT_EXIST) {
+      continue;
+    }
+    uint32_t b = user_slots[slot].name_hash % USER_INDEX_BUCKETS;
+    while (user_buckets[b] != USER_INDEX_EMPTY) {
+      b = (b + 1) % USER_INDEX_BUCKETS;
+    }
+    user_buckets[b] = slot;
+  }
+}
+
+/*
+ * Lock order is file system first, then user_index_lock: the index never calls into
+ * gdo_fs_* while holding user_index_lock, and gdo_user_index_on_write runs with the
+ * file system lock held.
+ */
+static void user_index_fill(gdo_user_index_entry *entry, const uint8_t *user_name, uint8_t user_role,
+                            uint8_t user_status)
+{
+  entry->name_hash   = user_index_hash(user_name);
+  entry->user_role   = user_role;
+  entry->user_status = user_status;
+}
+
+/* Index entries of @p count slots from @p first, count at most USER_INDEX_BUILD_BATCH */
+static int user_index_read_slots(size_t first, size_t count, gdo_user_index_entry *entries)
+{
+#if (GDO_USER_STORE_SPLIT)
+  gdo_user_hot_infor hot[USER_INDEX_BUILD_BATCH];
+
+  /* the hot records are dense, the whole batch is one small read */
+  if (gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, GDO_USER_HOT_FULL_PATH, hot, count * sizeof(hot[0]),
+                             first * sizeof(hot[0])) != count * sizeof(hot[0])) {
+    return -USER_UTIL_ACCESS_FILE_ERR;
+  }
+  for (size_t i = 0; i < count; i++) {
+    user_index_fill(&entries[i], hot[i].user_name, hot[i].user_role, hot[i].user_status);
+  }
+#else
+  uint8_t hot[GDO_USER_INDEX_HOT_LEN];
+  const gdo_user_infor *rec = (const gdo_user_infor *) hot;
+
+  for (size_t i = 0; i < count; i++) {
+    if (gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, GDO_USER_INFOR_FULL_PATH, hot, sizeof(hot),
+                               (first + i) * sizeof(gdo_user_infor)) != sizeof(hot)) {
+      return -USER_UTIL_ACCESS_FILE_ERR;
+    }
+    user_index_fill(&entries[i], rec->user_name, rec->user_role, rec->user_status);
+  }
+#endif
+  return 0;
+}
+
+int gdo_user_index_build(void)
+{
+  gdo_user_index_entry slots[GDO_MAX_USER_SUPORT];
+  int res = 0;
+
+  memset(slots, 0, sizeof(slots));
+  for (size_t slot = 0; slot < GDO_MAX_USER_SUPORT; slot += USER_INDEX_BUILD_BATCH) {
+    res = user_index_read_slots(slot, MIN(USER_INDEX_BUILD_BATCH, GDO_MAX_USER_SUPORT - slot), &slots[slot]);
+    if (res != 0) {
+      LOG_ERR("USER-INDEX: read slot %u failed", slot);
+      memset(slots, 0, sizeof(slots));
+      break;
+    }
+  }
+  k_mutex_lock(&user_index_lock, K_FOREVER);
+  memcpy(user_slots, slots, sizeof(user_slots));
+  user_index_rehash();
+  k_mutex_unlock(&user_index_lock);
+  return res;
+}
+
+void gdo_user_index_reset(void)
+{
+  k_mutex_lock(&user_index_lock, K_FOREVER);
+  memset(user_slots, 0, sizeof(user_slots));
+  user_index_rehash();
+  k_mutex_unlock(&user_index_lock);
+}
+
+void gdo_user_index_on_write(const void *buff, size_t len, size_t index)
+{
+  const uint8_t *data = buff;
+  size_t first        = index / sizeof(gdo_user_infor);
+  size_t end          = index + len;
+
+  for (size_t slot = first; slot < GDO_MAX_USER_SUPORT; slot++) {
+    size_t rec_start = slot * sizeof(gdo_user_infor);
+    gdo_user_index_entry entry;
+
+    if (rec_start >= end) {
+      break;
+    }
+    if (rec_start + GDO_USER_INDEX_HOT_LEN <= index) {
+      /* write only touched the cold tail of this record */
+      continue;
+    }
+    if (data != NULL && rec_start >= index && rec_start + GDO_USER_INDEX_HOT_LEN <= end) {
+      const gdo_user_infor *rec = (const gdo_user_infor *) (data + (rec_start - index));
+
+      user_index_fill(&entry, rec->user_name, rec->user_role, rec->user_status);
+    } else if (user_index_read_slots(slot, 1, &entry) != 0) {
+      LOG_ERR("USER-INDEX: refresh slot %u failed", slot);
+      memset(&entry, 0, sizeof(entry));
+    }
+    k_mutex_lock(&user_index_lock, K_FOREVER);
+    user_slots[slot] = entry;
+    user_index_rehash();
+    k_mutex_unlock(&user_index_lock);
+  }
+}
+
+/* 1 if @p slot holds @p user_name, 0 if not, negative if the record cannot be read */
+static int user_index_name_match(int slot, const uint8_t *user_name)
+{
+  size_t index = slot * USER_INDEX_NAME_STRIDE + USER_INDEX_NAME_OFFSET;
+  uint8_t name[GDO_MAX_USER_NAME_LEN];
+  /* only the name is pinned, not the whole record */
+  const uint8_t *rec = gdo_fs_view_index(USER_INDEX_NAME_PATH, sizeof(name), index);
+  int res;
+
+  if (rec != NULL) {
+    /* the name stays cached for the next lookup of the same user */
+    res = memcmp(rec, user_name, sizeof(name)) == 0;
+    gdo_fs_release_view(rec);
+    return res;
+  }
+  if (gdo_fs_read_file_index(GDO_DISK_MOUNT_PT, USER_INDEX_NAME_PATH, name, sizeof(name), index) != sizeof(name)) {
+    return -USER_UTIL_ACCESS_FILE_ERR;
+  }
+  return memcmp(name, user_name, sizeof(name)) == 0;
+}
+
+int gdo_user_index_lookup(const uint8_t *user_name, gdo_user_index_entry *entry)
+{
+  uint32_t hash = user_index_hash(user_name);
+  int16_t candidates[GDO_MAX_USER_SUPORT];
+  gdo_user_index_entry found[GDO_MAX_USER_SUPORT];
+  int count = 0;
+
+  k_mutex_lock(&user_index_lock, K_FOREVER);
+  for (uint32_t b = hash % USER_INDEX_BUCKETS; user_buckets[b] != USER_INDEX_EMPTY; b = (b + 1) % USER_INDEX_BUCKETS) {
+    int slot = user_buckets[b];
+
+    if (user_slots[slot].name_hash == hash) {
+      found[count]        = user_slots[slot];
+      candidates[count++] = slot;
+    }
+  }
+  k_mutex_unlock(&user_index_lock);
+
+  /* almost always zero or one candidate, the 32-bit prefix only collides by accident */
+  for (int i = 0; i < count; i++) {
+    int match = user_index_name_match(candidates[i], user_name);
+
+    if (match < 0) {
+      return match;
+    }
+    if (match) {
+      if (entry != NULL) {
+        *entry = found[i];
+      }
+      return candidates[i];
+    }
+  }
+  return -USER_UTIL_USER_NOT_EXIST;
+}
+
+int gdo_user_index_free_slot(void)
+{
+  int res = -USER_UTIL_NO_SLOT_EMPTY;
+
+  k_mutex_lock(&user_index_lock, K_FOREVER);
+  for (int slot = 0; slot < GDO_MAX_USER_SUPORT; slot++) {
+    if (user_slots[slot].user_status == USER_NOT_EXIST) {
+      res = slot;
+      break;
+    }
+  }
+  k_mutex_unlock(&user_index_lock);
+  return res;
+}
+
+int gdo_user_index_get(size_t slot, gdo_user_index_entry *entry)
+{
+  if (slot >= GDO_MAX_USER_SUPORT) {
+    return -USER_UTIL_USER_INDEX_INVALID;
+  }
+  k_mutex_lock(&user_index_lock, K_FOREVER);
+  *entry = user_slots[slot];
+  k_mutex_unlock(&user_index_lock);
+  return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef _GDO_USER_INDEX_H_
+#define _GDO_USER_INDEX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "gdo_user_infor_util.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bytes at the start of a gdo_user_infor record that hold every field the index needs. */
+#define GDO_USER_INDEX_HOT_LEN (offsetof(gdo_user_infor, user_status) + sizeof(((gdo_user_infor *) 0)->user_status))
+
+typedef struct {
+  uint32_t name_hash; /* first 4 bytes of the sha256 user_name */
+  uint8_t user_role;
+  uint8_t user_status;
+} gdo_user_index_entry;
+
+/**
+ * @brief Build the in-RAM index from GDO_USER_INFOR_FULL_PATH.
+ *
+ * Reads the dense hot file of the split layout (GDO_USER_STORE_SPLIT) a few slots at a time, or
+ * the first GDO_USER_INDEX_HOT_LEN bytes of every slot of the single file. Called by
+ * gdo_file_system_init.
+ *
+ * @return 0 on success, or a negative error code if the user file cannot be read.
+ */
+int gdo_user_index_build(void);
+
+/**
+ * @brief Mark every slot empty, e.g. after the user file was recreated.
+ */
+void gdo_user_index_reset(void);
+
+/**
+ * @brief Keep the index coherent with a write of @p len bytes at byte offset @p index of the user file.
+ *
+ * Called by the file system layer after every successful write to GDO_USER_INFOR_FULL_PATH.
+ * Slots whose hot fields are only partly covered by the write are re-read from flash, all of
+ * them with @p buff NULL (a write that failed part way).
+ */
+void gdo_user_index_on_write(const void *buff, size_t len, size_t index);
+
+/**
+ * @brief Find the slot of an existing user.
+ *
+ * The candidate slot is picked from RAM and its full user_name is confirmed against a view of the
+ * record (gdo_fs_view_index), so a miss costs no flash access and a hit at most one record read,
+ * none while the record is still cached.
+ *
+ * @param[in]  user_name GDO_MAX_USER_NAME_LEN bytes sha256 name.
+ * @param[out] entry     Optional, receives role and status of the slot.
+ *
+ * @return Slot number on success, -USER_UTIL_USER_NOT_EXIST if the user is not present,
+ *         -USER_UTIL_ACCESS_FILE_ERR if the confirmation read failed.
+ */
+int gdo_user_index_lookup(const uint8_t *user_name, gdo_user_index_entry *entry);
+
+/**
+ * @brief Return the first slot with status USER_NOT_EXIST.
+ *
+ * @return Slot number on success, -USER_UTIL_NO_SLOT_EMPTY if the table is full.
+ */
+int gdo_user_index_free_slot(void);
+
+/**
+ * @brief Copy the cached role/status of a slot without touching flash.
+ *
+ * @return 0 on success, -USER_UTIL_USER_INDEX_INVALID if @p slot is out of range.
+ */
+int gdo_user_index_get(size_t slot, gdo_user_index_entry *entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
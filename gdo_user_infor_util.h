@@ -76,6 +76,7 @@ int gdo_user_infor_load_user_list(uint32_t *user_list);
    * @param user Pointer to the user information structure to be checked.
    * @return Returns 0 if the user information is valid and exists in the database, or a negative error code indicating failure.
    *
+   * @note The slot is resolved with gdo_user_index_lookup(), at most one flash read.
    */
 int gdo_user_check_user(gdo_user_infor *user, uint32_t *user_list);
 
@@ -0,0 +1,219 @@
+/********************************************************************
+ * COPYRIGHT (C) 2024 Assa Abloy. All rights reserved.
+ *
+ * This file is part of Havasu and is proprietary to Assa Abloy.
+ *
+ * No part of this file may be copied, reproduced, modified, published,
+ * uploaded, posted, transmitted, or distributed in any way, without
+ * the prior written permission of Assa Abloy.
+ *
+ * Created by: FPT Software. Date: Feb 01, 2024
+ ********************************************************************/
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_file_system_util.h"
+#include "gdo_user_store.h"
+
+LOG_MODULE_DECLARE(app, CONFIG_CHIP_APP_LOG_LEVEL);
+
+BUILD_ASSERT(sizeof(gdo_user_hot_infor) + sizeof(gdo_user_cold_infor) == sizeof(gdo_user_infor),
+             "every gdo_user_infor field must be in the hot or the cold part");
+
+enum user_store_part {
+  USER_STORE_HOT = 0x00,
+  USER_STORE_COLD,
+  USER_STORE_PARTS,
+};
+
+struct user_store_field {
+  uint16_t offset; /* in gdo_user_infor */
+  uint16_t len;
+  uint8_t part;
+  uint16_t part_offset; /* in the hot or cold record */
+};
+
+#define USER_STORE_FIELD(field, part, type)                                                                       \
+  {offsetof(gdo_user_infor, field), sizeof(((gdo_user_infor *) 0)->field), part, offsetof(type, field)}
+
+/* In gdo_user_infor order, so a range is cut front to back */
+static const struct user_store_field user_fields[] = {
+    USER_STORE_FIELD(user_name, USER_STORE_HOT, gdo_user_hot_infor),
+    USER_STORE_FIELD(pub_key, USER_STORE_COLD, gdo_user_cold_infor),
+    USER_STORE_FIELD(user_role, USER_STORE_HOT, gdo_user_hot_infor),
+    USER_STORE_FIELD(user_status, USER_STORE_HOT, gdo_user_hot_infor),
+    USER_STORE_FIELD(user_info, USER_STORE_COLD, gdo_user_cold_infor),
+    USER_STORE_FIELD(temp_key, USER_STORE_COLD, gdo_user_cold_infor),
+};
+
+static const char *const user_part_path[USER_STORE_PARTS] = {GDO_USER_HOT_FULL_PATH, GDO_USER_COLD_FULL_PATH};
+static const size_t user_part_size[USER_STORE_PARTS]      = {sizeof(gdo_user_hot_infor), sizeof(gdo_user_cold_infor)};
+
+struct user_store_batch {
+  struct gdo_fs_iovec iov[USER_STORE_PARTS][GDO_USER_STORE_IOV];
+  size_t count[USER_STORE_PARTS];
+  bool write;
+};
+
+/* the batch is too big for the caller stack, accesses to the split table run one at a time */
+K_MUTEX_DEFINE(user_store_lock);
+static struct user_store_batch user_store_batch;
+
+/*
+ * Drops the segments of @p part that match the file and narrows the others to the changed
+ * bytes, per file, as gdo_fs_write_file_index() does for a single file. The split files only
+ * change under the file lock of GDO_USER_INFOR_FULL_PATH, which the caller holds.
+ */
+static void user_store_compare(struct user_store_batch *batch, int part)
+{
+  size_t kept = 0;
+
+  for (size_t i = 0; i < batch->count[part]; i++) {
+    struct gdo_fs_iovec seg = batch->iov[part][i];
+
+    if (gdo_fs_iov_narrow(user_part_path[part], &seg) == 0 && seg.len == 0) {
+      continue;
+    }
+    batch->iov[part][kept++] = seg;
+  }
+  batch->count[part] = kept;
+}
+
+static int user_store_flush(struct user_store_batch *batch)
+{
+  /* cold first: a new user becomes visible with the hot write, after its keys are stored */
+  for (int part = USER_STORE_PARTS - 1; part >= 0; part--) {
+    int res;
+
+    if (batch->write) {
+      user_store_compare(batch, part);
+    }
+    if (batch->count[part] == 0) {
+      continue;
+    }
+    if (batch->write) {
+      res = gdo_fs_writev_index(GDO_DISK_MOUNT_PT, user_part_path[part], batch->iov[part], batch->count[part]);
+    } else {
+      res = gdo_fs_readv_index(GDO_DISK_MOUNT_PT, user_part_path[part], batch->iov[part], batch->count[part]);
+    }
+    if (res < 0) {
+      LOG_ERR("USER-STORE: %s %s failed", batch->write ? "write" : "read", user_part_path[part]);
+      return -1;
+    }
+    batch->count[part] = 0;
+  }
+  return 0;
+}
+
+static int user_store_add(struct user_store_batch *batch, uint8_t part, uint8_t *buff, size_t len, size_t index)
+{
+  size_t count = batch->count[part];
+
+  if (count > 0) {
+    struct gdo_fs_iovec *last = &batch->iov[part][count - 1];
+
+    /* adjacent in the buffer and in the file, e.g. user_info and temp_key */
+    if (last->index + last->len == index && (uint8_t *) last->buff + last->len == buff) {
+      last->len += len;
+      return 0;
+    }
+  }
+  if (count == GDO_USER_STORE_IOV && user_store_flush(batch) != 0) {
+    return -1;
+  }
+  batch->iov[part][batch->count[part]++] = (struct gdo_fs_iovec){.index = index, .buff = buff, .len = len};
+  return 0;
+}
+
+static int user_store_map(struct user_store_batch *batch, uint8_t *data, size_t len, size_t index)
+{
+  size_t end = index + len;
+
+  if (end > GDO_MAX_USER_SUPORT * sizeof(gdo_user_infor) || end < index) {
+    LOG_ERR("USER-STORE: range %u+%u outside the table", index, len);
+    return -1;
+  }
+  for (size_t r = index / sizeof(gdo_user_infor); r * sizeof(gdo_user_infor) < end; r++) {
+    size_t base = r * sizeof(gdo_user_infor);
+
+    for (size_t f = 0; f < ARRAY_SIZE(user_fields); f++) {
+      const struct user_store_field *field = &user_fields[f];
+      size_t lo                            = MAX(index, base + field->offset);
+      size_t hi                            = MIN(end, base + field->offset + field->len);
+
+      if (lo >= hi) {
+        continue;
+      }
+      size_t part_index = r * user_part_size[field->part] + field->part_offset + (lo - base - field->offset);
+      if (user_store_add(batch, field->part, data + (lo - index), hi - lo, part_index) != 0) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+static int user_store_access(const struct gdo_fs_iovec *iov, size_t iovcnt, bool write)
+{
+  struct user_store_batch *batch = &user_store_batch;
+  int total                      = 0;
+
+  k_mutex_lock(&user_store_lock, K_FOREVER);
+  memset(batch->count, 0, sizeof(batch->count));
+  batch->write = write;
+  for (size_t i = 0; i < iovcnt && total >= 0; i++) {
+    if (user_store_map(batch, iov[i].buff, iov[i].len, iov[i].index) != 0) {
+      total = -1;
+      break;
+    }
+    total += iov[i].len;
+  }
+  if (total >= 0 && user_store_flush(batch) != 0) {
+    total = -1;
+  }
+  k_mutex_unlock(&user_store_lock);
+  return total;
+}
+
+int gdo_user_store_readv(const struct gdo_fs_iovec *iov, size_t iovcnt)
+{
+  return user_store_access(iov, iovcnt, false);
+}
+
+int gdo_user_store_writev(const struct gdo_fs_iovec *iov, size_t iovcnt)
+{
+  return user_store_access(iov, iovcnt, true);
+}
+
+int gdo_user_store_read(void *buff, size_t len, size_t index)
+{
+  struct gdo_fs_iovec iov = {.index = index, .buff = buff, .len = len};
+
+  return user_store_access(&iov, 1, false);
+}
+
+int gdo_user_store_write(const void *buff, size_t len, size_t index)
+{
+  /* only read from on this path */
+  struct gdo_fs_iovec iov = {.index = index, .buff = (void *) buff, .len = len};
+
+  return user_store_access(&iov, 1, true);
+}
+
+bool gdo_user_store_reset(size_t size_file)
+{
+  size_t records = size_file / sizeof(gdo_user_infor);
+
+  /* hot first, the users are gone as soon as it is empty */
+  return gdo_fs_create_file(GDO_USER_HOT_FULL_PATH, records * sizeof(gdo_user_hot_infor)) &&
+         gdo_fs_create_file(GDO_USER_COLD_FULL_PATH, records * sizeof(gdo_user_cold_infor));
+}
+
+int gdo_user_store_size(void)
+{
+  int res = gdo_fs_file_size(GDO_USER_HOT_FULL_PATH);
+
+  return (res < 0) ? res : (int) (res / sizeof(gdo_user_hot_infor) * sizeof(gdo_user_infor));
+}
@@ -0,0 +1,105 @@
+#ifndef _GDO_USER_STORE_H_
+#define _GDO_USER_STORE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "gdo_config.h"
+#include "gdo_user_infor_util.h"
+#include "gdo_file_system_util.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 1: the user table is stored as a dense file of the fields a scan needs and a file of the
+ * large ones. GDO_USER_INFOR_FULL_PATH stays the name callers use, the file system layer maps
+ * every access to it onto the two files. A single file table found at boot is migrated.
+ */
+#ifndef GDO_USER_STORE_SPLIT
+#define GDO_USER_STORE_SPLIT 1
+#endif
+
+#ifndef GDO_USER_HOT_FULL_PATH
+#define GDO_USER_HOT_FULL_PATH GDO_DISK_MOUNT_PT "/user_hot"
+#endif
+
+#ifndef GDO_USER_COLD_FULL_PATH
+#define GDO_USER_COLD_FULL_PATH GDO_DISK_MOUNT_PT "/user_cold"
+#endif
+
+/*
+ * Segments per file collected before the two files are written or read. A record is two
+ * segments in each file, so a batch touching every slot is still one writev per file.
+ */
+#ifndef GDO_USER_STORE_IOV
+#define GDO_USER_STORE_IOV (2 * GDO_MAX_USER_SUPORT)
+#endif
+
+/* Hot part of a gdo_user_infor record, what enumeration and check-user read */
+typedef struct {
+  uint8_t user_name[GDO_MAX_USER_NAME_LEN];
+  uint8_t user_role;
+  uint8_t user_status;
+} gdo_user_hot_infor;
+
+/* Everything else */
+typedef struct {
+  uint8_t pub_key[GDO_ECDH_PUBLIC_KEY_LEN];
+  uint8_t user_info[GDO_USER_INFOR_LEN];
+  uint8_t temp_key[GDO_USER_NUM_TEMP_KEY][GDO_USER_TEMP_KEY_LEN];
+} gdo_user_cold_infor;
+
+/**
+ * @brief True if accesses to @p full_path_file go through the split layout.
+ */
+static inline bool gdo_user_store_routed(const char *full_path_file)
+{
+  return GDO_USER_STORE_SPLIT && strcmp(full_path_file, GDO_USER_INFOR_FULL_PATH) == 0;
+}
+
+/**
+ * @brief True if @p full_path_file is one of the two files behind the split layout.
+ */
+static inline bool gdo_user_store_backs(const char *full_path_file)
+{
+  return GDO_USER_STORE_SPLIT &&
+         (strcmp(full_path_file, GDO_USER_HOT_FULL_PATH) == 0 || strcmp(full_path_file, GDO_USER_COLD_FULL_PATH) == 0);
+}
+
+/**
+ * @brief Read or write byte ranges of the logical user table (gdo_user_infor records).
+ *
+ * Each range is cut along the record fields and the pieces are batched into one
+ * gdo_fs_readv_index/gdo_fs_writev_index per file, the cold file written before the hot one so
+ * a user only shows up once its keys are stored. Called by the file system layer with the file
+ * lock of GDO_USER_INFOR_FULL_PATH held.
+ *
+ * A write is one commit per file, not one for the table: if the hot write fails after the cold
+ * one, new users stay invisible but an updated user keeps its new cold fields with its old hot
+ * ones, and a file write failing part way keeps the segments before the failure. Batches that
+ * must be atomic are staged first, see gdo_user_bulk.h.
+ *
+ * @return Total bytes, or -1 if a range is outside the table or a file access failed.
+ */
+int gdo_user_store_readv(const struct gdo_fs_iovec *iov, size_t iovcnt);
+int gdo_user_store_writev(const struct gdo_fs_iovec *iov, size_t iovcnt);
+int gdo_user_store_read(void *buff, size_t len, size_t index);
+int gdo_user_store_write(const void *buff, size_t len, size_t index);
+
+/**
+ * @brief Recreate both files empty for a logical table of @p size_file bytes.
+ */
+bool gdo_user_store_reset(size_t size_file);
+
+/**
+ * @brief Logical size of the table, or a negative error code if the hot file is missing.
+ */
+int gdo_user_store_size(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif